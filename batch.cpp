@@ -0,0 +1,491 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <QtConcurrent>
+
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+
+// Пакетный режим без камеры и окон: lab-2 --batch --filters чб,сеп --out DIR входы...
+// Снимки идут конвейером декодирование -> фильтры -> кодирование -> запись;
+// стадии связаны очередями ограниченной длины, так что память не растёт с
+// размером архива, а медленная стадия притормаживает остальные. Декодеры и
+// кодировщики работают на всех ядрах, фильтры и так делят кадр на полосы.
+// Снимки от tiledMinPixels (или все, с --tiled) идут мимо конвейера, по
+// одному и полосами (tiled.cpp). Видео отдаются saveFilteredVideos и идут
+// через общую очередь экспорта.
+
+template <typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(int capacity, int producers) : capacity(qMax(1, capacity)), producers(producers) {}
+
+    void push(T item) {
+        QMutexLocker locker(&mutex);
+        while (int(items.size()) >= capacity) {
+            notFull.wait(&mutex);
+        }
+        items.push_back(std::move(item));
+        notEmpty.wakeOne();
+    }
+
+    // false — очередь пуста и все производители закончили.
+    bool pop(T *item) {
+        QMutexLocker locker(&mutex);
+        while (items.empty() && producers > 0) {
+            notEmpty.wait(&mutex);
+        }
+        if (items.empty()) {
+            return false;
+        }
+        *item = std::move(items.front());
+        items.pop_front();
+        notFull.wakeOne();
+        return true;
+    }
+
+    void producerDone() {
+        QMutexLocker locker(&mutex);
+        if (--producers == 0) {
+            notEmpty.wakeAll();
+        }
+    }
+
+private:
+    QMutex mutex;
+    QWaitCondition notFull;
+    QWaitCondition notEmpty;
+    std::deque<T> items;
+    const int capacity;
+    int producers;
+};
+
+struct BatchDecoded {
+    QString input;
+    QImage image;
+};
+
+struct BatchFiltered {
+    QString filePath;
+    QImage image;
+};
+
+struct BatchEncoded {
+    QString filePath;
+    QByteArray data;
+};
+
+struct BatchStats {
+    std::atomic<int> images{0};
+    std::atomic<int> failures{0};
+    std::atomic<qint64> bytesIn{0};
+    std::atomic<qint64> bytesOut{0};
+};
+
+static bool isBatchVideo(const QString &path) {
+    static const QStringList suffixes = {QStringLiteral("mp4"), QStringLiteral("mov"), QStringLiteral("mkv"),
+                                         QStringLiteral("avi"), QStringLiteral("webm")};
+    return suffixes.contains(QFileInfo(path).suffix().toLower());
+}
+
+static bool isBatchImage(const QString &path) {
+    return QImageReader::supportedImageFormats().contains(QFileInfo(path).suffix().toLower().toLatin1());
+}
+
+// Вход — файл, каталог (рекурсивно) или маска вида dir/*.jpg.
+static QStringList expandBatchInputs(const QStringList &patterns) {
+    QStringList files;
+    for (const QString &pattern : patterns) {
+        const QFileInfo info(pattern);
+        if (info.isDir()) {
+            QDirIterator it(pattern, QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                const QString path = it.next();
+                if (isBatchImage(path) || isBatchVideo(path)) {
+                    files.append(path);
+                }
+            }
+        } else if (info.isFile()) {
+            files.append(info.filePath());
+        } else {
+            const QDir dir(info.path());
+            for (const QString &name : dir.entryList(QStringList(info.fileName()), QDir::Files, QDir::Name)) {
+                files.append(dir.filePath(name));
+            }
+        }
+    }
+    files.removeDuplicates();
+    return files;
+}
+
+// Имена выходов: <имя входа>_<фильтр>; совпавшие имена из разных каталогов
+// получают номер. Общие для конвейера, полосовой обработки и видео.
+class BatchOutputNames {
+public:
+    BatchOutputNames(const QDir &outDir, ImageFormat format) : outDir(outDir), suffix(imageFormatSuffix(format)) {}
+
+    QString path(const QString &input, const QString &code) {
+        const QString slug = filterSlug(code);
+        const QString stem = QFileInfo(input).completeBaseName() + QLatin1Char('_')
+                             + (slug.isEmpty() ? QStringLiteral("image") : slug);
+        QMutexLocker locker(&mutex);
+        QString name = stem + QLatin1Char('.') + suffix;
+        for (int n = 2; usedNames.contains(name); ++n) {
+            name = QStringLiteral("%1_%2.%3").arg(stem).arg(n).arg(suffix);
+        }
+        usedNames.insert(name);
+        return outDir.filePath(name);
+    }
+
+    // Начало имён выходов ролика (<prefix>_<номер>_<фильтр>.mp4): ролики с
+    // одинаковым именем из разных каталогов иначе писали бы в одни файлы.
+    QString videoPrefix(const QString &input) {
+        const QString stem = QFileInfo(input).completeBaseName();
+        QMutexLocker locker(&mutex);
+        QString prefix = stem;
+        for (int n = 2; usedVideoPrefixes.contains(prefix); ++n) {
+            prefix = QStringLiteral("%1_%2").arg(stem).arg(n);
+        }
+        usedVideoPrefixes.insert(prefix);
+        return prefix;
+    }
+
+private:
+    const QDir outDir;
+    const QString suffix;
+    QMutex mutex;
+    QSet<QString> usedNames;
+    QSet<QString> usedVideoPrefixes;
+};
+
+// Конвейер снимков; возвращается, когда записан последний файл.
+static void runImagePipeline(const QStringList &inputs, const QList<QString> &codes, BatchOutputNames &names,
+                             const ImageEncodeOptions &encoding, int jobs, BatchStats &stats) {
+    const int decoders = qMax(1, jobs / 2);
+    const int filterers = qMin(2, jobs);
+    const int encoders = jobs;
+
+    BoundedQueue<BatchDecoded> decoded(qMax(2, filterers * 2), decoders);
+    BoundedQueue<BatchFiltered> filtered(qMax(codes.size(), encoders * 2), filterers);
+    BoundedQueue<BatchEncoded> encoded(encoders * 2, encoders);
+
+    // у каждой стадии свои потоки: стадии ждут друг друга на очередях, и общий
+    // пул, из которого фильтры берут помощников для полос, остаётся свободным
+    QThreadPool stages;
+    stages.setMaxThreadCount(decoders + filterers + encoders + 1);
+
+    std::atomic<int> nextInput{0};
+    for (int i = 0; i < decoders; ++i) {
+        QtConcurrent::run(&stages, [&]() {
+            for (;;) {
+                const int index = nextInput.fetch_add(1);
+                if (index >= inputs.size()) {
+                    break;
+                }
+                const QString &input = inputs.at(index);
+                QImageReader reader(input);
+                reader.setAutoTransform(true);
+                BatchDecoded item;
+                item.input = input;
+                {
+                    TraceScope scope("image.decode", input);
+                    // read() декодирует прямо в кадр из пула, если размер и формат совпали
+                    item.image = pooledImage(reader.size().width(), reader.size().height(), reader.imageFormat());
+                    if (!reader.read(&item.image)) {
+                        item.image = QImage();
+                    }
+                }
+                if (item.image.isNull()) {
+                    qWarning() << "Не удалось прочитать" << input << ":" << reader.errorString();
+                    ++stats.failures;
+                    continue;
+                }
+                stats.bytesIn += QFileInfo(input).size();
+                decoded.push(std::move(item));
+            }
+            decoded.producerDone();
+        });
+    }
+
+    for (int i = 0; i < filterers; ++i) {
+        QtConcurrent::run(&stages, [&]() {
+            BatchDecoded item;
+            while (decoded.pop(&item)) {
+                // с одним фильтром декодированный кадр отдаётся ему целиком и меняется на месте
+                const QList<QImage> results = codes.size() == 1 ? QList<QImage>() << applyFilter(std::move(item.image), codes.first())
+                                                                : applyFilters(item.image, codes);
+                item.image = QImage();
+                for (int k = 0; k < results.size(); ++k) {
+                    BatchFiltered out;
+                    out.filePath = names.path(item.input, codes.at(k));
+                    out.image = results.at(k);
+                    filtered.push(std::move(out));
+                }
+                ++stats.images;
+            }
+            filtered.producerDone();
+        });
+    }
+
+    for (int i = 0; i < encoders; ++i) {
+        QtConcurrent::run(&stages, [&]() {
+            BatchFiltered item;
+            while (filtered.pop(&item)) {
+                BatchEncoded out;
+                out.filePath = item.filePath;
+                out.data = encodeImage(item.image, encoding);
+                item.image = QImage();
+                if (out.data.isEmpty()) {
+                    qWarning() << "Не удалось закодировать" << out.filePath;
+                    ++stats.failures;
+                    continue;
+                }
+                encoded.push(std::move(out));
+            }
+            encoded.producerDone();
+        });
+    }
+
+    // запись одна: диску параллельные мелкие записи только мешают
+    QtConcurrent::run(&stages, [&]() {
+        BatchEncoded item;
+        while (encoded.pop(&item)) {
+            if (writeEncodedFile(item.filePath, item.data)) {
+                stats.bytesOut += item.data.size();
+            } else {
+                qWarning() << "Не удалось сохранить" << item.filePath;
+                ++stats.failures;
+            }
+        }
+    });
+
+    // ожидание не должно занимать поток общего пула, где работают полосы фильтров
+    QThreadPool::globalInstance()->releaseThread();
+    stages.waitForDone();
+    QThreadPool::globalInstance()->reserveThread();
+}
+
+// Большие снимки по одному, полосами (tiled.cpp): каждый сам делит полосы
+// между всеми ядрами, а память не растёт с размером снимка.
+static void runTiledImages(const QStringList &inputs, const QList<QString> &codes, BatchOutputNames &names,
+                           const ImageEncodeOptions &encoding, BatchStats &stats) {
+    for (const QString &input : inputs) {
+        QStringList outputs;
+        for (const QString &code : codes) {
+            outputs.append(names.path(input, code));
+        }
+        const QList<bool> written = processImageTiled(input, codes, outputs, encoding);
+        bool any = false;
+        for (int i = 0; i < written.size(); ++i) {
+            if (written.at(i)) {
+                stats.bytesOut += QFileInfo(outputs.at(i)).size();
+                any = true;
+            } else {
+                ++stats.failures;
+            }
+        }
+        if (any) {
+            ++stats.images;
+            stats.bytesIn += QFileInfo(input).size();
+        }
+    }
+}
+
+static int runBatch(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Пакетная обработка снимков и видео фильтрами lab-2"));
+    parser.addHelpOption();
+    const QCommandLineOption batchOption(QStringLiteral("batch"), QStringLiteral("Пакетный режим."));
+    const QCommandLineOption filtersOption(QStringLiteral("filters"),
+                                           QStringLiteral("Коды фильтров или цепочки (теп+пос:4) через запятую, или all."),
+                                           QStringLiteral("codes"));
+    const QCommandLineOption outOption(QStringLiteral("out"), QStringLiteral("Каталог результатов."),
+                                       QStringLiteral("dir"));
+    const QCommandLineOption formatOption(QStringLiteral("format"),
+                                          QStringLiteral("Формат снимков: png, png-fast, qoi, webp, jpg."),
+                                          QStringLiteral("format"), QStringLiteral("png"));
+    const QCommandLineOption pngLevelOption(QStringLiteral("png-level"),
+                                            QStringLiteral("Уровень сжатия PNG, 0–9 (по умолчанию из --format)."),
+                                            QStringLiteral("level"));
+    const QCommandLineOption pngFilterOption(QStringLiteral("png-filter"),
+                                             QStringLiteral("Фильтр строк PNG: adaptive, none, sub, up, average, paeth."),
+                                             QStringLiteral("filter"));
+    const QCommandLineOption jobsOption(QStringLiteral("jobs"), QStringLiteral("Число потоков на стадию."),
+                                       QStringLiteral("n"), QString::number(QThread::idealThreadCount()));
+    const QCommandLineOption traceOption(QStringLiteral("trace"),
+                                         QStringLiteral("Записать Chrome trace этапов и напечатать сводку."),
+                                         QStringLiteral("file"));
+    const QCommandLineOption tiledOption(QStringLiteral("tiled"),
+                                         QStringLiteral("Обрабатывать полосами все снимки, а не только от %1 Мп.")
+                                             .arg(tiledMinPixels / 1000000));
+    parser.addOptions({batchOption, filtersOption, outOption, formatOption, pngLevelOption, pngFilterOption, jobsOption,
+                       tiledOption, traceOption});
+    parser.addPositionalArgument(QStringLiteral("inputs"), QStringLiteral("Файлы, каталоги или маски (dir/*.jpg)."),
+                                 QStringLiteral("inputs..."));
+    parser.process(app);
+
+    loadFilterChains();
+    QList<QString> codes;
+    const QString filterList = parser.value(filtersOption);
+    if (filterList == QStringLiteral("all")) {
+        for (const FilterSpec *spec : registeredFilters()) {
+            codes.append(spec->code);
+        }
+    } else {
+        for (const QString &part : filterList.split(QLatin1Char(','))) {
+            const QString code = part.trimmed();
+            if (code.isEmpty()) {
+                continue;
+            }
+            QString chainError;
+            if (isFilterChainExpression(code) && !registerFilterChain(code, code, code, &chainError)) {
+                qCritical().noquote() << QStringLiteral("Цепочка %1 не разбирается: %2").arg(code, chainError);
+                return EXIT_FAILURE;
+            }
+            if (!findFilter(code)) {
+                QStringList known;
+                for (const FilterSpec *spec : registeredFilters()) {
+                    known.append(spec->code);
+                }
+                qCritical().noquote() << QStringLiteral("Неизвестный фильтр %1, есть: %2").arg(code, known.join(QStringLiteral(", ")));
+                return EXIT_FAILURE;
+            }
+            codes.append(code);
+        }
+    }
+    codes.removeDuplicates();
+    if (codes.isEmpty() || parser.value(outOption).isEmpty() || parser.positionalArguments().isEmpty()) {
+        parser.showHelp(EXIT_FAILURE);
+    }
+
+    ImageEncodeOptions encoding;
+    const QString format = parser.value(formatOption).toLower();
+    if (format == QStringLiteral("png-fast")) {
+        encoding.pngLevel = 1;
+        encoding.pngFilter = PngFilter::Sub;
+    } else if (format == QStringLiteral("qoi")) {
+        encoding.format = ImageFormat::Qoi;
+    } else if (format == QStringLiteral("webp")) {
+        encoding.format = ImageFormat::WebpLossless;
+    } else if (format == QStringLiteral("jpg") || format == QStringLiteral("jpeg")) {
+        encoding.format = ImageFormat::Jpeg;
+    } else if (format != QStringLiteral("png")) {
+        qCritical() << "Неизвестный формат" << format;
+        return EXIT_FAILURE;
+    }
+    if (parser.isSet(pngLevelOption)) {
+        bool ok = false;
+        encoding.pngLevel = parser.value(pngLevelOption).toInt(&ok);
+        if (!ok || encoding.pngLevel < 0 || encoding.pngLevel > 9) {
+            qCritical() << "Уровень сжатия PNG должен быть от 0 до 9";
+            return EXIT_FAILURE;
+        }
+    }
+    if (parser.isSet(pngFilterOption)) {
+        const QString name = parser.value(pngFilterOption).toLower();
+        bool found = false;
+        for (const auto &filter : pngFilterNames()) {
+            if (filter.first == name) {
+                encoding.pngFilter = filter.second;
+                found = true;
+            }
+        }
+        if (!found) {
+            qCritical() << "Неизвестный фильтр строк PNG" << name;
+            return EXIT_FAILURE;
+        }
+    }
+
+    QDir outDir(parser.value(outOption));
+    if (!outDir.exists() && !outDir.mkpath(QStringLiteral("."))) {
+        qCritical() << "Не удалось создать каталог" << outDir.path();
+        return EXIT_FAILURE;
+    }
+    const int jobs = qMax(1, parser.value(jobsOption).toInt());
+
+    // снимки больше tiledMinPixels конвейер не берёт: в его очередях лежат
+    // целые кадры, по нескольку на стадию
+    QStringList images;
+    QStringList largeImages;
+    QStringList videos;
+    for (const QString &input : expandBatchInputs(parser.positionalArguments())) {
+        if (isBatchVideo(input)) {
+            videos.append(input);
+            continue;
+        }
+        const QSize size = QImageReader(input).size();
+        if (parser.isSet(tiledOption) || qint64(size.width()) * size.height() >= tiledMinPixels) {
+            largeImages.append(input);
+        } else {
+            images.append(input);
+        }
+    }
+    if (images.isEmpty() && largeImages.isEmpty() && videos.isEmpty()) {
+        qCritical() << "Нет входных файлов";
+        return EXIT_FAILURE;
+    }
+
+    QString tracePath = startTracingFromEnvironment();
+    if (parser.isSet(traceOption)) {
+        tracePath = parser.value(traceOption);
+        startTracing();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    BatchOutputNames names(outDir, encoding.format);
+    QList<QFuture<bool>> videoTasks;
+    for (const QString &video : videos) {
+        videoTasks.append(saveFilteredVideos(video, codes, outDir.path(), names.videoPrefix(video)));
+    }
+
+    BatchStats stats;
+    const QFuture<void> imageTask = QtConcurrent::run([&]() {
+        runImagePipeline(images, codes, names, encoding, jobs, stats);
+        runTiledImages(largeImages, codes, names, encoding, stats);
+    });
+
+    QList<QFuture<void>> allTasks;
+    allTasks.append(imageTask);
+    for (const QFuture<bool> &task : videoTasks) {
+        allTasks.append(QFuture<void>(task));
+    }
+    waitForFutures(allTasks);
+
+    int videoFailures = 0;
+    for (const QFuture<bool> &task : videoTasks) {
+        if (!task.result()) {
+            ++videoFailures;
+        }
+    }
+
+    const double seconds = qMax(1e-3, timer.elapsed() / 1000.0);
+    const double megabyte = 1024.0 * 1024.0;
+    qInfo().noquote() << QStringLiteral("Снимков: %1 за %2 с — %3 снимков/с, чтение %4 МБ/с, запись %5 МБ/с")
+                             .arg(stats.images.load())
+                             .arg(seconds, 0, 'f', 2)
+                             .arg(stats.images.load() / seconds, 0, 'f', 2)
+                             .arg(stats.bytesIn.load() / megabyte / seconds, 0, 'f', 1)
+                             .arg(stats.bytesOut.load() / megabyte / seconds, 0, 'f', 1);
+    if (!videoTasks.isEmpty()) {
+        qInfo().noquote() << QStringLiteral("Видео: %1 роликов, %2 файлов, ошибок %3")
+                                 .arg(videos.size()).arg(videoTasks.size()).arg(videoFailures);
+    }
+    finishTracing(tracePath);
+    const int failures = stats.failures.load() + videoFailures;
+    if (failures > 0) {
+        qWarning() << "Ошибок:" << failures;
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
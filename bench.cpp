@@ -0,0 +1,352 @@
+#include <QtWidgets>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <cstdlib>
+#include "src.cpp"
+
+// Замеры горячих путей: фильтры на типовых размерах кадра в одном потоке и на
+// всех ядрах, кодировщики снимков и экспорт видео на синтетическом ролике.
+// Результаты пишутся в JSON; с --baseline прошлый JSON сравнивается с текущим,
+// и просадка больше --tolerance процентов даёт код возврата 1.
+
+struct BenchSize {
+    const char *name;
+    int width;
+    int height;
+};
+
+static const BenchSize benchSizes[] = {
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"4k", 3840, 2160},
+    {"12mp", 4000, 3000},
+};
+
+// Каждый замер повторяется, пока не наберётся benchMinMs, но не больше benchMaxRuns раз.
+static const int benchMinMs = 500;
+static const int benchMaxRuns = 30;
+
+struct BenchTiming {
+    double medianMs = 0;
+    double minMs = 0;
+    int runs = 0;
+};
+
+// Плавный градиент с лёгким шумом: и фильтрам, и PNG достаётся что-то похожее
+// на фотографию, а не сплошная заливка. Одинаков от запуска к запуску.
+static QImage benchImage(int width, int height) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    std::mt19937 rng(12345);
+    for (int y = 0; y < height; ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const int noise = int(rng() % 17) - 8;
+            line[x] = qRgb(clampInt(x * 255 / width + noise), clampInt(y * 255 / height + noise),
+                           clampInt((x + y) * 127 / (width + height) + 64 + noise));
+        }
+    }
+    return image;
+}
+
+static BenchTiming benchRun(const std::function<void()> &body, int minMs) {
+    body(); // прогрев: кэши таблиц, масок и страницы памяти
+    std::vector<double> samples;
+    QElapsedTimer total;
+    total.start();
+    while (int(samples.size()) < benchMaxRuns && (samples.size() < 3 || total.elapsed() < minMs)) {
+        QElapsedTimer timer;
+        timer.start();
+        body();
+        samples.push_back(timer.nsecsElapsed() / 1e6);
+    }
+    std::sort(samples.begin(), samples.end());
+    BenchTiming timing;
+    timing.medianMs = samples[samples.size() / 2];
+    timing.minMs = samples.front();
+    timing.runs = int(samples.size());
+    return timing;
+}
+
+static QString benchFilterName(const FilterSpec &spec) {
+    return spec.slug.isEmpty() ? QStringLiteral("none") : spec.slug;
+}
+
+static QJsonArray benchFilters(const QList<const BenchSize *> &sizes, int minMs) {
+    QJsonArray results;
+    // однопоточный режим: пул из одного потока, полосы фильтра идут в вызывающем потоке
+    QThreadPool singlePool;
+    singlePool.setMaxThreadCount(1);
+
+    for (const BenchSize *size : sizes) {
+        const QImage source = benchImage(size->width, size->height);
+        const double mpix = double(size->width) * size->height / 1e6;
+        for (const FilterSpec *spec : registeredFilters()) {
+            for (int parallel = 0; parallel < 2; ++parallel) {
+                BenchTiming timing;
+                {
+                    ParallelPoolScope scope(parallel ? QThreadPool::globalInstance() : &singlePool);
+                    timing = benchRun([&]() { applyFilter(source, spec->code); }, minMs);
+                }
+                const double mpixPerSecond = mpix * 1000.0 / timing.medianMs;
+                QJsonObject entry;
+                entry[QStringLiteral("filter")] = benchFilterName(*spec);
+                entry[QStringLiteral("size")] = QString::fromLatin1(size->name);
+                entry[QStringLiteral("mode")] = parallel ? QStringLiteral("parallel") : QStringLiteral("single");
+                entry[QStringLiteral("median_ms")] = timing.medianMs;
+                entry[QStringLiteral("min_ms")] = timing.minMs;
+                entry[QStringLiteral("runs")] = timing.runs;
+                entry[QStringLiteral("mpix_per_s")] = mpixPerSecond;
+                results.append(entry);
+                qInfo().noquote() << QStringLiteral("filter %1 %2 %3: %4 ms, %5 Mpix/s")
+                                         .arg(benchFilterName(*spec), 10)
+                                         .arg(QString::fromLatin1(size->name), 6)
+                                         .arg(parallel ? QStringLiteral("parallel") : QStringLiteral("single"), 8)
+                                         .arg(timing.medianMs, 8, 'f', 2)
+                                         .arg(mpixPerSecond, 8, 'f', 1);
+            }
+        }
+    }
+    return results;
+}
+
+static QJsonArray benchEncoders(const QList<const BenchSize *> &sizes, int minMs) {
+    QList<QPair<QString, ImageEncodeOptions>> variants;
+    ImageEncodeOptions png;
+    variants.append(qMakePair(QStringLiteral("png"), png));
+    ImageEncodeOptions serialPng;
+    serialPng.parallelDeflate = false;
+    variants.append(qMakePair(QStringLiteral("png-serial-deflate"), serialPng));
+    ImageEncodeOptions fastPng;
+    fastPng.pngLevel = 1;
+    fastPng.pngFilter = PngFilter::Sub;
+    variants.append(qMakePair(QStringLiteral("png-fast"), fastPng));
+    ImageEncodeOptions qoi;
+    qoi.format = ImageFormat::Qoi;
+    variants.append(qMakePair(QStringLiteral("qoi"), qoi));
+
+    QJsonArray results;
+    for (const BenchSize *size : sizes) {
+        const QImage source = benchImage(size->width, size->height);
+        const double megabytes = double(size->width) * size->height * 4 / (1024.0 * 1024.0);
+        for (const QPair<QString, ImageEncodeOptions> &variant : variants) {
+            qint64 encodedBytes = 0;
+            const BenchTiming timing = benchRun([&]() { encodedBytes = encodeImage(source, variant.second).size(); }, minMs);
+            const double megabytesPerSecond = megabytes * 1000.0 / timing.medianMs;
+            QJsonObject entry;
+            entry[QStringLiteral("encoder")] = variant.first;
+            entry[QStringLiteral("size")] = QString::fromLatin1(size->name);
+            entry[QStringLiteral("median_ms")] = timing.medianMs;
+            entry[QStringLiteral("min_ms")] = timing.minMs;
+            entry[QStringLiteral("runs")] = timing.runs;
+            entry[QStringLiteral("bytes")] = encodedBytes;
+            entry[QStringLiteral("mb_per_s")] = megabytesPerSecond;
+            results.append(entry);
+            qInfo().noquote() << QStringLiteral("encode %1 %2: %3 ms, %4 MB/s, %5 bytes")
+                                     .arg(variant.first, 18)
+                                     .arg(QString::fromLatin1(size->name), 6)
+                                     .arg(timing.medianMs, 8, 'f', 2)
+                                     .arg(megabytesPerSecond, 8, 'f', 1)
+                                     .arg(encodedBytes);
+        }
+    }
+    return results;
+}
+
+// Экспорт видео целиком, как из окна: синтетический ролик testsrc2 от ffmpeg
+// проходит через saveFilteredVideos со всеми фильтрами сразу.
+static QJsonObject benchVideo(int seconds) {
+    QJsonObject result;
+    const QString ffmpegPath = QStandardPaths::findExecutable(QStringLiteral("ffmpeg"));
+    QTemporaryDir workDir;
+    if (ffmpegPath.isEmpty() || !workDir.isValid()) {
+        result[QStringLiteral("skipped")] = QStringLiteral("ffmpeg not found");
+        qWarning() << "video: ffmpeg не найден, замер пропущен";
+        return result;
+    }
+
+    const int fps = 30;
+    const QString clipPath = workDir.filePath(QStringLiteral("clip.mp4"));
+    const QStringList clipArguments = {
+        QStringLiteral("-v"), QStringLiteral("error"), QStringLiteral("-y"),
+        QStringLiteral("-f"), QStringLiteral("lavfi"),
+        QStringLiteral("-i"), QStringLiteral("testsrc2=size=1280x720:rate=%1").arg(fps),
+        QStringLiteral("-t"), QString::number(seconds),
+        QStringLiteral("-pix_fmt"), QStringLiteral("yuv420p"), clipPath,
+    };
+    if (!runFfmpeg(ffmpegPath, clipArguments, QStringLiteral("синтетический ролик"))) {
+        result[QStringLiteral("skipped")] = QStringLiteral("ffmpeg failed to generate the clip");
+        return result;
+    }
+
+    QList<QString> codes;
+    for (const FilterSpec *spec : registeredFilters()) {
+        codes.append(spec->code);
+    }
+
+    // выделения буферов кадров не должны расти с длиной ролика: после разгона всё из пула
+    const ImageBufferPoolStats poolBefore = imageBufferPool().stats();
+    QElapsedTimer timer;
+    timer.start();
+    const QList<QFuture<bool>> tasks = saveFilteredVideos(clipPath, codes, workDir.filePath(QStringLiteral("out")),
+                                                          QStringLiteral("bench"));
+    QList<QFuture<void>> pending;
+    for (const QFuture<bool> &task : tasks) {
+        pending.append(QFuture<void>(task));
+    }
+    waitForFutures(pending);
+    int failures = 0;
+    for (const QFuture<bool> &task : tasks) {
+        if (!task.result()) {
+            ++failures;
+        }
+    }
+    const double elapsedSeconds = qMax(1e-3, timer.nsecsElapsed() / 1e9);
+    const int frames = seconds * fps;
+    const double framesPerSecond = double(frames) * tasks.size() / elapsedSeconds;
+    const ImageBufferPoolStats poolAfter = imageBufferPool().stats();
+
+    result[QStringLiteral("width")] = 1280;
+    result[QStringLiteral("height")] = 720;
+    result[QStringLiteral("frames")] = frames;
+    result[QStringLiteral("outputs")] = tasks.size();
+    result[QStringLiteral("failures")] = failures;
+    result[QStringLiteral("seconds")] = elapsedSeconds;
+    result[QStringLiteral("frames_per_s")] = framesPerSecond;
+    result[QStringLiteral("buffers_acquired")] = double(poolAfter.acquired - poolBefore.acquired);
+    result[QStringLiteral("buffers_allocated")] = double(poolAfter.allocated - poolBefore.allocated);
+    qInfo().noquote() << QStringLiteral("video 720p x%1 outputs: %2 s, %3 frames/s, failures %4, buffers %5 allocated of %6")
+                             .arg(tasks.size())
+                             .arg(elapsedSeconds, 0, 'f', 2)
+                             .arg(framesPerSecond, 0, 'f', 1)
+                             .arg(failures)
+                             .arg(poolAfter.allocated - poolBefore.allocated)
+                             .arg(poolAfter.acquired - poolBefore.acquired);
+    return result;
+}
+
+// Плоский словарь «ключ замера -> пропускная способность» для сравнения запусков.
+static QHash<QString, double> benchThroughputs(const QJsonObject &report) {
+    QHash<QString, double> values;
+    for (const QJsonValue &value : report.value(QStringLiteral("filters")).toArray()) {
+        const QJsonObject entry = value.toObject();
+        values.insert(QStringLiteral("filter/%1/%2/%3")
+                          .arg(entry.value(QStringLiteral("filter")).toString(),
+                               entry.value(QStringLiteral("size")).toString(),
+                               entry.value(QStringLiteral("mode")).toString()),
+                      entry.value(QStringLiteral("mpix_per_s")).toDouble());
+    }
+    for (const QJsonValue &value : report.value(QStringLiteral("encoders")).toArray()) {
+        const QJsonObject entry = value.toObject();
+        values.insert(QStringLiteral("encode/%1/%2")
+                          .arg(entry.value(QStringLiteral("encoder")).toString(),
+                               entry.value(QStringLiteral("size")).toString()),
+                      entry.value(QStringLiteral("mb_per_s")).toDouble());
+    }
+    const QJsonObject video = report.value(QStringLiteral("video")).toObject();
+    if (video.contains(QStringLiteral("frames_per_s"))) {
+        values.insert(QStringLiteral("video/720p"), video.value(QStringLiteral("frames_per_s")).toDouble());
+    }
+    return values;
+}
+
+// Возвращает число замеров, просевших больше чем на tolerance процентов.
+static int compareWithBaseline(const QJsonObject &report, const QJsonObject &baseline, double tolerance) {
+    const QHash<QString, double> current = benchThroughputs(report);
+    const QHash<QString, double> previous = benchThroughputs(baseline);
+    QStringList keys = current.keys();
+    keys.sort();
+    int regressions = 0;
+    for (const QString &key : keys) {
+        const double before = previous.value(key);
+        if (before <= 0) {
+            continue;
+        }
+        const double change = (current.value(key) - before) / before * 100.0;
+        if (change < -tolerance) {
+            ++regressions;
+            qWarning().noquote() << QStringLiteral("REGRESSION %1: %2 -> %3 (%4%)")
+                                        .arg(key)
+                                        .arg(before, 0, 'f', 1)
+                                        .arg(current.value(key), 0, 'f', 1)
+                                        .arg(change, 0, 'f', 1);
+        }
+    }
+    qInfo().noquote() << QStringLiteral("baseline: %1 общих замеров, просело больше %2%: %3")
+                             .arg(keys.size())
+                             .arg(tolerance)
+                             .arg(regressions);
+    return regressions;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Замеры фильтров, кодировщиков и экспорта видео lab-2"));
+    parser.addHelpOption();
+    const QCommandLineOption jsonOption(QStringLiteral("json"), QStringLiteral("Куда записать JSON (по умолчанию stdout)."),
+                                        QStringLiteral("file"));
+    const QCommandLineOption baselineOption(QStringLiteral("baseline"),
+                                            QStringLiteral("JSON прошлого запуска для сравнения."),
+                                            QStringLiteral("file"));
+    const QCommandLineOption toleranceOption(QStringLiteral("tolerance"),
+                                             QStringLiteral("Допустимая просадка, проценты."),
+                                             QStringLiteral("percent"), QStringLiteral("10"));
+    const QCommandLineOption quickOption(QStringLiteral("quick"),
+                                         QStringLiteral("Только 720p и 1080p, короткие серии и ролик."));
+    const QCommandLineOption noVideoOption(QStringLiteral("no-video"), QStringLiteral("Пропустить экспорт видео."));
+    parser.addOptions({jsonOption, baselineOption, toleranceOption, quickOption, noVideoOption});
+    parser.process(app);
+
+    const bool quick = parser.isSet(quickOption);
+    QList<const BenchSize *> sizes;
+    for (const BenchSize &size : benchSizes) {
+        if (!quick || size.height <= 1080) {
+            sizes.append(&size);
+        }
+    }
+    const int minMs = quick ? benchMinMs / 5 : benchMinMs;
+
+    QJsonObject report;
+    report[QStringLiteral("version")] = 1;
+    report[QStringLiteral("date")] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report[QStringLiteral("cpu")] = QSysInfo::currentCpuArchitecture();
+    report[QStringLiteral("threads")] = QThreadPool::globalInstance()->maxThreadCount();
+    report[QStringLiteral("kernels")] = QString::fromLatin1(pixelKernels().name);
+    report[QStringLiteral("qt")] = QString::fromLatin1(qVersion());
+    report[QStringLiteral("filters")] = benchFilters(sizes, minMs);
+    report[QStringLiteral("encoders")] = benchEncoders(sizes, minMs);
+    if (!parser.isSet(noVideoOption)) {
+        report[QStringLiteral("video")] = benchVideo(quick ? 2 : 5);
+    }
+
+    const QByteArray json = QJsonDocument(report).toJson();
+    if (parser.isSet(jsonOption)) {
+        QFile file(parser.value(jsonOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            qCritical() << "Не удалось записать" << file.fileName();
+            return EXIT_FAILURE;
+        }
+    } else {
+        QTextStream(stdout) << json;
+    }
+
+    if (parser.isSet(baselineOption)) {
+        QFile file(parser.value(baselineOption));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCritical() << "Не удалось прочитать" << file.fileName();
+            return EXIT_FAILURE;
+        }
+        const QJsonObject baseline = QJsonDocument::fromJson(file.readAll()).object();
+        if (compareWithBaseline(report, baseline, parser.value(toleranceOption).toDouble()) > 0) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,11 @@
+# Замеры: qmake ../bench.pro && make && ./lab-2-bench --json bench.json
+QT += widgets concurrent
+TEMPLATE = app
+TARGET = lab-2-bench
+CONFIG += console release
+CONFIG -= app_bundle
+SOURCES += bench.cpp
+LIBS += -lz
+
+# те же флаги, что и у приложения, иначе замеряются другие ядра
+*-g++*|*clang*: QMAKE_CXXFLAGS += -ffp-contract=off
@@ -0,0 +1,241 @@
+#include <QImage>
+#include <QMutex>
+#include <QtGlobal>
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+// Пул пиксельных буферов. Кадр из пула — обычный QImage поверх чужой памяти
+// с функцией очистки: когда последняя копия QImage уходит, буфер не
+// освобождается, а возвращается в пул и достаётся следующему кадру того же
+// класса размера. Классы — четверти октавы (4, 5, 6, 7 × 2^k байт), так что
+// запас на кадр не больше 25%, а кадры одного размера всегда попадают в один
+// класс. Предпросмотр, сохранение, серия и видео берут кадры из одного пула:
+// после первых кадров работа с кадрами не выделяет память под пиксели.
+//
+// Копия такого QImage разделяет буфер, как и у обычного; запись в разделённый
+// кадр отсоединяет его по-обычному, в кучу, поэтому владельцы меняют кадр на
+// месте только через ownedArgb32().
+
+// Мелкие картинки дешевле выделить, чем держать в пуле.
+static const size_t imagePoolMinBytes = 64 * 1024;
+// Больше в пуле не лежит: хватает на видео 1080p с несколькими фильтрами и
+// окном кадров, лишнее освобождается сразу.
+static const size_t imagePoolMaxCachedBytes = size_t(256) * 1024 * 1024;
+// Буферы выравниваются на линию кэша (::operator new даёт только 16 байт), а
+// заголовок перед пикселями кратен 64, поэтому и пиксели начинаются с линии.
+static const size_t imagePoolAlignment = 64;
+static const size_t imagePoolHeaderBytes = 64;
+
+class ImageBufferPool;
+
+struct PooledBuffer {
+    ImageBufferPool *pool;
+    size_t capacity;
+
+    uchar *data() {
+        return reinterpret_cast<uchar*>(this) + imagePoolHeaderBytes;
+    }
+};
+
+struct ImageBufferPoolStats {
+    quint64 acquired = 0;  // выдано буферов
+    quint64 allocated = 0; // из них выделено заново
+    size_t cachedBytes = 0;
+};
+
+class ImageBufferPool {
+public:
+    // Наименьший класс размера, вмещающий bytes.
+    static size_t sizeClass(size_t bytes) {
+        size_t octave = 4;
+        while (octave * 2 <= bytes) {
+            octave *= 2;
+        }
+        const size_t step = octave / 4;
+        return (bytes + step - 1) / step * step;
+    }
+
+    PooledBuffer *acquire(size_t bytes) {
+        const size_t capacity = sizeClass(bytes);
+        acquiredCount.fetch_add(1, std::memory_order_relaxed);
+        {
+            QMutexLocker locker(&mutex);
+            for (FreeList &list : freeLists) {
+                if (list.capacity == capacity && !list.buffers.empty()) {
+                    PooledBuffer *buffer = list.buffers.back();
+                    list.buffers.pop_back();
+                    cached -= capacity;
+                    return buffer;
+                }
+            }
+        }
+        allocatedCount.fetch_add(1, std::memory_order_relaxed);
+        void *memory = qMallocAligned(imagePoolHeaderBytes + capacity, imagePoolAlignment);
+        if (!memory) {
+            return nullptr;
+        }
+        PooledBuffer *buffer = static_cast<PooledBuffer*>(memory);
+        buffer->pool = this;
+        buffer->capacity = capacity;
+        return buffer;
+    }
+
+    void release(PooledBuffer *buffer) {
+        {
+            QMutexLocker locker(&mutex);
+            if (cached + buffer->capacity <= imagePoolMaxCachedBytes) {
+                cached += buffer->capacity;
+                freeListFor(buffer->capacity).buffers.push_back(buffer);
+                return;
+            }
+        }
+        qFreeAligned(buffer);
+    }
+
+    // Отдаёт все свободные буферы системе.
+    void trim() {
+        std::vector<PooledBuffer*> dropped;
+        {
+            QMutexLocker locker(&mutex);
+            for (FreeList &list : freeLists) {
+                dropped.insert(dropped.end(), list.buffers.begin(), list.buffers.end());
+                list.buffers.clear();
+            }
+            cached = 0;
+        }
+        for (PooledBuffer *buffer : dropped) {
+            qFreeAligned(buffer);
+        }
+    }
+
+    ImageBufferPoolStats stats() {
+        ImageBufferPoolStats s;
+        s.acquired = acquiredCount.load();
+        s.allocated = allocatedCount.load();
+        QMutexLocker locker(&mutex);
+        s.cachedBytes = cached;
+        return s;
+    }
+
+private:
+    struct FreeList {
+        size_t capacity;
+        std::vector<PooledBuffer*> buffers;
+    };
+
+    // классов в работе единицы, линейный поиск дешевле хэша
+    FreeList &freeListFor(size_t capacity) {
+        for (FreeList &list : freeLists) {
+            if (list.capacity == capacity) {
+                return list;
+            }
+        }
+        freeLists.push_back(FreeList{capacity, std::vector<PooledBuffer*>()});
+        return freeLists.back();
+    }
+
+    QMutex mutex;
+    std::vector<FreeList> freeLists;
+    size_t cached = 0;
+    std::atomic<quint64> acquiredCount{0};
+    std::atomic<quint64> allocatedCount{0};
+};
+
+// Пул не разрушается: кадры из него могут жить в статических кэшах до самого выхода.
+static ImageBufferPool &imageBufferPool() {
+    static ImageBufferPool *pool = new ImageBufferPool;
+    return *pool;
+}
+
+static void releasePooledBuffer(void *info) {
+    PooledBuffer *buffer = static_cast<PooledBuffer*>(info);
+    buffer->pool->release(buffer);
+}
+
+static int pooledImageDepth(QImage::Format format) {
+    switch (format) {
+    case QImage::Format_ARGB32:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        return 32;
+    case QImage::Format_Grayscale8:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+// Кадр w x h из пула, содержимое не инициализировано (как у QImage(w, h, format)).
+// Редкие форматы и мелкие кадры выделяются обычным QImage.
+static QImage pooledImage(int w, int h, QImage::Format format) {
+    const int depth = pooledImageDepth(format);
+    if (depth == 0 || w <= 0 || h <= 0) {
+        return QImage(w, h, format);
+    }
+    const int bytesPerLine = (w * depth + 31) / 32 * 4;
+    const size_t bytes = size_t(bytesPerLine) * size_t(h);
+    if (bytes < imagePoolMinBytes) {
+        return QImage(w, h, format);
+    }
+    PooledBuffer *buffer = imageBufferPool().acquire(bytes);
+    if (!buffer) {
+        return QImage();
+    }
+    return QImage(buffer->data(), w, h, bytesPerLine, format, releasePooledBuffer, buffer);
+}
+
+// Копия src в формате ARGB32 в кадре из пула. ARGB32, RGB32 и серый
+// переводятся построчно без промежуточных кадров, остальные форматы — через
+// convertToFormat.
+static QImage pooledArgb32Copy(const QImage &src) {
+    if (src.isNull()) {
+        return QImage();
+    }
+    const QImage::Format format = src.format();
+    const bool direct = format == QImage::Format_ARGB32 || format == QImage::Format_RGB32
+                        || format == QImage::Format_Grayscale8;
+    const QImage converted = direct ? src : src.convertToFormat(QImage::Format_ARGB32);
+    const int w = converted.width();
+    QImage out = pooledImage(w, converted.height(), QImage::Format_ARGB32);
+    if (out.isNull()) {
+        return out;
+    }
+    uchar *bits = out.bits();
+    const int bytesPerLine = out.bytesPerLine();
+    const QImage::Format from = converted.format();
+    parallelForRows(converted.height(), w, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const uchar *line = converted.constScanLine(y);
+            QRgb *dst = reinterpret_cast<QRgb*>(bits + size_t(y) * bytesPerLine);
+            if (from == QImage::Format_Grayscale8) {
+                for (int x = 0; x < w; ++x) {
+                    dst[x] = qRgb(line[x], line[x], line[x]);
+                }
+            } else if (from == QImage::Format_RGB32) {
+                const QRgb *px = reinterpret_cast<const QRgb*>(line);
+                for (int x = 0; x < w; ++x) {
+                    dst[x] = px[x] | 0xff000000u;
+                }
+            } else {
+                std::memcpy(dst, line, size_t(w) * sizeof(QRgb));
+            }
+        }
+    });
+    return out;
+}
+
+// Кадр ARGB32, который вызывающий может менять на месте: сам src, если он уже
+// ARGB32 и ни с кем не разделён, иначе копия в кадре из пула.
+static QImage ownedArgb32(QImage &&src) {
+    if (src.format() == QImage::Format_ARGB32 && src.isDetached()) {
+        return std::move(src);
+    }
+    return pooledArgb32Copy(src);
+}
+
+// ARGB32-представление src только для чтения: без копии, если формат уже тот.
+static QImage argb32View(const QImage &src) {
+    return src.format() == QImage::Format_ARGB32 ? src : pooledArgb32Copy(src);
+}
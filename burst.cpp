@@ -0,0 +1,352 @@
+#include <QCamera>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMutex>
+#include <QPainter>
+#include <QVideoFrame>
+#include <QtConcurrent>
+
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+// Серийная съёмка. Кадры берутся из потока видоискателя (с частотой сенсора,
+// а не по одному capture() на снимок) и копируются в кольцо заранее
+// выделенных полноразмерных буферов. Каждый занятый слот фильтруется,
+// кодируется и пишется в общем пуле, в свои же буферы результата, и только
+// потом возвращается в кольцо. Если свободного слота нет, кадр не ждёт и не
+// копится в памяти, а пропускается и считается: серия идёт с той частотой,
+// которую успевают сохранять, а память ограничена размером кольца.
+//
+// Буферы кадров выделяются один раз при запуске первой серии, под её
+// разрешение (и заново только при его смене); буферы результатов — на первом
+// проходе слота и дальше переиспользуются, по одному на формат выхода фильтра.
+
+// 12 Мп кадр ARGB32 — 48 МБ, поэтому кольцо небольшое; больше слотов, чем
+// потоков пула, не ускоряет запись, а только копит кадры.
+static const int burstRingFrames = 6;
+static const int burstDefaultFrames = 20;
+static const int burstMaxFrames = 200;
+// для серии выбирается самое большое разрешение видоискателя, которое
+// держит хотя бы столько кадров в секунду
+static const qreal burstMinFrameRate = 10.0;
+// столько кадров подряд не того размера — и серия берёт их размер (около 3 с)
+static const int burstMaxMismatchedFrames = 30;
+
+struct BurstSlot {
+    QImage frame;                                // копия кадра камеры, ARGB32
+    std::map<QImage::Format, QImage> filtered;   // результаты фильтров по формату
+};
+
+class BurstRing {
+public:
+    explicit BurstRing(int frames) : slots(size_t(qMax(1, frames))) {}
+
+    // Готовит все слоты под кадр size; буферы выделяются только при смене
+    // размера и только когда ни один слот не в работе (иначе кадры другого
+    // размера пропускаются, пока кольцо не освободится).
+    void reserve(const QSize &size) {
+        QMutexLocker locker(&mutex);
+        if (size == frameSize || (frameSize.isValid() && freeSlots.size() != slots.size())) {
+            return;
+        }
+        TraceScope scope("burst.allocate");
+        freeSlots.clear();
+        for (size_t i = 0; i < slots.size(); ++i) {
+            slots[i].frame = QImage(size, QImage::Format_ARGB32);
+            slots[i].filtered.clear();
+            freeSlots.push_back(int(i));
+        }
+        frameSize = size;
+    }
+
+    // Свободный слот или -1, если все в работе.
+    int acquire() {
+        QMutexLocker locker(&mutex);
+        if (freeSlots.empty()) {
+            return -1;
+        }
+        const int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    void release(int slot) {
+        QMutexLocker locker(&mutex);
+        freeSlots.push_back(slot);
+    }
+
+    // Слот принадлежит тому, кто его взял через acquire(), до release().
+    BurstSlot &slot(int index) {
+        return slots[size_t(index)];
+    }
+
+private:
+    QMutex mutex;
+    std::vector<BurstSlot> slots; // размер не меняется, ссылки на слоты стабильны
+    std::vector<int> freeSlots;
+    QSize frameSize;
+};
+
+struct BurstResult {
+    int requested = 0;
+    int grabbed = 0;  // попали в кольцо
+    int dropped = 0;  // кольцо было занято или кадр не удалось прочитать
+    int written = 0;  // записанных файлов
+    int failed = 0;
+    qint64 captureMs = 0; // от первого до последнего кадра серии
+    qint64 totalMs = 0;   // до записи последнего файла
+};
+
+// Копия кадра в буфер слота без выделения памяти. Кадры RGB32/ARGB32 копируются
+// построчно (у RGB32 байт «x» бывает нулём, поэтому альфа выставляется в 255,
+// иначе снимок вышел бы прозрачным), остальные форматы, которые понимает
+// QImage, перерисовываются в буфер через QPainter. false — формат кадра не
+// поддерживается.
+static bool copyFrameInto(const QVideoFrame &frame, bool bottomToTop, QImage *target) {
+    QVideoFrame mapped(frame);
+    if (!mapped.map(QAbstractVideoBuffer::ReadOnly)) {
+        return false;
+    }
+    TraceScope scope("burst.copy");
+    const QImage::Format format = QVideoFrame::imageFormatFromPixelFormat(mapped.pixelFormat());
+    bool ok = format != QImage::Format_Invalid && mapped.size() == target->size();
+    if (ok) {
+        const int h = mapped.height();
+        if (format == QImage::Format_ARGB32) {
+            const size_t lineBytes = size_t(mapped.width()) * sizeof(QRgb);
+            for (int y = 0; y < h; ++y) {
+                std::memcpy(target->scanLine(bottomToTop ? h - 1 - y : y),
+                            mapped.bits() + size_t(y) * mapped.bytesPerLine(), lineBytes);
+            }
+        } else if (format == QImage::Format_RGB32) {
+            const int w = mapped.width();
+            for (int y = 0; y < h; ++y) {
+                const QRgb *src = reinterpret_cast<const QRgb*>(mapped.bits() + size_t(y) * mapped.bytesPerLine());
+                QRgb *dst = reinterpret_cast<QRgb*>(target->scanLine(bottomToTop ? h - 1 - y : y));
+                for (int x = 0; x < w; ++x) {
+                    dst[x] = src[x] | 0xff000000u;
+                }
+            }
+        } else {
+            const QImage view(mapped.bits(), mapped.width(), h, mapped.bytesPerLine(), format);
+            QPainter painter(target);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            if (bottomToTop) {
+                painter.setTransform(QTransform(1, 0, 0, -1, 0, h));
+            }
+            painter.drawImage(0, 0, view);
+        }
+    }
+    mapped.unmap();
+    return ok;
+}
+
+// Формат файлов серии: быстрое сжатие PNG, чтобы запись успевала за сенсором.
+static ImageEncodeOptions burstEncoding() {
+    ImageEncodeOptions options;
+    options.pngLevel = 1;
+    options.pngFilter = PngFilter::Sub;
+    return options;
+}
+
+// Одна серия. Счётчики и обратный вызов — только из потока приложения; в пуле
+// работают лишь слоты кольца.
+struct BurstSession {
+    int requested = 0;
+    int offered = 0;
+    int pending = 0; // слоты серии, ещё не вернувшиеся в кольцо
+    QSize frameSize; // кадры другого размера в серию не идут
+    int mismatched = 0; // таких кадров подряд
+    bool capturing = true;
+    BurstResult result;
+    QList<const FilterSpec*> filters;
+    QString directory;
+    QString baseName;
+    ImageEncodeOptions encoding;
+    QElapsedTimer timer;
+    std::function<void(const BurstResult &)> finished;
+
+    void finishIfDone() {
+        if (capturing || pending > 0 || !finished) {
+            return;
+        }
+        result.totalMs = timer.elapsed();
+        std::function<void(const BurstResult &)> callback = finished;
+        finished = nullptr;
+        callback(result);
+    }
+};
+
+class BurstCapture {
+public:
+    explicit BurstCapture(int ringFrames = burstRingFrames) : ring(std::make_shared<BurstRing>(ringFrames)) {}
+
+    bool active() const {
+        return session && session->capturing;
+    }
+
+    // Начинает серию из count кадров размера frameSize: каждый кадр сохраняется
+    // с каждым фильтром из codes (пустой список — без фильтра) в directory.
+    // Кольцо готовится под frameSize сразу, до первого кадра; невалидный
+    // frameSize — размер первого кадра. finished вызывается в потоке
+    // приложения, когда записан последний файл.
+    bool start(int count, const QSize &frameSize, const QList<QString> &codes, const QString &directory,
+               std::function<void(const BurstResult &)> finished) {
+        if (active() || count <= 0) {
+            return false;
+        }
+        auto next = std::make_shared<BurstSession>();
+        next->requested = count;
+        next->frameSize = frameSize;
+        next->result.requested = count;
+        for (const QString &code : codes) {
+            if (const FilterSpec *spec = findFilter(code)) {
+                if (!next->filters.contains(spec)) {
+                    next->filters.append(spec);
+                }
+            }
+        }
+        if (next->filters.isEmpty()) {
+            next->filters.append(findFilter(FilterId::None));
+        }
+        QDir targetDir(directory);
+        if (!targetDir.exists()) {
+            targetDir.mkpath(QStringLiteral("."));
+        }
+        next->directory = directory;
+        next->baseName = QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd_HHmmss"));
+        next->encoding = burstEncoding();
+        next->finished = std::move(finished);
+        session = next;
+        if (frameSize.isValid()) {
+            ring->reserve(frameSize);
+        }
+        return true;
+    }
+
+    // Кадр видоискателя, поток приложения. Вне серии ничего не делает. Кадры
+    // другого размера (ещё со старыми настройками, пока камера
+    // перезапускается) пропускаются и в серию не считаются.
+    void offer(const QVideoFrame &frame, bool bottomToTop = false) {
+        if (!active()) {
+            return;
+        }
+        std::shared_ptr<BurstSession> s = session;
+        if (!s->frameSize.isValid()) {
+            s->frameSize = frame.size();
+            ring->reserve(s->frameSize);
+        }
+        if (frame.size() != s->frameSize) {
+            // камера так и не перешла на выбранное разрешение: серия снимается в том, что есть
+            if (++s->mismatched < burstMaxMismatchedFrames) {
+                return;
+            }
+            qWarning() << "Серия: камера отдаёт кадры" << frame.size() << "вместо" << s->frameSize;
+            s->frameSize = frame.size();
+            ring->reserve(s->frameSize);
+        }
+        s->mismatched = 0;
+        if (s->offered == 0) {
+            s->timer.start();
+        }
+        const int index = s->offered++;
+        if (s->offered == s->requested) {
+            s->capturing = false;
+            s->result.captureMs = s->timer.elapsed();
+        }
+
+        // кольцо другого размера, если прошлая серия ещё пишется: переделывается, когда освободится
+        ring->reserve(s->frameSize);
+        const int slot = ring->acquire();
+        if (slot < 0) {
+            ++s->result.dropped; // все слоты пишутся: кадр пропускается, а не ждёт
+        } else if (ring->slot(slot).frame.size() != frame.size()) {
+            const QSize ringSize = ring->slot(slot).frame.size();
+            ring->release(slot);
+            ++s->result.dropped;
+            if (!warnedSize) {
+                qWarning() << "Серия: кольцо ещё занято кадрами прошлой серии размера" << ringSize;
+                warnedSize = true;
+            }
+        } else if (!copyFrameInto(frame, bottomToTop, &ring->slot(slot).frame)) {
+            ring->release(slot);
+            ++s->result.dropped;
+            if (!warnedFormat) {
+                qWarning() << "Серия: формат кадра камеры не поддерживается" << frame.pixelFormat();
+                warnedFormat = true;
+            }
+        } else {
+            ++s->result.grabbed;
+            ++s->pending;
+            process(s, slot, index);
+        }
+        s->finishIfDone();
+    }
+
+private:
+    void process(const std::shared_ptr<BurstSession> &s, int slot, int index) {
+        std::shared_ptr<BurstRing> sharedRing = ring;
+        const QList<const FilterSpec*> filters = s->filters;
+        const QString directory = s->directory;
+        const QString baseName = s->baseName;
+        const ImageEncodeOptions encoding = s->encoding;
+        const qint64 queued = traceMark();
+        QtConcurrent::run([s, sharedRing, slot, index, filters, directory, baseName, encoding, queued]() {
+            traceSince("burst.queue_wait", queued);
+            int written = 0;
+            int failed = 0;
+            {
+                TraceScope scope("burst.frame");
+                BurstSlot &buffers = sharedRing->slot(slot);
+                const QDir dir(directory);
+                for (const FilterSpec *spec : filters) {
+                    QImage &filtered = buffers.filtered[spec->outputFormat];
+                    applyFilterInto(buffers.frame, *spec, spec->defaults(), &filtered);
+                    const QString filePath = dir.filePath(QStringLiteral("%1_burst_%2_%3.%4")
+                                                              .arg(baseName)
+                                                              .arg(index, 3, 10, QLatin1Char('0'))
+                                                              .arg(spec->slug)
+                                                              .arg(imageFormatSuffix(encoding.format)));
+                    if (writeImage(filtered, filePath, encoding)) {
+                        ++written;
+                    } else {
+                        qWarning() << "Не удалось сохранить" << filePath;
+                        ++failed;
+                    }
+                }
+            }
+            sharedRing->release(slot);
+            runInApplicationThread([s, written, failed]() {
+                s->result.written += written;
+                s->result.failed += failed;
+                --s->pending;
+                s->finishIfDone();
+            });
+        });
+    }
+
+    std::shared_ptr<BurstRing> ring;
+    std::shared_ptr<BurstSession> session;
+    bool warnedFormat = false;
+    bool warnedSize = false;
+};
+
+// Настройки видоискателя для серии: самое большое разрешение, которое держит
+// burstMinFrameRate; если такого нет — текущие настройки.
+static QCameraViewfinderSettings burstViewfinderSettings(QCamera *camera) {
+    QCameraViewfinderSettings best = camera->viewfinderSettings();
+    qint64 bestArea = 0;
+    for (const QCameraViewfinderSettings &settings : camera->supportedViewfinderSettings()) {
+        const qint64 area = qint64(settings.resolution().width()) * settings.resolution().height();
+        if (settings.maximumFrameRate() >= burstMinFrameRate && area > bestArea) {
+            best = settings;
+            bestArea = area;
+        }
+    }
+    return best;
+}
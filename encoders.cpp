@@ -0,0 +1,630 @@
+#include <QBuffer>
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QImageWriter>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <zlib.h>
+
+// Кодировщики снимков. PNG собирается здесь, а не через QImage::save: строки
+// фильтруются полосами на всех ядрах, а поток deflate режется на куски по
+// 128 КБ, которые сжимаются параллельно, как в pigz, — каждый кусок получает
+// словарь из последних 32 КБ предыдущего, поэтому степень сжатия почти не
+// падает. Плюс QOI (очень быстрый lossless), WebP без потерь и JPEG через
+// плагины Qt. Формат и параметры выбираются на каждый экспорт.
+
+enum class ImageFormat {
+    Png,
+    Qoi,
+    WebpLossless,
+    Jpeg
+};
+
+// Фильтр строк PNG; Adaptive выбирает для каждой строки фильтр с наименьшей
+// суммой модулей, как libpng по умолчанию.
+enum class PngFilter {
+    None,
+    Sub,
+    Up,
+    Average,
+    Paeth,
+    Adaptive
+};
+
+struct ImageEncodeOptions {
+    ImageFormat format = ImageFormat::Png;
+    int pngLevel = 6;                        // 0–9, как у zlib
+    PngFilter pngFilter = PngFilter::Adaptive;
+    bool parallelDeflate = true;             // один PNG сжимается на нескольких ядрах
+    int quality = 95;                        // для JPEG
+};
+
+static const int pngDeflateChunk = 128 * 1024;
+static const int pngDeflateWindow = 32 * 1024;
+
+static QString imageFormatSuffix(ImageFormat format) {
+    switch (format) {
+    case ImageFormat::Qoi:
+        return QStringLiteral("qoi");
+    case ImageFormat::WebpLossless:
+        return QStringLiteral("webp");
+    case ImageFormat::Jpeg:
+        return QStringLiteral("jpg");
+    case ImageFormat::Png:
+        break;
+    }
+    return QStringLiteral("png");
+}
+
+// Варианты для выбора в интерфейсе; WebP — только если есть плагин Qt. У PNG
+// уровень и фильтр строк затем можно поменять отдельно.
+static QList<QPair<QString, ImageEncodeOptions>> imageEncodePresets() {
+    QList<QPair<QString, ImageEncodeOptions>> presets;
+    ImageEncodeOptions png;
+    presets.append(qMakePair(QStringLiteral("PNG"), png));
+
+    ImageEncodeOptions fastPng;
+    fastPng.pngLevel = 1;
+    fastPng.pngFilter = PngFilter::Sub;
+    presets.append(qMakePair(QStringLiteral("PNG, быстрое сжатие"), fastPng));
+
+    ImageEncodeOptions qoi;
+    qoi.format = ImageFormat::Qoi;
+    presets.append(qMakePair(QStringLiteral("QOI"), qoi));
+
+    if (QImageWriter::supportedImageFormats().contains("webp")) {
+        ImageEncodeOptions webp;
+        webp.format = ImageFormat::WebpLossless;
+        presets.append(qMakePair(QStringLiteral("WebP без потерь"), webp));
+    }
+
+    ImageEncodeOptions jpeg;
+    jpeg.format = ImageFormat::Jpeg;
+    presets.append(qMakePair(QStringLiteral("JPEG 95"), jpeg));
+    return presets;
+}
+
+// Фильтры строк PNG по именам: для окна снимка и --png-filter.
+static QList<QPair<QString, PngFilter>> pngFilterNames() {
+    QList<QPair<QString, PngFilter>> names;
+    names.append(qMakePair(QStringLiteral("adaptive"), PngFilter::Adaptive));
+    names.append(qMakePair(QStringLiteral("none"), PngFilter::None));
+    names.append(qMakePair(QStringLiteral("sub"), PngFilter::Sub));
+    names.append(qMakePair(QStringLiteral("up"), PngFilter::Up));
+    names.append(qMakePair(QStringLiteral("average"), PngFilter::Average));
+    names.append(qMakePair(QStringLiteral("paeth"), PngFilter::Paeth));
+    return names;
+}
+
+static void putBigEndian32(uchar *p, quint32 v) {
+    p[0] = uchar(v >> 24);
+    p[1] = uchar(v >> 16);
+    p[2] = uchar(v >> 8);
+    p[3] = uchar(v);
+}
+
+// У ARGB32 альфа почти всегда 255; тогда хватает трёх каналов.
+static bool isOpaque(const QImage &image) {
+    if (!image.hasAlphaChannel()) {
+        return true;
+    }
+    std::atomic<bool> opaque{true};
+    const int w = image.width();
+    parallelForRows(image.height(), w, [&](int y0, int y1) {
+        for (int y = y0; y < y1 && opaque.load(std::memory_order_relaxed); ++y) {
+            const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            for (int x = 0; x < w; ++x) {
+                if (qAlpha(line[x]) != 255) {
+                    opaque.store(false, std::memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+    });
+    return opaque.load();
+}
+
+// Строка в байтах PNG: серый, RGB или RGBA.
+static void pngRawRow(const QImage &image, int y, int channels, uchar *out) {
+    const int w = image.width();
+    if (channels == 1) {
+        std::memcpy(out, image.constScanLine(y), size_t(w));
+        return;
+    }
+    const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+    for (int x = 0; x < w; ++x) {
+        const QRgb p = line[x];
+        out[0] = uchar(qRed(p));
+        out[1] = uchar(qGreen(p));
+        out[2] = uchar(qBlue(p));
+        if (channels == 4) {
+            out[3] = uchar(qAlpha(p));
+        }
+        out += channels;
+    }
+}
+
+static inline uchar paethPredictor(int a, int b, int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return uchar(a);
+    }
+    return uchar(pb <= pc ? b : c);
+}
+
+// Фильтрует строку raw (prev — предыдущая строка или нули) фильтром type в out.
+static void pngFilterRow(int type, const uchar *raw, const uchar *prev, int bytes, int bpp, uchar *out) {
+    for (int i = 0; i < bytes; ++i) {
+        const int a = i >= bpp ? raw[i - bpp] : 0;
+        const int b = prev[i];
+        const int c = i >= bpp ? prev[i - bpp] : 0;
+        int predicted = 0;
+        switch (type) {
+        case 1: predicted = a; break;
+        case 2: predicted = b; break;
+        case 3: predicted = (a + b) >> 1; break;
+        case 4: predicted = paethPredictor(a, b, c); break;
+        default: break;
+        }
+        out[i] = uchar(raw[i] - predicted);
+    }
+}
+
+static quint64 pngFilterCost(const uchar *row, int bytes) {
+    quint64 sum = 0;
+    for (int i = 0; i < bytes; ++i) {
+        sum += row[i] < 128 ? row[i] : 256 - row[i];
+    }
+    return sum;
+}
+
+// Поток IDAT до сжатия для строк image: на строку байт фильтра и сама строка,
+// в out (image.height() * (ширина строки + 1) байт). prevRaw — сырая строка
+// перед первой (последняя строка предыдущей полосы) или nullptr в начале кадра.
+static void pngFilterRows(const QImage &image, int channels, PngFilter filter, const uchar *prevRaw, uchar *data) {
+    const int w = image.width();
+    const int h = image.height();
+    const int bytes = w * channels;
+    const size_t stride = size_t(bytes) + 1;
+
+    parallelForRows(h, w, [&](int y0, int y1) {
+        // каждой полосе нужна и сырая строка перед ней
+        std::vector<uchar> prev(size_t(bytes), 0);
+        std::vector<uchar> raw(size_t(bytes), 0);
+        std::vector<uchar> trial(size_t(bytes), 0);
+        if (y0 > 0) {
+            pngRawRow(image, y0 - 1, channels, prev.data());
+        } else if (prevRaw) {
+            std::memcpy(prev.data(), prevRaw, size_t(bytes));
+        }
+        for (int y = y0; y < y1; ++y) {
+            pngRawRow(image, y, channels, raw.data());
+            uchar *out = data + stride * y;
+            int type = int(filter);
+            if (filter == PngFilter::Adaptive) {
+                quint64 best = 0;
+                for (int t = 0; t <= 4; ++t) {
+                    pngFilterRow(t, raw.data(), prev.data(), bytes, channels, trial.data());
+                    const quint64 cost = pngFilterCost(trial.data(), bytes);
+                    if (t == 0 || cost < best) {
+                        best = cost;
+                        type = t;
+                        std::memcpy(out + 1, trial.data(), size_t(bytes));
+                    }
+                }
+            } else {
+                pngFilterRow(type, raw.data(), prev.data(), bytes, channels, out + 1);
+            }
+            out[0] = uchar(type);
+            prev.swap(raw);
+        }
+    });
+}
+
+// Кусок [from, from + length) потока data сырым deflate со словарём из
+// предыдущих 32 КБ, закрытый Z_SYNC_FLUSH (последний — Z_FINISH), так что
+// куски просто склеиваются.
+static bool deflatePiece(const uchar *data, size_t from, size_t length, int level, bool last, std::vector<uchar> *out) {
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    if (from > 0) {
+        const size_t dictionary = qMin(from, size_t(pngDeflateWindow));
+        deflateSetDictionary(&stream, data + from - dictionary, uInt(dictionary));
+    }
+    out->resize(deflateBound(&stream, uLong(length)) + 16);
+    stream.next_in = const_cast<Bytef*>(data + from);
+    stream.avail_in = uInt(length);
+    stream.next_out = out->data();
+    stream.avail_out = uInt(out->size());
+    const int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    const bool ok = (last ? result == Z_STREAM_END : result == Z_OK) && stream.avail_in == 0;
+    out->resize(out->size() - stream.avail_out);
+    deflateEnd(&stream);
+    return ok;
+}
+
+static void appendPngChunk(QByteArray &out, const char *type, const uchar *payload, size_t size) {
+    uchar header[8];
+    putBigEndian32(header, quint32(size));
+    std::memcpy(header + 4, type, 4);
+    out.append(reinterpret_cast<const char*>(header), 8);
+    uLong crc = crc32(0L, header + 4, 4);
+    if (size > 0) {
+        out.append(reinterpret_cast<const char*>(payload), int(size));
+        crc = crc32(crc, payload, uInt(size));
+    }
+    uchar tail[4];
+    putBigEndian32(tail, quint32(crc));
+    out.append(reinterpret_cast<const char*>(tail), 4);
+}
+
+// PNG, который пишется по мере поступления строк. Строки фильтруются полосами
+// на всех ядрах, поток deflate режется на куски по 128 КБ, которые сжимаются
+// параллельно, как в pigz: каждый кусок получает словарь из последних 32 КБ
+// предыдущего, поэтому степень сжатия почти не падает, а куски просто
+// склеиваются (adler32 сводится adler32_combine). Готовые куски сразу уходят в
+// out отдельными IDAT, так что в памяти держится только несжатый хвост и окно
+// словаря — полосовая обработка больших снимков (tiled.cpp) пишет PNG любого
+// размера с памятью на полосу. encodePng — тот же писатель с одной полосой.
+// Без parallel поток сжимается одним z_stream по мере поступления.
+class PngStreamWriter {
+public:
+    // channels: 1 — серый (строки Grayscale8), 3 — RGB, 4 — RGBA (строки ARGB32).
+    PngStreamWriter(QIODevice *out, int width, int height, int channels, int level, PngFilter filter, bool parallel)
+        : out(out), width(width), height(height), channels(channels), level(qBound(0, level, 9)), filter(filter),
+          parallel(parallel) {
+        QByteArray header(13, '\0');
+        uchar *h = reinterpret_cast<uchar*>(header.data());
+        putBigEndian32(h, quint32(width));
+        putBigEndian32(h + 4, quint32(height));
+        h[8] = 8;                                            // бит на канал
+        h[9] = channels == 1 ? 0 : (channels == 3 ? 2 : 6);  // серый, RGB, RGBA
+        h[10] = 0;
+        h[11] = 0;
+        h[12] = 0;
+
+        QByteArray start("\x89PNG\r\n\x1a\n", 8);
+        appendPngChunk(start, "IHDR", reinterpret_cast<const uchar*>(header.constData()), size_t(header.size()));
+        failed = out->write(start) != start.size();
+
+        if (!parallel) {
+            std::memset(&serial, 0, sizeof(serial));
+            serialOpen = deflateInit(&serial, this->level) == Z_OK;
+            failed = failed || !serialOpen;
+        }
+    }
+
+    ~PngStreamWriter() {
+        if (serialOpen) {
+            deflateEnd(&serial);
+        }
+    }
+
+    PngStreamWriter(const PngStreamWriter &) = delete;
+    PngStreamWriter &operator=(const PngStreamWriter &) = delete;
+
+    // Следующие строки кадра, сверху вниз.
+    bool writeRows(const QImage &rows) {
+        if (failed || rows.isNull()) {
+            return false;
+        }
+        const int bytes = width * channels;
+        const size_t stride = size_t(bytes) + 1;
+        const size_t start = pending.size();
+        pending.resize(start + stride * size_t(rows.height()));
+        {
+            TraceScope scope("png.filter_rows");
+            pngFilterRows(rows, channels, filter, rowsWritten > 0 ? prevRaw.data() : nullptr, pending.data() + start);
+        }
+        prevRaw.resize(size_t(bytes));
+        pngRawRow(rows, rows.height() - 1, channels, prevRaw.data());
+        rowsWritten += rows.height();
+        return compress(false);
+    }
+
+    // После последней строки: хвост потока deflate и IEND.
+    bool finish() {
+        if (failed || rowsWritten != height || !compress(true)) {
+            return false;
+        }
+        QByteArray end;
+        appendPngChunk(end, "IEND", nullptr, 0);
+        return out->write(end) == end.size();
+    }
+
+private:
+    bool writeIdat(const QByteArray &payload) {
+        if (payload.isEmpty()) {
+            return true;
+        }
+        QByteArray chunk;
+        appendPngChunk(chunk, "IDAT", reinterpret_cast<const uchar*>(payload.constData()), size_t(payload.size()));
+        failed = failed || out->write(chunk) != chunk.size();
+        return !failed;
+    }
+
+    // Сжимает накопленное: все полные куски, а при last — и остаток.
+    bool compress(bool last) {
+        TraceScope scope("png.deflate");
+        if (!parallel) {
+            return compressSerial(last);
+        }
+        const size_t chunk = size_t(pngDeflateChunk);
+        const size_t fresh = pending.size() - window;
+        const int count = last ? int(qMax<size_t>(1, (fresh + chunk - 1) / chunk)) : int(fresh / chunk);
+        if (count == 0) {
+            return true;
+        }
+
+        std::vector<std::vector<uchar>> pieces(static_cast<size_t>(count));
+        std::atomic<bool> pieceFailed{false};
+        parallelForIndices(count, parallelThreadCount(), [&](int i) {
+            const size_t from = window + size_t(i) * chunk;
+            const size_t length = qMin(chunk, pending.size() - from);
+            if (!deflatePiece(pending.data(), from, length, level, last && i == count - 1, &pieces[size_t(i)])) {
+                pieceFailed.store(true);
+            }
+        });
+        if (pieceFailed.load()) {
+            failed = true;
+            return false;
+        }
+
+        QByteArray payload;
+        if (!headerWritten) {
+            static const uchar levelFlags[] = {0x01, 0x01, 0x5e, 0x5e, 0x5e, 0x5e, 0x9c, 0xda, 0xda, 0xda};
+            payload.append(char(0x78));
+            payload.append(char(levelFlags[level]));
+            headerWritten = true;
+        }
+        for (int i = 0; i < count; ++i) {
+            const size_t from = window + size_t(i) * chunk;
+            const size_t length = qMin(chunk, pending.size() - from);
+            const uLong pieceAdler = adler32(1L, pending.data() + from, uInt(length));
+            adler = adler32_combine(adler, pieceAdler, z_off_t(length));
+            payload.append(reinterpret_cast<const char*>(pieces[size_t(i)].data()), int(pieces[size_t(i)].size()));
+        }
+        if (last) {
+            uchar tail[4];
+            putBigEndian32(tail, quint32(adler));
+            payload.append(reinterpret_cast<const char*>(tail), 4);
+        }
+
+        // в начале остаётся только окно словаря для следующего куска
+        const size_t consumed = qMin(pending.size(), window + size_t(count) * chunk);
+        const size_t keep = qMin(consumed, size_t(pngDeflateWindow));
+        pending.erase(pending.begin(), pending.begin() + std::ptrdiff_t(consumed - keep));
+        window = keep;
+        return writeIdat(payload);
+    }
+
+    bool compressSerial(bool last) {
+        QByteArray payload;
+        uchar buffer[64 * 1024];
+        serial.next_in = pending.data();
+        serial.avail_in = uInt(pending.size());
+        int result = Z_OK;
+        do {
+            serial.next_out = buffer;
+            serial.avail_out = sizeof(buffer);
+            result = deflate(&serial, last ? Z_FINISH : Z_NO_FLUSH);
+            if (result == Z_STREAM_ERROR) {
+                failed = true;
+                return false;
+            }
+            payload.append(reinterpret_cast<const char*>(buffer), int(sizeof(buffer) - serial.avail_out));
+        } while (serial.avail_out == 0 || (last && result != Z_STREAM_END));
+        pending.clear();
+        return writeIdat(payload);
+    }
+
+    QIODevice *out;
+    const int width;
+    const int height;
+    const int channels;
+    const int level;
+    const PngFilter filter;
+    const bool parallel;
+    bool failed = false;
+    int rowsWritten = 0;
+    std::vector<uchar> prevRaw; // сырая последняя строка: от неё фильтруется следующая полоса
+    std::vector<uchar> pending; // [окно словаря | ещё не сжатое]
+    size_t window = 0;          // байт окна в начале pending
+    bool headerWritten = false;
+    uLong adler = 1;
+    z_stream serial;
+    bool serialOpen = false;
+};
+
+// PNG из Grayscale8 (серый) или ARGB32 (RGB, если альфа везде 255, иначе RGBA).
+static QByteArray encodePng(const QImage &source, int level, PngFilter filter, bool parallel) {
+    TraceScope scope("png.encode");
+    const QImage image = source.format() == QImage::Format_Grayscale8
+                             ? source
+                             : source.convertToFormat(QImage::Format_ARGB32);
+    if (image.isNull()) {
+        return QByteArray();
+    }
+    const int channels = image.format() == QImage::Format_Grayscale8 ? 1 : (isOpaque(image) ? 3 : 4);
+
+    QByteArray png;
+    QBuffer buffer(&png);
+    buffer.open(QIODevice::WriteOnly);
+    PngStreamWriter writer(&buffer, image.width(), image.height(), channels, level, filter, parallel);
+    if (!writer.writeRows(image) || !writer.finish()) {
+        return QByteArray();
+    }
+    return png;
+}
+
+// QOI (qoiformat.org): один последовательный проход, кодирует в разы быстрее
+// PNG при сравнимом размере. Состояние кодировщика переживает вызовы rows(),
+// поэтому кадр можно подавать полосами: выход каждой полосы забирается take().
+class QoiEncoder {
+public:
+    QoiEncoder(int width, int height, int channels) {
+        uchar header[14] = {'q', 'o', 'i', 'f'};
+        putBigEndian32(header + 4, quint32(width));
+        putBigEndian32(header + 8, quint32(height));
+        header[12] = uchar(channels);
+        header[13] = 0; // sRGB с линейной альфой
+        out.append(reinterpret_cast<const char*>(header), 14);
+        std::memset(index, 0, sizeof(index));
+    }
+
+    // Следующие строки кадра (ARGB32), сверху вниз.
+    void rows(const QImage &image) {
+        const int w = image.width();
+        out.reserve(out.size() + w * image.height() * 2);
+        for (int y = 0; y < image.height(); ++y) {
+            const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            for (int x = 0; x < w; ++x) {
+                pixel(line[x]);
+            }
+        }
+    }
+
+    // После последней строки: незакрытый повтор и концевой маркер.
+    void finish() {
+        if (run > 0) {
+            out.append(char(0xc0 | (run - 1)));
+            run = 0;
+        }
+        static const char end[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+        out.append(end, 8);
+    }
+
+    // Накопленный выход; дальше накопление начинается заново.
+    QByteArray take() {
+        QByteArray result;
+        result.swap(out);
+        return result;
+    }
+
+private:
+    void pixel(QRgb p) {
+        if (p == previous) {
+            if (++run == 62) {
+                out.append(char(0xc0 | (run - 1)));
+                run = 0;
+            }
+            return;
+        }
+        if (run > 0) {
+            out.append(char(0xc0 | (run - 1)));
+            run = 0;
+        }
+
+        const int r = qRed(p);
+        const int g = qGreen(p);
+        const int b = qBlue(p);
+        const int a = qAlpha(p);
+        const int slot = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+        if (index[slot] == p) {
+            out.append(char(slot));
+        } else {
+            index[slot] = p;
+            if (a == qAlpha(previous)) {
+                const signed char dr = static_cast<signed char>(r - qRed(previous));
+                const signed char dg = static_cast<signed char>(g - qGreen(previous));
+                const signed char db = static_cast<signed char>(b - qBlue(previous));
+                const signed char drg = static_cast<signed char>(dr - dg);
+                const signed char dbg = static_cast<signed char>(db - dg);
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    out.append(char(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                    out.append(char(0x80 | (dg + 32)));
+                    out.append(char(((drg + 8) << 4) | (dbg + 8)));
+                } else {
+                    const char rgb[4] = {char(0xfe), char(r), char(g), char(b)};
+                    out.append(rgb, 4);
+                }
+            } else {
+                const char rgba[5] = {char(0xff), char(r), char(g), char(b), char(a)};
+                out.append(rgba, 5);
+            }
+        }
+        previous = p;
+    }
+
+    QByteArray out;
+    QRgb index[64];
+    QRgb previous = qRgba(0, 0, 0, 255);
+    int run = 0;
+};
+
+static QByteArray encodeQoi(const QImage &source) {
+    TraceScope scope("qoi.encode");
+    const QImage image = source.convertToFormat(QImage::Format_ARGB32);
+    if (image.isNull()) {
+        return QByteArray();
+    }
+    QoiEncoder encoder(image.width(), image.height(), isOpaque(image) ? 3 : 4);
+    encoder.rows(image);
+    encoder.finish();
+    return encoder.take();
+}
+
+static bool writeEncodedFile(const QString &filePath, const QByteArray &data) {
+    if (data.isEmpty()) {
+        return false;
+    }
+    TraceScope scope("disk.write", filePath);
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    const bool ok = file.write(data) == data.size();
+    file.close();
+    if (!ok) {
+        QFile::remove(filePath);
+    }
+    return ok;
+}
+
+// Снимок в байтах файла формата options.format; пустой массив — ошибка.
+static QByteArray encodeImage(const QImage &image, const ImageEncodeOptions &options) {
+    switch (options.format) {
+    case ImageFormat::Png:
+        return encodePng(image, options.pngLevel, options.pngFilter, options.parallelDeflate);
+    case ImageFormat::Qoi:
+        return encodeQoi(image);
+    case ImageFormat::WebpLossless:
+    case ImageFormat::Jpeg: {
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        const bool webp = options.format == ImageFormat::WebpLossless;
+        TraceScope scope(webp ? "webp.encode" : "jpeg.encode");
+        QImageWriter writer(&buffer, webp ? "webp" : "jpeg");
+        if (webp) {
+            writer.setQuality(100); // у плагина Qt качество 100 включает режим без потерь
+        } else {
+            writer.setQuality(options.quality);
+            writer.setOptimizedWrite(true);
+        }
+        const QImage prepared = !webp && image.hasAlphaChannel() ? image.convertToFormat(QImage::Format_RGB32) : image;
+        return writer.write(prepared) ? data : QByteArray();
+    }
+    }
+    return QByteArray();
+}
+
+// Записывает снимок в filePath в формате options.format.
+static bool writeImage(const QImage &image, const QString &filePath, const ImageEncodeOptions &options) {
+    return writeEncodedFile(filePath, encodeImage(image, options));
+}
@@ -0,0 +1,622 @@
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QSettings>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Реестр фильтров. Каждый фильтр описывается одной записью: код из интерфейса,
+// slug для имени файла, выражение ffmpeg, схема параметров и построчное ядро.
+// applyFilter, совместный проход, сохранение видео и интерфейс берут всё из
+// реестра, поэтому новый фильтр — это одна registerFilter(), без правок в src.cpp.
+// Запись ищется один раз на задачу, дальше работает уже готовое ядро.
+
+// Строки результата, в которые пишут полосы. Указатель берётся один раз до
+// запуска потоков, чтобы полосы не трогали QImage::scanLine() параллельно.
+// Строки нумеруются по всему кадру; буфер одной полосы большого снимка
+// начинается со строки firstRow (у целого кадра — 0).
+struct RowTarget {
+    uchar *bits;
+    int bytesPerLine;
+    int firstRow;
+
+    uchar *line(int y) const { return bits + size_t(y - firstRow) * bytesPerLine; }
+};
+
+enum class FilterId : quint16 {
+    None,
+    Gray,
+    Negative,
+    Sepia,
+    Posterize,
+    Solarize,
+    Cold,
+    Warm,
+    Vintage,
+    Vignette,
+    PosterizeDither,
+    User = 256,    // сторонние фильтры берут идентификаторы начиная отсюда
+    Chain = 0x8000 // цепочки фильтров (registerFilterChain)
+};
+
+enum FilterTrait {
+    FilterPerChannel = 0x1,     // канал результата зависит только от того же канала: есть channelLut
+    FilterInPlace = 0x2,        // строку можно обработать на месте, без отдельного буфера
+    FilterNeedsNeighbors = 0x4  // пиксель зависит от соседей: только целым кадром через whole
+};
+
+struct FilterParam {
+    QString name;
+    float defaultValue;
+    float minimum;
+    float maximum;
+};
+
+// Значения параметров в порядке FilterSpec::params.
+using FilterValues = QVector<float>;
+
+// Обработка полосы исходника (ARGB32, строки [y0, y0 + band.height())) в строки
+// результата. У фильтров с FilterInPlace out может указывать на ту же память, что и band.
+using BandKernel = std::function<void(const QImage &band, int y0, const RowTarget &out)>;
+
+struct FilterSpec {
+    FilterId id = FilterId::None;
+    QString code;   // код в интерфейсе: "чб", "сеп", ...
+    QString title;  // подпись чекбокса
+    QString slug;   // часть имени сохранённого файла
+    QString ffmpeg; // выражение для -vf; пустое — видео сохраняется без фильтра
+    QList<FilterParam> params;
+    int traits = 0;
+    QImage::Format outputFormat = QImage::Format_ARGB32;
+
+    // Ядро для кадра w x h; вызывается один раз на задачу, результат — из любых потоков.
+    std::function<BandKernel(int w, int h, const FilterValues &values)> prepare;
+    // Необязательно: ядро только для строк [y0, y1) кадра — у фильтров, которые
+    // в prepare строят что-то размером с кадр (маска виньетки). Полосовая
+    // обработка больших снимков (tiled.cpp) готовит их на каждую полосу.
+    std::function<BandKernel(int w, int h, int y0, int y1, const FilterValues &values)> prepareRows;
+    // Для FilterNeedsNeighbors: весь кадр сразу.
+    std::function<QImage(const QImage &src, const FilterValues &values)> whole;
+    // Необязательно, для FilterNeedsNeighbors, которым хватает идти сверху
+    // вниз: ядро с состоянием между полосами (перенос ошибки диффузии). Его
+    // вызывают полосами строго по порядку и по одной; внутри полосы оно само
+    // делит работу. Без него фильтр в полосовой обработке берёт кадр целиком.
+    std::function<BandKernel(int w, int h, const FilterValues &values)> stream;
+    // Для FilterPerChannel: поканальная таблица фильтра.
+    std::function<const ChannelLut &(const FilterValues &values)> channelLut;
+
+    bool has(FilterTrait trait) const { return (traits & trait) != 0; }
+
+    FilterValues defaults() const {
+        FilterValues values;
+        values.reserve(params.size());
+        for (const FilterParam &p : params) {
+            values.append(p.defaultValue);
+        }
+        return values;
+    }
+};
+
+// Полосное ядро из построчной функции fn(line, width, y), работающей на месте.
+// fn подставляется в цикл по строкам шаблоном, без косвенного вызова на строку.
+template <typename RowFn>
+static BandKernel rowKernel(RowFn fn) {
+    return [fn](const QImage &band, int y0, const RowTarget &out) {
+        const int w = band.width();
+        for (int i = 0; i < band.height(); ++i) {
+            QRgb *line = reinterpret_cast<QRgb*>(out.line(y0 + i));
+            const uchar *src = band.constScanLine(i);
+            if (reinterpret_cast<const uchar*>(line) != src) {
+                std::memcpy(line, src, size_t(w) * sizeof(QRgb));
+            }
+            fn(line, w, y0 + i);
+        }
+    };
+}
+
+struct FilterRegistry;
+
+// Встроенные фильтры описаны в src.cpp и попадают в реестр при его создании,
+// раньше любых сторонних.
+static void registerBuiltinFilters(FilterRegistry &registry);
+
+struct FilterRegistry {
+    QMutex mutex;
+    std::vector<std::unique_ptr<const FilterSpec>> specs; // порядок регистрации = порядок в интерфейсе
+    QHash<QString, const FilterSpec*> byCode;
+    QHash<quint16, const FilterSpec*> byId;
+
+    FilterRegistry() { registerBuiltinFilters(*this); }
+
+    // false, если код или идентификатор уже заняты или у фильтра нет ядра.
+    bool add(FilterSpec spec) {
+        if (spec.code.isEmpty() || (!spec.prepare && !spec.whole)) {
+            return false;
+        }
+        if (spec.has(FilterNeedsNeighbors) && !spec.whole) {
+            return false;
+        }
+
+        QMutexLocker locker(&mutex);
+        if (byCode.contains(spec.code) || byId.contains(quint16(spec.id))) {
+            return false;
+        }
+        specs.push_back(std::unique_ptr<const FilterSpec>(new FilterSpec(std::move(spec))));
+        const FilterSpec *stored = specs.back().get();
+        byCode.insert(stored->code, stored);
+        byId.insert(quint16(stored->id), stored);
+        return true;
+    }
+};
+
+static FilterRegistry &filterRegistry() {
+    static FilterRegistry registry;
+    return registry;
+}
+
+static bool registerFilter(FilterSpec spec) {
+    return filterRegistry().add(std::move(spec));
+}
+
+// Записи не удаляются, поэтому указатели остаются действительными. Поиск
+// реестр не меняет: цепочку сначала регистрируют явно (registerFilterChain).
+static const FilterSpec *findFilter(const QString &code) {
+    FilterRegistry &registry = filterRegistry();
+    QMutexLocker locker(&registry.mutex);
+    return registry.byCode.value(code, nullptr);
+}
+
+static const FilterSpec *findFilter(FilterId id) {
+    FilterRegistry &registry = filterRegistry();
+    QMutexLocker locker(&registry.mutex);
+    return registry.byId.value(quint16(id), nullptr);
+}
+
+static QList<const FilterSpec*> registeredFilters() {
+    FilterRegistry &registry = filterRegistry();
+    QMutexLocker locker(&registry.mutex);
+    QList<const FilterSpec*> result;
+    for (const std::unique_ptr<const FilterSpec> &spec : registry.specs) {
+        result.append(spec.get());
+    }
+    return result;
+}
+
+// Регистрация из статического объекта в файле стороннего фильтра:
+//   static FilterRegistration blur(makeBlurSpec());
+struct FilterRegistration {
+    explicit FilterRegistration(FilterSpec spec) { registerFilter(std::move(spec)); }
+};
+
+// ---- Цепочки фильтров ----
+//
+// Цепочка — запись реестра из нескольких фильтров подряд: "теп+пос:4+вгн"
+// (после двоеточия — параметры стадии по порядку FilterSpec::params). Она
+// работает везде, где работает обычный фильтр: applyFilter, совместный
+// проход, сохранение, видео и пакетный режим. Вместо прохода с новым кадром
+// на каждую стадию цепочка компилируется так:
+//   - соседние поканальные стадии (FilterPerChannel) сливаются в одну таблицу;
+//   - остальные попиксельные стадии идут в том же цикле по полосе, пока она
+//     в кэше, на месте в строках результата;
+//   - граница прохода — только у стадий с FilterNeedsNeighbors: им отдаётся
+//     весь кадр после предыдущих стадий.
+// Выражение ffmpeg цепочки — выражения стадий через запятую. Выражения стадий
+// не знают параметров, поэтому у цепочки, где параметр стадии задан не по
+// умолчанию, выражения нет: иначе видео без ffprobe вышло бы не таким, как
+// снимок с той же цепочкой.
+
+static const QChar filterChainSeparator = QLatin1Char('+');
+static const QChar filterStageParamSeparator = QLatin1Char(':');
+
+struct FilterStage {
+    const FilterSpec *spec = nullptr;
+    FilterValues values;
+};
+
+// Попиксельная стадия цепочки: либо фильтр, либо слитые поканальные таблицы.
+struct ChainStep {
+    FilterStage stage;
+    std::shared_ptr<const ChannelLut> lut; // не пусто — стадия-таблица
+};
+
+// Проход: попиксельные шаги одним циклом или один фильтр целым кадром.
+struct ChainPass {
+    QList<ChainStep> pixels;
+    FilterStage neighbors;
+};
+
+static bool isFilterChainExpression(const QString &code) {
+    return code.contains(filterChainSeparator) || code.contains(filterStageParamSeparator);
+}
+
+// Стадии выражения; false и текст ошибки при неизвестном коде или параметре.
+static bool parseFilterChain(const QString &expression, QList<FilterStage> *stages, QString *error) {
+    stages->clear();
+    for (const QString &part : expression.split(filterChainSeparator)) {
+        const QStringList fields = part.trimmed().split(filterStageParamSeparator);
+        const QString code = fields.first().trimmed();
+        FilterStage stage;
+        {
+            FilterRegistry &registry = filterRegistry();
+            QMutexLocker locker(&registry.mutex);
+            stage.spec = registry.byCode.value(code, nullptr);
+        }
+        if (!stage.spec || stage.spec->id >= FilterId::Chain) {
+            *error = QStringLiteral("неизвестный фильтр «%1»").arg(code);
+            return false;
+        }
+        stage.values = stage.spec->defaults();
+        if (fields.size() - 1 > stage.values.size()) {
+            *error = QStringLiteral("у фильтра «%1» параметров меньше, чем задано").arg(code);
+            return false;
+        }
+        for (int i = 1; i < fields.size(); ++i) {
+            bool ok = false;
+            const float value = fields.at(i).trimmed().toFloat(&ok);
+            if (!ok) {
+                *error = QStringLiteral("параметр «%1» фильтра «%2» — не число").arg(fields.at(i), code);
+                return false;
+            }
+            const FilterParam &param = stage.spec->params.at(i - 1);
+            stage.values[i - 1] = qBound(param.minimum, value, param.maximum);
+        }
+        if (stage.spec->id != FilterId::None) {
+            stages->append(stage);
+        }
+    }
+    if (stages->isEmpty()) {
+        *error = QStringLiteral("в цепочке нет фильтров");
+        return false;
+    }
+    return true;
+}
+
+// Таблица «сначала first, потом second».
+static ChannelLut composeChannelLuts(const ChannelLut &first, const ChannelLut &second) {
+    ChannelLut lut = {};
+    for (int c = 0; c < 3; ++c) {
+        for (int v = 0; v < 256; ++v) {
+            lut.table[c][v] = second.table[c][first.table[c][v]];
+        }
+    }
+    return lut;
+}
+
+static QList<ChainPass> compileFilterChain(const QList<FilterStage> &stages) {
+    QList<ChainPass> passes;
+    passes.append(ChainPass());
+    for (const FilterStage &stage : stages) {
+        if (stage.spec->has(FilterNeedsNeighbors)) {
+            if (!passes.last().pixels.isEmpty() || passes.last().neighbors.spec) {
+                passes.append(ChainPass());
+            }
+            passes.last().neighbors = stage;
+            passes.append(ChainPass());
+            continue;
+        }
+        QList<ChainStep> &pixels = passes.last().pixels;
+        if (stage.spec->has(FilterPerChannel) && stage.spec->channelLut) {
+            const ChannelLut &lut = stage.spec->channelLut(stage.values);
+            if (!pixels.isEmpty() && pixels.last().lut) {
+                pixels.last().lut = std::make_shared<const ChannelLut>(composeChannelLuts(*pixels.last().lut, lut));
+            } else {
+                ChainStep step;
+                step.lut = std::make_shared<const ChannelLut>(lut);
+                pixels.append(step);
+            }
+            continue;
+        }
+        ChainStep step;
+        step.stage = stage;
+        pixels.append(step);
+    }
+    if (passes.last().pixels.isEmpty() && !passes.last().neighbors.spec) {
+        passes.removeLast();
+    }
+    return passes;
+}
+
+static QImage::Format chainStepFormat(const ChainStep &step) {
+    return step.lut ? QImage::Format_ARGB32 : step.stage.spec->outputFormat;
+}
+
+// Строки [y0, y0 + rows) кадра from (формат format) переводятся в ARGB32 строки to.
+static void expandRowsToArgb32(const RowTarget &from, QImage::Format format, const RowTarget &to, int y0, int rows, int w) {
+    for (int y = y0; y < y0 + rows; ++y) {
+        QRgb *dst = reinterpret_cast<QRgb*>(to.line(y));
+        const uchar *src = from.line(y);
+        if (format == QImage::Format_ARGB32) {
+            std::memcpy(dst, src, size_t(w) * sizeof(QRgb));
+        } else if (format == QImage::Format_Grayscale8) {
+            for (int x = 0; x < w; ++x) {
+                dst[x] = qRgb(src[x], src[x], src[x]);
+            }
+        } else {
+            const QImage line = QImage(src, w, 1, from.bytesPerLine, format).convertToFormat(QImage::Format_ARGB32);
+            std::memcpy(dst, line.constScanLine(0), size_t(w) * sizeof(QRgb));
+        }
+    }
+}
+
+// Одно ядро на все попиксельные шаги прохода. Полоса копируется в строки
+// результата и дальше обрабатывается там на месте всеми шагами по очереди.
+// Шаги, которые не умеют на месте или пишут другой формат (ч/б), пишут в
+// кадр-черновик из пула и возвращаются в ARGB32; последний такой шаг пишет
+// прямо в результат, а рабочие строки тогда живут в своём кадре. Ядро — для
+// строк [firstRow, lastRow) кадра w x h: у полосы большого снимка черновики
+// размером с полосу, а шаги с prepareRows готовятся только на неё.
+static BandKernel fusedChainKernel(const QList<ChainStep> &steps, int w, int h, int firstRow, int lastRow) {
+    struct Compiled {
+        BandKernel kernel;
+        QImage::Format format;
+        QImage scratch; // держит память scratchTarget
+        RowTarget scratchTarget;
+    };
+    auto compiled = std::make_shared<std::vector<Compiled>>();
+    const PixelKernels &kernels = pixelKernels();
+    const bool wholeFrame = firstRow == 0 && lastRow == h;
+    for (const ChainStep &step : steps) {
+        Compiled c;
+        c.format = chainStepFormat(step);
+        if (step.lut) {
+            const std::shared_ptr<const ChannelLut> lut = step.lut;
+            c.kernel = rowKernel([&kernels, lut](QRgb *line, int lineWidth, int) { kernels.lut(line, lineWidth, *lut); });
+        } else if (!wholeFrame && step.stage.spec->prepareRows) {
+            c.kernel = step.stage.spec->prepareRows(w, h, firstRow, lastRow, step.stage.values);
+        } else {
+            c.kernel = step.stage.spec->prepare(w, h, step.stage.values);
+        }
+        c.scratchTarget = RowTarget{nullptr, 0, 0};
+        compiled->push_back(c);
+    }
+
+    const QImage::Format finalFormat = compiled->back().format;
+    const bool finalInWork = finalFormat == QImage::Format_ARGB32
+                             && (steps.last().lut || steps.last().stage.spec->has(FilterInPlace));
+    for (size_t i = 0; i + 1 < compiled->size(); ++i) {
+        Compiled &c = (*compiled)[i];
+        const bool inPlace = c.format == QImage::Format_ARGB32 && (steps.at(int(i)).lut || steps.at(int(i)).stage.spec->has(FilterInPlace));
+        if (!inPlace) {
+            c.scratch = pooledImage(w, lastRow - firstRow, c.format);
+            c.scratchTarget = RowTarget{c.scratch.bits(), c.scratch.bytesPerLine(), firstRow};
+        }
+    }
+    QImage work; // рабочие строки, если последний шаг пишет не на месте
+    RowTarget workTarget{nullptr, 0, 0};
+    if (!finalInWork) {
+        work = pooledImage(w, lastRow - firstRow, QImage::Format_ARGB32);
+        workTarget = RowTarget{work.bits(), work.bytesPerLine(), firstRow};
+    }
+
+    return [compiled, work, workTarget, finalInWork](const QImage &band, int y0, const RowTarget &out) {
+        const int lineWidth = band.width();
+        const int rows = band.height();
+        const RowTarget rowsTarget = finalInWork ? out : workTarget;
+        for (int i = 0; i < rows; ++i) {
+            uchar *line = rowsTarget.line(y0 + i);
+            if (line != band.constScanLine(i)) {
+                std::memcpy(line, band.constScanLine(i), size_t(lineWidth) * sizeof(QRgb));
+            }
+        }
+        const QImage rowsBand(rowsTarget.line(y0), lineWidth, rows, rowsTarget.bytesPerLine, QImage::Format_ARGB32);
+        const size_t last = compiled->size() - 1;
+        for (size_t i = 0; i < compiled->size(); ++i) {
+            const Compiled &c = (*compiled)[i];
+            if (i == last && !finalInWork) {
+                c.kernel(rowsBand, y0, out);
+            } else if (c.scratchTarget.bits) {
+                c.kernel(rowsBand, y0, c.scratchTarget);
+                expandRowsToArgb32(c.scratchTarget, c.format, rowsTarget, y0, rows, lineWidth);
+            } else {
+                c.kernel(rowsBand, y0, rowsTarget);
+            }
+        }
+    };
+}
+
+// Строки [y0, y0 + band.height()) через шаги steps в out, полосами на всех ядрах.
+static void runChainSteps(const QImage &band, int w, int h, int y0, const QList<ChainStep> &steps, const RowTarget &out) {
+    const int rows = band.height();
+    const BandKernel kernel = fusedChainKernel(steps, w, h, y0, y0 + rows);
+    const uchar *bits = band.constBits();
+    const int bpl = band.bytesPerLine();
+    parallelForRows(rows, w, [&](int from, int to) {
+        const QImage part(bits + size_t(from) * bpl, w, to - from, bpl, QImage::Format_ARGB32);
+        kernel(part, y0 + from, out);
+    });
+}
+
+// Попиксельный проход по целому кадру — для цепочек с границами проходов.
+static QImage runChainPass(const QImage &source, const QList<ChainStep> &steps) {
+    const QImage src = argb32View(source);
+    QImage result = pooledImage(src.width(), src.height(), chainStepFormat(steps.last()));
+    runChainSteps(src, src.width(), src.height(), 0, steps,
+                  RowTarget{result.bits(), result.bytesPerLine(), 0});
+    return result;
+}
+
+static QImage::Format chainPassFormat(const ChainPass &pass) {
+    return pass.neighbors.spec ? pass.neighbors.spec->outputFormat : chainStepFormat(pass.pixels.last());
+}
+
+// Полосовое ядро цепочки с границами проходов: каждая полоса проходит все
+// проходы по очереди, стадии с соседями — через свои ядра stream.
+static BandKernel chainStreamKernel(const QList<ChainPass> &passes, int w, int h) {
+    auto streams = std::make_shared<std::vector<BandKernel>>();
+    for (const ChainPass &pass : passes) {
+        streams->push_back(pass.neighbors.spec ? pass.neighbors.spec->stream(w, h, pass.neighbors.values) : BandKernel());
+    }
+    return [passes, streams, w, h](const QImage &band, int y0, const RowTarget &out) {
+        const int rows = band.height();
+        QImage frame = band;
+        for (int i = 0; i < passes.size(); ++i) {
+            const ChainPass &pass = passes.at(i);
+            const bool last = i + 1 == passes.size();
+            QImage result;
+            RowTarget target = out;
+            if (!last) {
+                result = pooledImage(w, rows, chainPassFormat(pass));
+                target = RowTarget{result.bits(), result.bytesPerLine(), y0};
+            }
+            const QImage input = argb32View(frame);
+            if (pass.neighbors.spec) {
+                (*streams)[size_t(i)](input, y0, target);
+            } else {
+                runChainSteps(input, w, h, y0, pass.pixels, target);
+            }
+            frame = result;
+        }
+    };
+}
+
+// Регистрирует цепочку code из выражения expression; title — подпись в интерфейсе.
+// Уже зарегистрированная с тем же кодом возвращается как есть. nullptr и
+// текст в error — если выражение не разбирается или код занят фильтром.
+static const FilterSpec *registerFilterChain(const QString &code, const QString &title, const QString &expression,
+                                             QString *error) {
+    static std::atomic<int> nextChainId{0};
+    QString message;
+    if (!error) {
+        error = &message;
+    }
+    FilterRegistry &registry = filterRegistry();
+    {
+        QMutexLocker locker(&registry.mutex);
+        if (const FilterSpec *existing = registry.byCode.value(code, nullptr)) {
+            if (existing->id >= FilterId::Chain) {
+                return existing;
+            }
+            *error = QStringLiteral("код «%1» уже занят фильтром").arg(code);
+            return nullptr;
+        }
+    }
+
+    QList<FilterStage> parsed;
+    if (!parseFilterChain(expression, &parsed, error)) {
+        return nullptr;
+    }
+    const QList<ChainPass> passes = compileFilterChain(parsed);
+
+    FilterSpec spec;
+    spec.id = FilterId(quint16(FilterId::Chain) + nextChainId.fetch_add(1));
+    spec.code = code;
+    spec.title = title;
+    QStringList slugs;
+    QStringList ffmpeg;
+    bool defaultValues = true;
+    bool perChannel = true;
+    for (const FilterStage &stage : parsed) {
+        slugs << stage.spec->slug;
+        if (!stage.spec->ffmpeg.isEmpty()) {
+            ffmpeg << stage.spec->ffmpeg;
+        }
+        defaultValues = defaultValues && stage.values == stage.spec->defaults();
+        perChannel = perChannel && stage.spec->has(FilterPerChannel) && stage.spec->channelLut;
+    }
+    spec.slug = slugs.join(QLatin1Char('_'));
+    if (defaultValues) {
+        spec.ffmpeg = ffmpeg.join(QLatin1Char(','));
+    }
+
+    const ChainPass &lastPass = passes.last();
+    if (passes.size() == 1 && !lastPass.neighbors.spec) {
+        const QList<ChainStep> steps = lastPass.pixels;
+        spec.outputFormat = chainStepFormat(steps.last());
+        spec.traits = spec.outputFormat == QImage::Format_ARGB32 ? FilterInPlace : 0;
+        spec.prepare = [steps](int w, int h, const FilterValues &) { return fusedChainKernel(steps, w, h, 0, h); };
+        spec.prepareRows = [steps](int w, int h, int y0, int y1, const FilterValues &) {
+            return fusedChainKernel(steps, w, h, y0, y1);
+        };
+        if (perChannel) {
+            // все стадии — таблицы, и они уже слиты в одну
+            const std::shared_ptr<const ChannelLut> lut = steps.first().lut;
+            spec.traits |= FilterPerChannel;
+            spec.channelLut = [lut](const FilterValues &) -> const ChannelLut & { return *lut; };
+        }
+    } else {
+        spec.outputFormat = chainPassFormat(lastPass);
+        spec.traits = FilterNeedsNeighbors;
+        bool streamable = true;
+        for (const ChainPass &pass : passes) {
+            streamable = streamable && (!pass.neighbors.spec || pass.neighbors.spec->stream);
+        }
+        if (streamable) {
+            spec.stream = [passes](int w, int h, const FilterValues &) { return chainStreamKernel(passes, w, h); };
+        }
+        spec.whole = [passes](const QImage &src, const FilterValues &) {
+            QImage frame = src;
+            for (const ChainPass &pass : passes) {
+                frame = pass.neighbors.spec ? pass.neighbors.spec->whole(frame, pass.neighbors.values)
+                                            : runChainPass(frame, pass.pixels);
+            }
+            return frame;
+        };
+    }
+
+    if (!registry.add(spec)) {
+        // тот же код мог успеть зарегистрировать другой поток
+        QMutexLocker locker(&registry.mutex);
+        const FilterSpec *existing = registry.byCode.value(code, nullptr);
+        if (!existing || existing->id < FilterId::Chain) {
+            *error = QStringLiteral("код «%1» уже занят фильтром").arg(code);
+            return nullptr;
+        }
+        return existing;
+    }
+    return findFilter(code);
+}
+
+// Сохранённые цепочки: имя (оно же код) и выражение, в настройках приложения.
+static const char filterChainsKey[] = "filterChains";
+
+// Регистрирует сохранённые цепочки; возвращает зарегистрированные по порядку.
+// Цепочки, которые больше не разбираются, пропускаются с предупреждением.
+static QList<const FilterSpec*> loadFilterChains() {
+    QList<const FilterSpec*> loaded;
+    QSettings settings(QStringLiteral("lab-2"), QStringLiteral("lab-2"));
+    const int count = settings.beginReadArray(QLatin1String(filterChainsKey));
+    for (int i = 0; i < count; ++i) {
+        settings.setArrayIndex(i);
+        const QString name = settings.value(QStringLiteral("name")).toString();
+        const QString expression = settings.value(QStringLiteral("expression")).toString();
+        QString error;
+        if (const FilterSpec *spec = registerFilterChain(name, name, expression, &error)) {
+            loaded.append(spec);
+        } else {
+            qWarning() << "Цепочка" << name << "пропущена:" << error;
+        }
+    }
+    settings.endArray();
+    return loaded;
+}
+
+// Дописывает цепочку в настройки; цепочка с тем же именем заменяется.
+static void saveFilterChain(const QString &name, const QString &expression) {
+    QSettings settings(QStringLiteral("lab-2"), QStringLiteral("lab-2"));
+    QList<QPair<QString, QString>> chains;
+    const int count = settings.beginReadArray(QLatin1String(filterChainsKey));
+    for (int i = 0; i < count; ++i) {
+        settings.setArrayIndex(i);
+        const QString existing = settings.value(QStringLiteral("name")).toString();
+        if (existing != name) {
+            chains.append(qMakePair(existing, settings.value(QStringLiteral("expression")).toString()));
+        }
+    }
+    settings.endArray();
+    chains.append(qMakePair(name, expression));
+
+    settings.beginWriteArray(QLatin1String(filterChainsKey), chains.size());
+    for (int i = 0; i < chains.size(); ++i) {
+        settings.setArrayIndex(i);
+        settings.setValue(QStringLiteral("name"), chains.at(i).first);
+        settings.setValue(QStringLiteral("expression"), chains.at(i).second);
+    }
+    settings.endArray();
+}
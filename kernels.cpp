@@ -0,0 +1,846 @@
+#include <QImage>
+#include <QList>
+
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LAB2_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LAB2_TARGET(isa)
+#else
+#define LAB2_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// Построчные ядра попиксельных фильтров. Скалярные версии повторяют исходные
+// формулы один в один (тот же порядок float операций) или, как винтаж, считают
+// их в фиксированной точке; SIMD-версии обязаны давать побитово тот же
+// результат — это проверяет selfTestFilterKernels().
+
+// Тоновый фильтр по каналам r, g, b: out = round((v + (255 - v) * lift) * scale).
+// lift = 0 или scale = 1 не меняют значение, поэтому тёплый и холодный фильтры
+// описываются одной структурой без потери точности.
+struct ToneParams {
+    float lift[3];
+    float scale[3];
+};
+
+// Поканальная таблица: out = table[c][v]. В неё компилируются фильтры, у которых
+// выходной канал зависит только от того же входного канала (тёплый, холодный,
+// постеризация без дизеринга).
+struct ChannelLut {
+    uchar table[3][256];  // r, g, b
+    uchar padding[4];     // gather читает по 4 байта начиная с последнего индекса
+};
+
+// Таблицы произведений для сепии в фиксированной точке 16.16:
+// out_o = min(255, (t[o][0][r] + t[o][1][g] + t[o][2][b]) >> 16).
+// Каждое произведение округлено вверх — так результат отличается от исходной
+// формулы в double не больше чем на 1 и лишь на 859 из 2^24 цветов.
+struct SepiaTables {
+    quint32 t[3][3][256];
+};
+
+// Винтаж в фиксированной точке. Обесцвечивание, тон и контраст линейны, поэтому
+// складываются в матрицу 3x3 со сдвигом: t_o = sum(weight[o][c] * in_c) + offset[o].
+// Веса — Q14 в int16 (по модулю меньше 2 при любых параметрах фильтра), сдвиг —
+// Q14 в int32 вместе с половиной шага для округления до Q6. Дальше канал живёт
+// в int16 Q6: умножение на виньетку (Q15) с округлением, как pmulhrsw, и
+// сложение с шумом (Q6) с насыщением, как paddsw. Всё целочисленное, поэтому
+// результат одинаков на любом компиляторе и наборе инструкций, а в SIMD канал
+// занимает 16 бит — вдвое больше пикселей на вектор, чем в float. От исходной
+// формулы во float отличается не больше чем на 1 (проверяется в --selftest).
+struct VintageParams {
+    qint16 weight[3][3];  // [выход r, g, b][вход r, g, b], Q14
+    qint32 offset[3];     // Q14, с +128 для округления при сдвиге на 8
+};
+
+// Исходная формула винтажа во float: по ней строятся веса и проверяется ядро.
+struct VintageReference {
+    float desatKeep;      // 1 - desatAmount
+    float desat;
+    float toneR;          // 0.30 * toneAmount
+    float toneG;          // 0.12 * toneAmount
+    float toneBMul;       // 1 - 0.20 * toneAmount
+    float contrastMul;
+};
+
+// Множители виньетки для кадра width x height, Q15 (32767 — без затемнения).
+// dy^2 у строк y и height - y совпадает побитово (центр на height / 2),
+// поэтому хранится только верхняя половина кадра. Маска полосы большого
+// снимка (rows > 0) хранит только строки [firstRow, firstRow + rows).
+struct VignetteMask {
+    int width = 0;
+    int height = 0;
+    int firstRow = 0;
+    int rows = 0;
+    std::vector<qint16> factors;
+
+    const qint16 *row(int y) const {
+        if (rows > 0) {
+            return factors.data() + size_t(y - firstRow) * width;
+        }
+        return factors.data() + size_t(y <= height / 2 ? y : height - y) * width;
+    }
+};
+
+// Та же формула, что раньше считалась в каждом пикселе ядра.
+static inline float vignetteFactor(int x, int y, float cx, float cy, float maxDist, float amount) {
+    float dx = x - cx;
+    float dy = y - cy;
+    float d = std::sqrt(dx*dx + dy*dy);
+    float t = d / maxDist; // 0..1
+    float vign = 1.0f - amount * (t * t);
+    if (vign < 0.0f) vign = 0.0f;
+    return vign;
+}
+
+// Зерно из счётчика: значение шума зависит только от (seed, x, y), поэтому
+// любую полосу или тайл можно считать независимо и результат воспроизводим.
+// Хэш — lowbias32 (C. Wellons), только целые умножения и сдвиги.
+static inline quint32 grainHash(quint32 v) {
+    v ^= v >> 16;
+    v *= 0x7feb352du;
+    v ^= v >> 15;
+    v *= 0x846ca68bu;
+    v ^= v >> 16;
+    return v;
+}
+
+static inline quint32 grainRowKey(quint32 seed, int y) {
+    return grainHash(seed ^ grainHash(quint32(y) + 0x9e3779b9u));
+}
+
+// Равномерный шум в [-1, 1), умноженный на scale; scale и результат — Q6.
+static inline qint16 grainValue(quint32 rowKey, int x, int scale) {
+    const int u = int(grainHash(rowKey + quint32(x)) >> 16) - 32768;
+    return qint16((u * scale + 0x4000) >> 15);
+}
+
+// Множитель виньетки или амплитуда шума во float -> Q15 / Q6.
+static inline qint16 toQ15(float v) {
+    return qint16(qBound(0L, std::lround(v * 32767.0f), 32767L));
+}
+
+static inline qint16 toQ6(float v) {
+    return qint16(qBound(-32768L, std::lround(v * 64.0f), 32767L));
+}
+
+static inline int roundToByte(float v) {
+    return qBound(0, int(std::round(v)), 255);
+}
+
+static inline QRgb tonePixel(QRgb p, const ToneParams &t) {
+    const int r = qRed(p);
+    const int g = qGreen(p);
+    const int b = qBlue(p);
+    const int nr = roundToByte((r + (255 - r) * t.lift[0]) * t.scale[0]);
+    const int ng = roundToByte((g + (255 - g) * t.lift[1]) * t.scale[1]);
+    const int nb = roundToByte((b + (255 - b) * t.lift[2]) * t.scale[2]);
+    return qRgba(nr, ng, nb, qAlpha(p));
+}
+
+// Исходная формула сепии в double, по ней строятся и проверяются таблицы.
+static inline QRgb sepiaReferencePixel(QRgb p) {
+    const int r = qRed(p);
+    const int g = qGreen(p);
+    const int b = qBlue(p);
+    const int tr = qBound(0, static_cast<int>(0.393*r + 0.769*g + 0.189*b), 255);
+    const int tg = qBound(0, static_cast<int>(0.349*r + 0.686*g + 0.168*b), 255);
+    const int tb = qBound(0, static_cast<int>(0.272*r + 0.534*g + 0.131*b), 255);
+    return qRgba(tr, tg, tb, qAlpha(p));
+}
+
+static SepiaTables buildSepiaTables() {
+    static const double weights[3][3] = {
+        {0.393, 0.769, 0.189},
+        {0.349, 0.686, 0.168},
+        {0.272, 0.534, 0.131}
+    };
+    SepiaTables tables;
+    for (int o = 0; o < 3; ++o) {
+        for (int c = 0; c < 3; ++c) {
+            for (int v = 0; v < 256; ++v) {
+                tables.t[o][c][v] = static_cast<quint32>(std::ceil(weights[o][c] * v * 65536.0));
+            }
+        }
+    }
+    return tables;
+}
+
+static const SepiaTables &sepiaTables() {
+    static const SepiaTables tables = buildSepiaTables();
+    return tables;
+}
+
+static inline QRgb lutPixel(QRgb p, const ChannelLut &lut) {
+    return qRgba(lut.table[0][qRed(p)], lut.table[1][qGreen(p)], lut.table[2][qBlue(p)], qAlpha(p));
+}
+
+static inline int sepiaChannel(const quint32 (&t)[3][256], int r, int g, int b) {
+    return int(qMin<quint32>((t[0][r] + t[1][g] + t[2][b]) >> 16, 255u));
+}
+
+static inline QRgb sepiaPixel(QRgb p, const SepiaTables &s) {
+    const int r = qRed(p);
+    const int g = qGreen(p);
+    const int b = qBlue(p);
+    return qRgba(sepiaChannel(s.t[0], r, g, b), sepiaChannel(s.t[1], r, g, b), sepiaChannel(s.t[2], r, g, b), qAlpha(p));
+}
+
+static inline QRgb solarizePixel(QRgb p, int threshold) {
+    if (qGray(p) <= threshold) {
+        return p;
+    }
+    return qRgba(255 - 3*qRed(p), 255 - 3*qGreen(p), 255 - 3*qBlue(p), qAlpha(p));
+}
+
+static inline qint16 saturate16(int v) {
+    return qint16(qBound(-32768, v, 32767));
+}
+
+// Один канал винтажа: t — сумма матрицы в Q14, дальше Q6 до самого конца.
+static inline int vintageChannel(int t, const qint16 *vignette, const qint16 *noise, int x) {
+    int q = saturate16(t >> 8);
+    if (vignette) {
+        q = (q * vignette[x] + 0x4000) >> 15;
+    }
+    if (noise) {
+        q = saturate16(q + noise[x]);
+    }
+    return qBound(0, saturate16(q + 32) >> 6, 255);
+}
+
+static inline QRgb vintagePixel(QRgb p, const VintageParams &v, const qint16 *vignette, const qint16 *noise, int x) {
+    const int r = qRed(p);
+    const int g = qGreen(p);
+    const int b = qBlue(p);
+    int out[3];
+    for (int o = 0; o < 3; ++o) {
+        const int t = v.weight[o][0] * r + v.weight[o][1] * g + v.weight[o][2] * b + v.offset[o];
+        out[o] = vintageChannel(t, vignette, noise, x);
+    }
+    return qRgba(out[0], out[1], out[2], qAlpha(p));
+}
+
+// Исходная формула винтажа во float; vign = 1 и n = 0 — без виньетки и шума.
+static inline QRgb vintageReferencePixel(QRgb p, const VintageReference &v, float vign, float n) {
+    float r = qRed(p);
+    float g = qGreen(p);
+    float b = qBlue(p);
+
+    float lum = 0.299f * r + 0.587f * g + 0.114f * b;
+    r = r * v.desatKeep + lum * v.desat;
+    g = g * v.desatKeep + lum * v.desat;
+    b = b * v.desatKeep + lum * v.desat;
+
+    r = r + (255.0f - r) * v.toneR;
+    g = g + (255.0f - g) * v.toneG;
+    b = b * v.toneBMul;
+
+    r = (r - 128.0f) * v.contrastMul + 128.0f;
+    g = (g - 128.0f) * v.contrastMul + 128.0f;
+    b = (b - 128.0f) * v.contrastMul + 128.0f;
+
+    r *= vign;
+    g *= vign;
+    b *= vign;
+
+    r += n;
+    g += n;
+    b += n;
+
+    return qRgba(roundToByte(r), roundToByte(g), roundToByte(b), qAlpha(p));
+}
+
+static void lutRowScalar(QRgb *line, int w, const ChannelLut &lut) {
+    for (int x = 0; x < w; ++x) {
+        line[x] = lutPixel(line[x], lut);
+    }
+}
+
+static void sepiaRowScalar(QRgb *line, int w, const SepiaTables &s) {
+    for (int x = 0; x < w; ++x) {
+        line[x] = sepiaPixel(line[x], s);
+    }
+}
+
+static void solarizeRowScalar(QRgb *line, int w, int threshold) {
+    for (int x = 0; x < w; ++x) {
+        line[x] = solarizePixel(line[x], threshold);
+    }
+}
+
+static void vintageRowScalar(QRgb *line, int w, const VintageParams &v, const qint16 *vignette, const qint16 *noise) {
+    for (int x = 0; x < w; ++x) {
+        line[x] = vintagePixel(line[x], v, vignette, noise, x);
+    }
+}
+
+static void grainRowScalar(qint16 *out, int w, quint32 rowKey, int scale) {
+    for (int x = 0; x < w; ++x) {
+        out[x] = grainValue(rowKey, x, scale);
+    }
+}
+
+#ifdef LAB2_X86
+
+// ---- SSE4.1: 4 пикселя за итерацию ----
+
+template <int Shift>
+LAB2_TARGET("sse4.1") static inline __m128i channelIntSse41(__m128i px) {
+    return _mm_and_si128(_mm_srli_epi32(px, Shift), _mm_set1_epi32(0xff));
+}
+
+LAB2_TARGET("sse4.1") static inline __m128i packSse41(__m128i src, __m128i r, __m128i g, __m128i b) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi32(255);
+    r = _mm_min_epi32(_mm_max_epi32(r, zero), max);
+    g = _mm_min_epi32(_mm_max_epi32(g, zero), max);
+    b = _mm_min_epi32(_mm_max_epi32(b, zero), max);
+    const __m128i a = _mm_and_si128(src, _mm_set1_epi32(static_cast<int>(0xff000000u)));
+    return _mm_or_si128(_mm_or_si128(a, _mm_slli_epi32(r, 16)), _mm_or_si128(_mm_slli_epi32(g, 8), b));
+}
+
+LAB2_TARGET("sse4.1") static void solarizeRowSse41(QRgb *line, int w, int threshold) {
+    const __m128i thr = _mm_set1_epi32(threshold);
+    const __m128i rgbMask = _mm_set1_epi32(0x00ffffff);
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        __m128i *ptr = reinterpret_cast<__m128i*>(line + x);
+        const __m128i px = _mm_loadu_si128(ptr);
+        const __m128i lum = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(
+                                               _mm_mullo_epi32(channelIntSse41<16>(px), _mm_set1_epi32(11)),
+                                               _mm_slli_epi32(channelIntSse41<8>(px), 4)),
+                                               _mm_mullo_epi32(channelIntSse41<0>(px), _mm_set1_epi32(5))), 5);
+        // (255 - 3*v) & 0xff == ~(3*v) по каждому байту
+        const __m128i tripled = _mm_add_epi8(px, _mm_add_epi8(px, px));
+        const __m128i inverted = _mm_or_si128(_mm_andnot_si128(tripled, rgbMask), _mm_andnot_si128(rgbMask, px));
+        _mm_storeu_si128(ptr, _mm_blendv_epi8(px, inverted, _mm_cmpgt_epi32(lum, thr)));
+    }
+    for (; x < w; ++x) {
+        line[x] = solarizePixel(line[x], threshold);
+    }
+}
+
+// Веса строки матрицы для pmaddwd: пары (r, g) и (b, 0).
+LAB2_TARGET("sse4.1") static inline __m128i weightPairSse41(qint16 lo, qint16 hi) {
+    return _mm_set1_epi32(int((quint32(quint16(hi)) << 16) | quint16(lo)));
+}
+
+// Канал выхода o для 8 пикселей: матрица в int32, дальше int16 Q6 как в vintageChannel.
+LAB2_TARGET("sse4.1") static inline __m128i vintageChannelSse41(const VintageParams &v, int o,
+                                                                __m128i rgLo, __m128i rgHi, __m128i bLo, __m128i bHi,
+                                                                __m128i vign, __m128i n, bool hasVignette, bool hasNoise) {
+    const __m128i wRG = weightPairSse41(v.weight[o][0], v.weight[o][1]);
+    const __m128i wB = weightPairSse41(v.weight[o][2], 0);
+    const __m128i offset = _mm_set1_epi32(v.offset[o]);
+    const __m128i tLo = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rgLo, wRG), _mm_madd_epi16(bLo, wB)), offset);
+    const __m128i tHi = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rgHi, wRG), _mm_madd_epi16(bHi, wB)), offset);
+    __m128i q = _mm_packs_epi32(_mm_srai_epi32(tLo, 8), _mm_srai_epi32(tHi, 8));
+    if (hasVignette) {
+        q = _mm_mulhrs_epi16(q, vign);
+    }
+    if (hasNoise) {
+        q = _mm_adds_epi16(q, n);
+    }
+    return _mm_srai_epi16(_mm_adds_epi16(q, _mm_set1_epi16(32)), 6);
+}
+
+LAB2_TARGET("sse4.1") static void vintageRowSse41(QRgb *line, int w, const VintageParams &v, const qint16 *vignette, const qint16 *noise) {
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i *ptr = reinterpret_cast<__m128i*>(line + x);
+        const __m128i px0 = _mm_loadu_si128(ptr);
+        const __m128i px1 = _mm_loadu_si128(ptr + 1);
+        // каналы 8 пикселей в int16, по порядку
+        const __m128i r = _mm_packus_epi32(channelIntSse41<16>(px0), channelIntSse41<16>(px1));
+        const __m128i g = _mm_packus_epi32(channelIntSse41<8>(px0), channelIntSse41<8>(px1));
+        const __m128i b = _mm_packus_epi32(channelIntSse41<0>(px0), channelIntSse41<0>(px1));
+        const __m128i rgLo = _mm_unpacklo_epi16(r, g), rgHi = _mm_unpackhi_epi16(r, g);
+        const __m128i bLo = _mm_unpacklo_epi16(b, zero), bHi = _mm_unpackhi_epi16(b, zero);
+        const __m128i vign = vignette ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(vignette + x)) : zero;
+        const __m128i n = noise ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(noise + x)) : zero;
+
+        const __m128i outR = vintageChannelSse41(v, 0, rgLo, rgHi, bLo, bHi, vign, n, vignette != nullptr, noise != nullptr);
+        const __m128i outG = vintageChannelSse41(v, 1, rgLo, rgHi, bLo, bHi, vign, n, vignette != nullptr, noise != nullptr);
+        const __m128i outB = vintageChannelSse41(v, 2, rgLo, rgHi, bLo, bHi, vign, n, vignette != nullptr, noise != nullptr);
+        _mm_storeu_si128(ptr, packSse41(px0, _mm_cvtepi16_epi32(outR), _mm_cvtepi16_epi32(outG), _mm_cvtepi16_epi32(outB)));
+        _mm_storeu_si128(ptr + 1, packSse41(px1, _mm_cvtepi16_epi32(_mm_unpackhi_epi64(outR, outR)),
+                                            _mm_cvtepi16_epi32(_mm_unpackhi_epi64(outG, outG)),
+                                            _mm_cvtepi16_epi32(_mm_unpackhi_epi64(outB, outB))));
+    }
+    for (; x < w; ++x) {
+        line[x] = vintagePixel(line[x], v, vignette, noise, x);
+    }
+}
+
+LAB2_TARGET("sse4.1") static inline __m128i grainHashSse41(__m128i v) {
+    v = _mm_xor_si128(v, _mm_srli_epi32(v, 16));
+    v = _mm_mullo_epi32(v, _mm_set1_epi32(0x7feb352d));
+    v = _mm_xor_si128(v, _mm_srli_epi32(v, 15));
+    v = _mm_mullo_epi32(v, _mm_set1_epi32(static_cast<int>(0x846ca68bu)));
+    return _mm_xor_si128(v, _mm_srli_epi32(v, 16));
+}
+
+// Шум grainValue для 4 соседних x, в int32.
+LAB2_TARGET("sse4.1") static inline __m128i grainValuesSse41(__m128i counter, __m128i scale) {
+    const __m128i u = _mm_sub_epi32(_mm_srli_epi32(grainHashSse41(counter), 16), _mm_set1_epi32(32768));
+    return _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(u, scale), _mm_set1_epi32(0x4000)), 15);
+}
+
+LAB2_TARGET("sse4.1") static void grainRowSse41(qint16 *out, int w, quint32 rowKey, int scale) {
+    const __m128i s = _mm_set1_epi32(scale);
+    __m128i counter = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(rowKey)), _mm_setr_epi32(0, 1, 2, 3));
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        const __m128i lo = grainValuesSse41(counter, s);
+        const __m128i hi = grainValuesSse41(_mm_add_epi32(counter, _mm_set1_epi32(4)), s);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packs_epi32(lo, hi));
+        counter = _mm_add_epi32(counter, _mm_set1_epi32(8));
+    }
+    for (; x < w; ++x) {
+        out[x] = grainValue(rowKey, x, scale);
+    }
+}
+
+// ---- AVX2: 8 пикселей за итерацию ----
+
+template <int Shift>
+LAB2_TARGET("avx2") static inline __m256i channelIntAvx2(__m256i px) {
+    return _mm256_and_si256(_mm256_srli_epi32(px, Shift), _mm256_set1_epi32(0xff));
+}
+
+LAB2_TARGET("avx2") static inline __m256i packAvx2(__m256i src, __m256i r, __m256i g, __m256i b) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi32(255);
+    r = _mm256_min_epi32(_mm256_max_epi32(r, zero), max);
+    g = _mm256_min_epi32(_mm256_max_epi32(g, zero), max);
+    b = _mm256_min_epi32(_mm256_max_epi32(b, zero), max);
+    const __m256i a = _mm256_and_si256(src, _mm256_set1_epi32(static_cast<int>(0xff000000u)));
+    return _mm256_or_si256(_mm256_or_si256(a, _mm256_slli_epi32(r, 16)),
+                           _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+}
+
+// Табличные ядра на AVX2 читают таблицы через gather: 8 независимых загрузок за инструкцию.
+LAB2_TARGET("avx2") static inline __m256i gatherByteAvx2(const uchar *table, __m256i idx) {
+    return _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(table), idx, 1),
+                            _mm256_set1_epi32(0xff));
+}
+
+LAB2_TARGET("avx2") static void lutRowAvx2(QRgb *line, int w, const ChannelLut &lut) {
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256i *ptr = reinterpret_cast<__m256i*>(line + x);
+        const __m256i px = _mm256_loadu_si256(ptr);
+        const __m256i r = gatherByteAvx2(lut.table[0], channelIntAvx2<16>(px));
+        const __m256i g = gatherByteAvx2(lut.table[1], channelIntAvx2<8>(px));
+        const __m256i b = gatherByteAvx2(lut.table[2], channelIntAvx2<0>(px));
+        _mm256_storeu_si256(ptr, packAvx2(px, r, g, b));
+    }
+    for (; x < w; ++x) {
+        line[x] = lutPixel(line[x], lut);
+    }
+}
+
+LAB2_TARGET("avx2") static inline __m256i sepiaChannelAvx2(const quint32 (&t)[3][256], __m256i r, __m256i g, __m256i b) {
+    const __m256i sum = _mm256_add_epi32(_mm256_add_epi32(
+                                             _mm256_i32gather_epi32(reinterpret_cast<const int*>(t[0]), r, 4),
+                                             _mm256_i32gather_epi32(reinterpret_cast<const int*>(t[1]), g, 4)),
+                                         _mm256_i32gather_epi32(reinterpret_cast<const int*>(t[2]), b, 4));
+    return _mm256_srli_epi32(sum, 16);
+}
+
+LAB2_TARGET("avx2") static void sepiaRowAvx2(QRgb *line, int w, const SepiaTables &s) {
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256i *ptr = reinterpret_cast<__m256i*>(line + x);
+        const __m256i px = _mm256_loadu_si256(ptr);
+        const __m256i r = channelIntAvx2<16>(px);
+        const __m256i g = channelIntAvx2<8>(px);
+        const __m256i b = channelIntAvx2<0>(px);
+        _mm256_storeu_si256(ptr, packAvx2(px, sepiaChannelAvx2(s.t[0], r, g, b),
+                                          sepiaChannelAvx2(s.t[1], r, g, b),
+                                          sepiaChannelAvx2(s.t[2], r, g, b)));
+    }
+    for (; x < w; ++x) {
+        line[x] = sepiaPixel(line[x], s);
+    }
+}
+
+LAB2_TARGET("avx2") static void solarizeRowAvx2(QRgb *line, int w, int threshold) {
+    const __m256i thr = _mm256_set1_epi32(threshold);
+    const __m256i rgbMask = _mm256_set1_epi32(0x00ffffff);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256i *ptr = reinterpret_cast<__m256i*>(line + x);
+        const __m256i px = _mm256_loadu_si256(ptr);
+        const __m256i lum = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(
+                                                  _mm256_mullo_epi32(channelIntAvx2<16>(px), _mm256_set1_epi32(11)),
+                                                  _mm256_slli_epi32(channelIntAvx2<8>(px), 4)),
+                                                  _mm256_mullo_epi32(channelIntAvx2<0>(px), _mm256_set1_epi32(5))), 5);
+        const __m256i tripled = _mm256_add_epi8(px, _mm256_add_epi8(px, px));
+        const __m256i inverted = _mm256_or_si256(_mm256_andnot_si256(tripled, rgbMask), _mm256_andnot_si256(rgbMask, px));
+        _mm256_storeu_si256(ptr, _mm256_blendv_epi8(px, inverted, _mm256_cmpgt_epi32(lum, thr)));
+    }
+    for (; x < w; ++x) {
+        line[x] = solarizePixel(line[x], threshold);
+    }
+}
+
+LAB2_TARGET("avx2") static inline __m256i weightPairAvx2(qint16 lo, qint16 hi) {
+    return _mm256_set1_epi32(int((quint32(quint16(hi)) << 16) | quint16(lo)));
+}
+
+LAB2_TARGET("avx2") static inline __m256i vintageChannelAvx2(const VintageParams &v, int o,
+                                                             __m256i rgLo, __m256i rgHi, __m256i bLo, __m256i bHi,
+                                                             __m256i vign, __m256i n, bool hasVignette, bool hasNoise) {
+    const __m256i wRG = weightPairAvx2(v.weight[o][0], v.weight[o][1]);
+    const __m256i wB = weightPairAvx2(v.weight[o][2], 0);
+    const __m256i offset = _mm256_set1_epi32(v.offset[o]);
+    const __m256i tLo = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(rgLo, wRG), _mm256_madd_epi16(bLo, wB)), offset);
+    const __m256i tHi = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(rgHi, wRG), _mm256_madd_epi16(bHi, wB)), offset);
+    __m256i q = _mm256_packs_epi32(_mm256_srai_epi32(tLo, 8), _mm256_srai_epi32(tHi, 8));
+    if (hasVignette) {
+        q = _mm256_mulhrs_epi16(q, vign);
+    }
+    if (hasNoise) {
+        q = _mm256_adds_epi16(q, n);
+    }
+    return _mm256_srai_epi16(_mm256_adds_epi16(q, _mm256_set1_epi16(32)), 6);
+}
+
+// 16 пикселей за итерацию. pack внутри 128-битных половин даёт порядок
+// [0-3, 8-11 | 4-7, 12-15]; строки виньетки и шума переставляются так же, а
+// unpacklo/unpackhi возвращают каналы первых и вторых 8 пикселей по порядку.
+LAB2_TARGET("avx2") static void vintageRowAvx2(QRgb *line, int w, const VintageParams &v, const qint16 *vignette, const qint16 *noise) {
+    const __m256i zero = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m256i *ptr = reinterpret_cast<__m256i*>(line + x);
+        const __m256i px0 = _mm256_loadu_si256(ptr);
+        const __m256i px1 = _mm256_loadu_si256(ptr + 1);
+        const __m256i r = _mm256_packus_epi32(channelIntAvx2<16>(px0), channelIntAvx2<16>(px1));
+        const __m256i g = _mm256_packus_epi32(channelIntAvx2<8>(px0), channelIntAvx2<8>(px1));
+        const __m256i b = _mm256_packus_epi32(channelIntAvx2<0>(px0), channelIntAvx2<0>(px1));
+        const __m256i rgLo = _mm256_unpacklo_epi16(r, g), rgHi = _mm256_unpackhi_epi16(r, g);
+        const __m256i bLo = _mm256_unpacklo_epi16(b, zero), bHi = _mm256_unpackhi_epi16(b, zero);
+        const __m256i vign = vignette ? _mm256_permute4x64_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(vignette + x)), 0xd8)
+                                      : zero;
+        const __m256i n = noise ? _mm256_permute4x64_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(noise + x)), 0xd8)
+                                : zero;
+
+        const __m256i outR = vintageChannelAvx2(v, 0, rgLo, rgHi, bLo, bHi, vign, n, vignette != nullptr, noise != nullptr);
+        const __m256i outG = vintageChannelAvx2(v, 1, rgLo, rgHi, bLo, bHi, vign, n, vignette != nullptr, noise != nullptr);
+        const __m256i outB = vintageChannelAvx2(v, 2, rgLo, rgHi, bLo, bHi, vign, n, vignette != nullptr, noise != nullptr);
+        // int16 -> int32 со знаком (в старшую половину и сдвиг обратно): отрицательные packAvx2 зажмёт в 0
+        _mm256_storeu_si256(ptr, packAvx2(px0, _mm256_srai_epi32(_mm256_unpacklo_epi16(zero, outR), 16),
+                                          _mm256_srai_epi32(_mm256_unpacklo_epi16(zero, outG), 16),
+                                          _mm256_srai_epi32(_mm256_unpacklo_epi16(zero, outB), 16)));
+        _mm256_storeu_si256(ptr + 1, packAvx2(px1, _mm256_srai_epi32(_mm256_unpackhi_epi16(zero, outR), 16),
+                                              _mm256_srai_epi32(_mm256_unpackhi_epi16(zero, outG), 16),
+                                              _mm256_srai_epi32(_mm256_unpackhi_epi16(zero, outB), 16)));
+    }
+    for (; x < w; ++x) {
+        line[x] = vintagePixel(line[x], v, vignette, noise, x);
+    }
+}
+
+LAB2_TARGET("avx2") static inline __m256i grainHashAvx2(__m256i v) {
+    v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 16));
+    v = _mm256_mullo_epi32(v, _mm256_set1_epi32(0x7feb352d));
+    v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 15));
+    v = _mm256_mullo_epi32(v, _mm256_set1_epi32(static_cast<int>(0x846ca68bu)));
+    return _mm256_xor_si256(v, _mm256_srli_epi32(v, 16));
+}
+
+LAB2_TARGET("avx2") static inline __m256i grainValuesAvx2(__m256i counter, __m256i scale) {
+    const __m256i u = _mm256_sub_epi32(_mm256_srli_epi32(grainHashAvx2(counter), 16), _mm256_set1_epi32(32768));
+    return _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(u, scale), _mm256_set1_epi32(0x4000)), 15);
+}
+
+LAB2_TARGET("avx2") static void grainRowAvx2(qint16 *out, int w, quint32 rowKey, int scale) {
+    const __m256i s = _mm256_set1_epi32(scale);
+    __m256i counter = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(rowKey)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        const __m256i lo = grainValuesAvx2(counter, s);
+        const __m256i hi = grainValuesAvx2(_mm256_add_epi32(counter, _mm256_set1_epi32(8)), s);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8));
+        counter = _mm256_add_epi32(counter, _mm256_set1_epi32(16));
+    }
+    for (; x < w; ++x) {
+        out[x] = grainValue(rowKey, x, scale);
+    }
+}
+
+// ---- AVX-512: 16 пикселей за итерацию, хвост строки через маски ----
+
+#define LAB2_AVX512 "avx512f,avx512bw"
+
+template <int Shift>
+LAB2_TARGET(LAB2_AVX512) static inline __m512i channelIntAvx512(__m512i px) {
+    return _mm512_and_si512(_mm512_srli_epi32(px, Shift), _mm512_set1_epi32(0xff));
+}
+
+LAB2_TARGET(LAB2_AVX512) static inline __m512i packAvx512(__m512i src, __m512i r, __m512i g, __m512i b) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i max = _mm512_set1_epi32(255);
+    r = _mm512_min_epi32(_mm512_max_epi32(r, zero), max);
+    g = _mm512_min_epi32(_mm512_max_epi32(g, zero), max);
+    b = _mm512_min_epi32(_mm512_max_epi32(b, zero), max);
+    const __m512i a = _mm512_and_si512(src, _mm512_set1_epi32(static_cast<int>(0xff000000u)));
+    return _mm512_or_si512(_mm512_or_si512(a, _mm512_slli_epi32(r, 16)),
+                           _mm512_or_si512(_mm512_slli_epi32(g, 8), b));
+}
+
+static inline __mmask16 tailMask16(int remaining) {
+    return remaining >= 16 ? __mmask16(0xffff) : __mmask16((1u << remaining) - 1u);
+}
+
+LAB2_TARGET(LAB2_AVX512) static inline __m512i gatherByteAvx512(const uchar *table, __m512i idx) {
+    return _mm512_and_si512(_mm512_i32gather_epi32(idx, table, 1), _mm512_set1_epi32(0xff));
+}
+
+LAB2_TARGET(LAB2_AVX512) static void lutRowAvx512(QRgb *line, int w, const ChannelLut &lut) {
+    for (int x = 0; x < w; x += 16) {
+        const __mmask16 m = tailMask16(w - x);
+        const __m512i px = _mm512_maskz_loadu_epi32(m, line + x);
+        const __m512i r = gatherByteAvx512(lut.table[0], channelIntAvx512<16>(px));
+        const __m512i g = gatherByteAvx512(lut.table[1], channelIntAvx512<8>(px));
+        const __m512i b = gatherByteAvx512(lut.table[2], channelIntAvx512<0>(px));
+        _mm512_mask_storeu_epi32(line + x, m, packAvx512(px, r, g, b));
+    }
+}
+
+// С AVX-512 VBMI таблица на 256 байт целиком лежит в четырёх регистрах и
+// применяется к 64 байтам сразу двумя перестановками vpermi2b — без gather.
+#define LAB2_AVX512VBMI "avx512f,avx512bw,avx512vbmi"
+
+LAB2_TARGET(LAB2_AVX512VBMI) static inline __m512i lookupBytesVbmi(__m512i idx, const __m512i (&t)[4]) {
+    const __m512i lo = _mm512_permutex2var_epi8(t[0], idx, t[1]);
+    const __m512i hi = _mm512_permutex2var_epi8(t[2], idx, t[3]);
+    return _mm512_mask_blend_epi8(_mm512_movepi8_mask(idx), lo, hi);
+}
+
+LAB2_TARGET(LAB2_AVX512VBMI) static void lutRowAvx512Vbmi(QRgb *line, int w, const ChannelLut &lut) {
+    __m512i tables[3][4];
+    for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < 4; ++i) {
+            tables[c][i] = _mm512_loadu_si512(lut.table[c] + 64 * i);
+        }
+    }
+    // байты пикселя ARGB32 в памяти: B, G, R, A
+    const __mmask64 blueBytes = 0x1111111111111111ull;
+    for (int x = 0; x < w; x += 16) {
+        const int remaining = qMin(w - x, 16);
+        const __mmask64 m = remaining == 16 ? ~__mmask64(0) : ((__mmask64(1) << (4 * remaining)) - 1);
+        const __m512i px = _mm512_maskz_loadu_epi8(m, line + x);
+        __m512i out = _mm512_mask_mov_epi8(px, blueBytes, lookupBytesVbmi(px, tables[2]));
+        out = _mm512_mask_mov_epi8(out, blueBytes << 1, lookupBytesVbmi(px, tables[1]));
+        out = _mm512_mask_mov_epi8(out, blueBytes << 2, lookupBytesVbmi(px, tables[0]));
+        _mm512_mask_storeu_epi8(line + x, m, out);
+    }
+}
+
+LAB2_TARGET(LAB2_AVX512) static inline __m512i sepiaChannelAvx512(const quint32 (&t)[3][256], __m512i r, __m512i g, __m512i b) {
+    const __m512i sum = _mm512_add_epi32(_mm512_add_epi32(_mm512_i32gather_epi32(r, t[0], 4),
+                                                          _mm512_i32gather_epi32(g, t[1], 4)),
+                                         _mm512_i32gather_epi32(b, t[2], 4));
+    return _mm512_srli_epi32(sum, 16);
+}
+
+LAB2_TARGET(LAB2_AVX512) static void sepiaRowAvx512(QRgb *line, int w, const SepiaTables &s) {
+    for (int x = 0; x < w; x += 16) {
+        const __mmask16 m = tailMask16(w - x);
+        const __m512i px = _mm512_maskz_loadu_epi32(m, line + x);
+        const __m512i r = channelIntAvx512<16>(px);
+        const __m512i g = channelIntAvx512<8>(px);
+        const __m512i b = channelIntAvx512<0>(px);
+        _mm512_mask_storeu_epi32(line + x, m, packAvx512(px, sepiaChannelAvx512(s.t[0], r, g, b),
+                                                         sepiaChannelAvx512(s.t[1], r, g, b),
+                                                         sepiaChannelAvx512(s.t[2], r, g, b)));
+    }
+}
+
+LAB2_TARGET(LAB2_AVX512) static void solarizeRowAvx512(QRgb *line, int w, int threshold) {
+    const __m512i thr = _mm512_set1_epi32(threshold);
+    const __m512i rgbMask = _mm512_set1_epi32(0x00ffffff);
+    for (int x = 0; x < w; x += 16) {
+        const __mmask16 m = tailMask16(w - x);
+        const __m512i px = _mm512_maskz_loadu_epi32(m, line + x);
+        const __m512i lum = _mm512_srli_epi32(_mm512_add_epi32(_mm512_add_epi32(
+                                                  _mm512_mullo_epi32(channelIntAvx512<16>(px), _mm512_set1_epi32(11)),
+                                                  _mm512_slli_epi32(channelIntAvx512<8>(px), 4)),
+                                                  _mm512_mullo_epi32(channelIntAvx512<0>(px), _mm512_set1_epi32(5))), 5);
+        const __m512i tripled = _mm512_add_epi8(px, _mm512_add_epi8(px, px));
+        const __m512i inverted = _mm512_or_si512(_mm512_andnot_si512(tripled, rgbMask), _mm512_andnot_si512(rgbMask, px));
+        const __mmask16 bright = _mm512_cmpgt_epi32_mask(lum, thr);
+        _mm512_mask_storeu_epi32(line + x, m, _mm512_mask_blend_epi32(bright, px, inverted));
+    }
+}
+
+static inline __mmask32 tailMask32(int remaining) {
+    return remaining >= 32 ? __mmask32(0xffffffffu) : __mmask32((1u << qMax(0, remaining)) - 1u);
+}
+
+LAB2_TARGET(LAB2_AVX512) static inline __m512i vintageChannelAvx512(const VintageParams &v, int o,
+                                                                    __m512i rgLo, __m512i rgHi, __m512i bLo, __m512i bHi,
+                                                                    __m512i vign, __m512i n, bool hasVignette, bool hasNoise) {
+    const __m512i wRG = _mm512_set1_epi32(int((quint32(quint16(v.weight[o][1])) << 16) | quint16(v.weight[o][0])));
+    const __m512i wB = _mm512_set1_epi32(int(quint16(v.weight[o][2])));
+    const __m512i offset = _mm512_set1_epi32(v.offset[o]);
+    const __m512i tLo = _mm512_add_epi32(_mm512_add_epi32(_mm512_madd_epi16(rgLo, wRG), _mm512_madd_epi16(bLo, wB)), offset);
+    const __m512i tHi = _mm512_add_epi32(_mm512_add_epi32(_mm512_madd_epi16(rgHi, wRG), _mm512_madd_epi16(bHi, wB)), offset);
+    __m512i q = _mm512_packs_epi32(_mm512_srai_epi32(tLo, 8), _mm512_srai_epi32(tHi, 8));
+    if (hasVignette) {
+        q = _mm512_mulhrs_epi16(q, vign);
+    }
+    if (hasNoise) {
+        q = _mm512_adds_epi16(q, n);
+    }
+    return _mm512_srai_epi16(_mm512_adds_epi16(q, _mm512_set1_epi16(32)), 6);
+}
+
+// 32 пикселя за итерацию, порядок после pack — как в AVX2, но по четырём 128-битным четвертям.
+LAB2_TARGET(LAB2_AVX512) static void vintageRowAvx512(QRgb *line, int w, const VintageParams &v, const qint16 *vignette, const qint16 *noise) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i order = _mm512_setr_epi64(0, 4, 1, 5, 2, 6, 3, 7);
+    for (int x = 0; x < w; x += 32) {
+        const __mmask16 m0 = tailMask16(qMax(0, w - x));
+        const __mmask16 m1 = tailMask16(qMax(0, w - x - 16));
+        const __mmask32 m16 = tailMask32(w - x);
+        const __m512i px0 = _mm512_maskz_loadu_epi32(m0, line + x);
+        const __m512i px1 = _mm512_maskz_loadu_epi32(m1, line + x + 16);
+        const __m512i r = _mm512_packus_epi32(channelIntAvx512<16>(px0), channelIntAvx512<16>(px1));
+        const __m512i g = _mm512_packus_epi32(channelIntAvx512<8>(px0), channelIntAvx512<8>(px1));
+        const __m512i b = _mm512_packus_epi32(channelIntAvx512<0>(px0), channelIntAvx512<0>(px1));
+        const __m512i rgLo = _mm512_unpacklo_epi16(r, g), rgHi = _mm512_unpackhi_epi16(r, g);
+        const __m512i bLo = _mm512_unpacklo_epi16(b, zero), bHi = _mm512_unpackhi_epi16(b, zero);
+        const __m512i vign = vignette ? _mm512_permutexvar_epi64(order, _mm512_maskz_loadu_epi16(m16, vignette + x)) : zero;
+        const __m512i n = noise ? _mm512_permutexvar_epi64(order, _mm512_maskz_loadu_epi16(m16, noise + x)) : zero;
+
+        const __m512i outR = vintageChannelAvx512(v, 0, rgLo, rgHi, bLo, bHi, vign, n, vignette != nullptr, noise != nullptr);
+        const __m512i outG = vintageChannelAvx512(v, 1, rgLo, rgHi, bLo, bHi, vign, n, vignette != nullptr, noise != nullptr);
+        const __m512i outB = vintageChannelAvx512(v, 2, rgLo, rgHi, bLo, bHi, vign, n, vignette != nullptr, noise != nullptr);
+        _mm512_mask_storeu_epi32(line + x, m0, packAvx512(px0, _mm512_srai_epi32(_mm512_unpacklo_epi16(zero, outR), 16),
+                                                          _mm512_srai_epi32(_mm512_unpacklo_epi16(zero, outG), 16),
+                                                          _mm512_srai_epi32(_mm512_unpacklo_epi16(zero, outB), 16)));
+        _mm512_mask_storeu_epi32(line + x + 16, m1, packAvx512(px1, _mm512_srai_epi32(_mm512_unpackhi_epi16(zero, outR), 16),
+                                                               _mm512_srai_epi32(_mm512_unpackhi_epi16(zero, outG), 16),
+                                                               _mm512_srai_epi32(_mm512_unpackhi_epi16(zero, outB), 16)));
+    }
+}
+
+LAB2_TARGET(LAB2_AVX512) static inline __m512i grainHashAvx512(__m512i v) {
+    v = _mm512_xor_si512(v, _mm512_srli_epi32(v, 16));
+    v = _mm512_mullo_epi32(v, _mm512_set1_epi32(0x7feb352d));
+    v = _mm512_xor_si512(v, _mm512_srli_epi32(v, 15));
+    v = _mm512_mullo_epi32(v, _mm512_set1_epi32(static_cast<int>(0x846ca68bu)));
+    return _mm512_xor_si512(v, _mm512_srli_epi32(v, 16));
+}
+
+LAB2_TARGET(LAB2_AVX512) static void grainRowAvx512(qint16 *out, int w, quint32 rowKey, int scale) {
+    const __m512i s = _mm512_set1_epi32(scale);
+    const __m512i iota = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    for (int x = 0; x < w; x += 16) {
+        const __m512i counter = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(rowKey + quint32(x))), iota);
+        const __m512i u = _mm512_sub_epi32(_mm512_srli_epi32(grainHashAvx512(counter), 16), _mm512_set1_epi32(32768));
+        const __m512i n = _mm512_srai_epi32(_mm512_add_epi32(_mm512_mullo_epi32(u, s), _mm512_set1_epi32(0x4000)), 15);
+        _mm512_mask_cvtepi32_storeu_epi16(out + x, tailMask16(w - x), n);
+    }
+}
+
+#endif // LAB2_X86
+
+struct PixelKernels {
+    const char *name;
+    void (*lut)(QRgb *line, int w, const ChannelLut &lut);
+    void (*sepia)(QRgb *line, int w, const SepiaTables &s);
+    void (*solarize)(QRgb *line, int w, int threshold);
+    // vignette — строка VignetteMask, noise — строка grain; любой из них может быть nullptr
+    void (*vintage)(QRgb *line, int w, const VintageParams &v, const qint16 *vignette, const qint16 *noise);
+    void (*grain)(qint16 *out, int w, quint32 rowKey, int scale);
+};
+
+static const PixelKernels scalarKernels = {
+    "scalar", lutRowScalar, sepiaRowScalar, solarizeRowScalar, vintageRowScalar, grainRowScalar
+};
+
+#ifdef LAB2_X86
+// в SSE4.1 нет gather, табличные фильтры там скалярные
+static const PixelKernels sse41Kernels = {
+    "sse4.1", lutRowScalar, sepiaRowScalar, solarizeRowSse41, vintageRowSse41, grainRowSse41
+};
+static const PixelKernels avx2Kernels = {
+    "avx2", lutRowAvx2, sepiaRowAvx2, solarizeRowAvx2, vintageRowAvx2, grainRowAvx2
+};
+static const PixelKernels avx512Kernels = {
+    "avx512", lutRowAvx512, sepiaRowAvx512, solarizeRowAvx512, vintageRowAvx512, grainRowAvx512
+};
+static const PixelKernels avx512VbmiKernels = {
+    "avx512vbmi", lutRowAvx512Vbmi, sepiaRowAvx512, solarizeRowAvx512, vintageRowAvx512, grainRowAvx512
+};
+#endif
+
+enum CpuFeature {
+    CpuSse41 = 1,
+    CpuAvx2 = 2,
+    CpuAvx512 = 4,
+    CpuAvx512Vbmi = 8
+};
+
+static int detectCpuFeatures() {
+    int features = 0;
+#if defined(LAB2_X86) && defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 0);
+    const int maxLeaf = regs[0];
+    __cpuid(regs, 1);
+    if (regs[2] & (1 << 19)) features |= CpuSse41;
+    const bool osxsave = regs[2] & (1 << 27);
+    if (!osxsave || maxLeaf < 7) {
+        return features;
+    }
+    const unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(regs, 7, 0);
+    if ((xcr0 & 0x6) == 0x6 && (regs[1] & (1 << 5))) features |= CpuAvx2;
+    if ((xcr0 & 0xe6) == 0xe6 && (regs[1] & (1 << 16)) && (regs[1] & (1 << 30))) {
+        features |= CpuAvx512;
+        if (regs[2] & (1 << 1)) features |= CpuAvx512Vbmi;
+    }
+#elif defined(LAB2_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) features |= CpuSse41;
+    if (__builtin_cpu_supports("avx2")) features |= CpuAvx2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        features |= CpuAvx512;
+        if (__builtin_cpu_supports("avx512vbmi")) features |= CpuAvx512Vbmi;
+    }
+#endif
+    return features;
+}
+
+// Все наборы ядер, доступные на этом процессоре, от самого быстрого до скалярного.
+static QList<const PixelKernels*> supportedPixelKernels() {
+    QList<const PixelKernels*> sets;
+#ifdef LAB2_X86
+    const int features = detectCpuFeatures();
+    if (features & CpuAvx512Vbmi) sets.append(&avx512VbmiKernels);
+    if (features & CpuAvx512) sets.append(&avx512Kernels);
+    if (features & CpuAvx2) sets.append(&avx2Kernels);
+    if (features & CpuSse41) sets.append(&sse41Kernels);
+#endif
+    sets.append(&scalarKernels);
+    return sets;
+}
+
+// Набор выбирается один раз по CPUID и дальше используется всеми фильтрами.
+static const PixelKernels &pixelKernels() {
+    static const PixelKernels *selected = supportedPixelKernels().first();
+    return *selected;
+}
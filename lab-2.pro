@@ -3,6 +3,14 @@ TEMPLATE = app
 TARGET = lab-2
 INCLUDEPATH +=
 SOURCES += main.cpp
+# zlib для параллельного сжатия PNG (encoders.cpp)
+LIBS += -lz
+# libjpeg для чтения больших JPEG полосами (tiled.cpp)
+LIBS += -ljpeg
+
+# SIMD-ядра из kernels.cpp обязаны совпадать со скалярными побитово,
+# поэтому умножение со сложением нельзя сливать в FMA.
+*-g++*|*clang*: QMAKE_CXXFLAGS += -ffp-contract=off
 
 macx {
     QT -= opengl
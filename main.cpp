@@ -5,9 +5,108 @@
 #include <cstdlib>
 #include <memory>
 #include "src.cpp"
+#include "viewfinder.cpp"
+#include "burst.cpp"
+#include "tiled.cpp"
+#include "batch.cpp"
+
+// Следит за задачами сохранения: общий прогресс — в bar, cancel отменяет все
+// задачи (как и закрытие owner), после последней вызывается
+// finished(failures, canceled).
+static void watchExportTasks(QObject *owner, const QList<QFuture<bool>> &tasks, QProgressBar *bar, QPushButton *cancel,
+                             const std::function<void(int failures, int canceled)> &finished) {
+    const int totalTasks = tasks.size();
+    auto completed = std::make_shared<int>(0);
+    auto failures = std::make_shared<int>(0);
+    auto canceled = std::make_shared<int>(0);
+    auto fractions = std::make_shared<QVector<double>>(totalTasks, 0.0);
+
+    QPointer<QProgressBar> barPtr(bar);
+    QPointer<QPushButton> cancelPtr(cancel);
+    auto updateBar = [barPtr, fractions]() {
+        if (!barPtr) {
+            return;
+        }
+        double sum = 0.0;
+        for (double fraction : *fractions) {
+            sum += fraction;
+        }
+        barPtr->setValue(int(1000.0 * sum / fractions->size()));
+    };
+
+    bar->setRange(0, 1000);
+    bar->setValue(0);
+    bar->show();
+    cancel->setEnabled(true);
+    cancel->show();
+
+    auto cancelAll = [tasks]() {
+        for (QFuture<bool> task : tasks) {
+            task.cancel();
+        }
+    };
+    auto cancelConnection = std::make_shared<QMetaObject::Connection>(
+        QObject::connect(cancel, &QPushButton::clicked, owner, [cancelPtr, cancelAll]() {
+            if (cancelPtr) {
+                cancelPtr->setEnabled(false);
+            }
+            cancelAll();
+        }));
+    auto destroyConnection = std::make_shared<QMetaObject::Connection>(QObject::connect(owner, &QObject::destroyed, cancelAll));
+
+    for (int i = 0; i < totalTasks; ++i) {
+        auto *watcher = new QFutureWatcher<bool>(owner);
+        QObject::connect(watcher, &QFutureWatcher<bool>::progressValueChanged, owner, [watcher, fractions, updateBar, i](int value) {
+            const int minimum = watcher->progressMinimum();
+            const int maximum = watcher->progressMaximum();
+            if (maximum > minimum) {
+                (*fractions)[i] = double(value - minimum) / (maximum - minimum);
+                updateBar();
+            }
+        });
+        QObject::connect(watcher, &QFutureWatcher<bool>::finished, owner,
+                         [watcher, fractions, updateBar, i, completed, failures, canceled, totalTasks, barPtr, cancelPtr,
+                          cancelConnection, destroyConnection, finished]() {
+            if (watcher->isCanceled()) {
+                ++(*canceled);
+            } else if (!watcher->future().result()) {
+                ++(*failures);
+            }
+            watcher->deleteLater();
+            (*fractions)[i] = 1.0;
+            updateBar();
+
+            if (++(*completed) == totalTasks) {
+                QObject::disconnect(*cancelConnection);
+                QObject::disconnect(*destroyConnection);
+                if (barPtr) {
+                    barPtr->hide();
+                }
+                if (cancelPtr) {
+                    cancelPtr->hide();
+                }
+                finished(*failures, *canceled);
+            }
+        });
+        watcher->setFuture(tasks.at(i));
+    }
+}
 
 int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--selftest") == 0) {
+            const bool kernelsOk = selfTestFilterKernels();
+            const bool chainsOk = selfTestFilterChains();
+            const bool tiledOk = selfTestTiled();
+            return kernelsOk && chainsOk && tiledOk ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if (qstrcmp(argv[i], "--batch") == 0) {
+            return runBatch(argc, argv);
+        }
+    }
+
     QApplication app(argc, argv);
+    const QString tracePath = startTracingFromEnvironment();
     QWidget *w = new QWidget();
     w->resize(800, 600);
 
@@ -25,6 +124,7 @@ int main(int argc, char* argv[]) {
     camera->setViewfinder(viewfinder);
 
     QCameraImageCapture *imageCapture = new QCameraImageCapture(camera);
+    auto captureRequested = std::make_shared<qint64>(-1); // traceMark() нажатия «Снимок»
     QMediaRecorder *mediaRecorder = new QMediaRecorder(camera);
     camera->setCaptureMode(QCamera::CaptureStillImage);
     camera->start();
@@ -37,17 +137,13 @@ int main(int argc, char* argv[]) {
     QVBoxLayout *vb = new QVBoxLayout();
     QList<QString> filters;
 
-    auto *btn1 = new QCheckBox("Без фильтра");
-    auto *btn2 = new QCheckBox("ЧБ");
-    auto *btn3 = new QCheckBox("Сепия");
-    auto *btn4 = new QCheckBox("Негатив");
-    auto *btn5 = new QCheckBox("Постеризация");
-    auto *btn6 = new QCheckBox("Соляризация");
-    auto *btn7 = new QCheckBox("Холодный");
-    auto *btn8 = new QCheckBox("Теплый");
-    auto *btn9 = new QCheckBox("Винтаж");
     auto *shelk = new QPushButton("Снимок");
     auto *recordButton = new QPushButton("Видео");
+    auto *burstButton = new QPushButton(QStringLiteral("Серия"));
+    auto *burstCount = new QSpinBox();
+    burstCount->setRange(2, burstMaxFrames);
+    burstCount->setValue(burstDefaultFrames);
+    burstCount->setSuffix(QStringLiteral(" кадров"));
 
     auto registerFilterToggle = [&filters](QCheckBox *box, const QString &code) {
         QObject::connect(box, &QCheckBox::toggled, [code, &filters](bool checked) {
@@ -61,21 +157,125 @@ int main(int argc, char* argv[]) {
         });
     };
 
-    registerFilterToggle(btn1, QStringLiteral("бф"));
-    registerFilterToggle(btn2, QStringLiteral("чб"));
-    registerFilterToggle(btn3, QStringLiteral("сеп"));
-    registerFilterToggle(btn4, QStringLiteral("нег"));
-    registerFilterToggle(btn5, QStringLiteral("пос"));
-    registerFilterToggle(btn6, QStringLiteral("сол"));
-    registerFilterToggle(btn7, QStringLiteral("хол"));
-    registerFilterToggle(btn8, QStringLiteral("теп"));
-    registerFilterToggle(btn9, QStringLiteral("вин"));
+    // по чекбоксу на каждый зарегистрированный фильтр, в порядке регистрации;
+    // сохранённые цепочки регистрируются последними
+    loadFilterChains();
+    QList<QCheckBox*> filterBoxes;
+    for (const FilterSpec *spec : registeredFilters()) {
+        auto *box = new QCheckBox(spec->title.isEmpty() ? spec->code : spec->title);
+        registerFilterToggle(box, spec->code);
+        filterBoxes.append(box);
+    }
+
+    // живой предпросмотр: камера переключается с QCameraViewfinder на свою
+    // поверхность, которая показывает кадры с последним отмеченным фильтром
+    auto *liveBox = new QCheckBox(QStringLiteral("Фильтр в видоискателе"));
+    auto *liveView = new QLabel(w);
+    liveView->setAlignment(Qt::AlignCenter);
+    liveView->setMinimumSize(320, 180);
+    liveView->hide();
+    auto *fpsLabel = new QLabel(w);
+    fpsLabel->hide();
+    auto *liveSurface = new LiveFilterSurface(liveView, [&filters]() {
+        return filters.isEmpty() ? QString() : filters.last();
+    }, [fpsLabel](double fps, int dropped) {
+        fpsLabel->setText(QStringLiteral("%1 fps, пропущено %2").arg(fps, 0, 'f', 1).arg(dropped));
+    }, w);
+    QObject::connect(liveBox, &QCheckBox::toggled, w, [camera, viewfinder, liveView, fpsLabel, liveSurface](bool live) {
+        camera->stop();
+        if (live) {
+            camera->setViewfinder(liveSurface);
+        } else {
+            camera->setViewfinder(viewfinder);
+        }
+        viewfinder->setVisible(!live);
+        liveView->setVisible(live);
+        fpsLabel->setVisible(live);
+        camera->start();
+    });
 
 
-    QObject::connect(shelk, &QPushButton::clicked, [imageCapture](bool) {
+    QObject::connect(shelk, &QPushButton::clicked, [imageCapture, captureRequested](bool) {
+        *captureRequested = traceMark();
         imageCapture->capture();
 
     });
+    // серия берёт кадры видоискателя через QVideoProbe, не мешая показу
+    auto burst = std::make_shared<BurstCapture>();
+    auto burstRestore = std::make_shared<QCameraViewfinderSettings>(); // настройки до серии
+    auto *burstProbe = new QVideoProbe(w);
+    if (!burstProbe->setSource(camera)) {
+        burstButton->setEnabled(false);
+        burstCount->setEnabled(false);
+        burstButton->setToolTip(QStringLiteral("Камера не отдаёт кадры видоискателя"));
+    }
+    auto finishBurstCapture = [camera, burstRestore, recordButton, liveBox]() {
+        if (!burstRestore->isNull()) {
+            camera->stop();
+            camera->setViewfinderSettings(*burstRestore);
+            camera->start();
+            *burstRestore = QCameraViewfinderSettings();
+        }
+        recordButton->setEnabled(true);
+        liveBox->setEnabled(true);
+    };
+    QObject::connect(burstProbe, &QVideoProbe::videoFrameProbed, w, [burst, finishBurstCapture](const QVideoFrame &frame) {
+        if (!burst->active()) {
+            return;
+        }
+        burst->offer(frame);
+        if (!burst->active()) {
+            finishBurstCapture(); // последний кадр серии снят, дальше только запись
+        }
+    });
+    QObject::connect(burstButton, &QPushButton::clicked, w, [w, camera, burst, burstRestore, burstButton, burstCount, recordButton,
+                                                            liveBox, recordingActive, finishBurstCapture, &filters]() {
+        if (burst->active() || *recordingActive) {
+            return;
+        }
+        const QString directory = QFileDialog::getExistingDirectory(w, QStringLiteral("Выберите папку для серии"));
+        if (directory.isEmpty()) {
+            return;
+        }
+
+        // камера переключается до серии: кадры со старыми настройками в неё не попадут,
+        // а кольцо сразу готовится под новое разрешение
+        const QCameraViewfinderSettings current = camera->viewfinderSettings();
+        const QCameraViewfinderSettings settings = burstViewfinderSettings(camera);
+        if (settings.resolution() != current.resolution() || settings.maximumFrameRate() != current.maximumFrameRate()) {
+            *burstRestore = current;
+            camera->stop();
+            camera->setViewfinderSettings(settings);
+            camera->start();
+        }
+
+        QPointer<QPushButton> buttonPtr(burstButton);
+        const bool started = burst->start(burstCount->value(), settings.resolution(), filters, directory,
+                                          [w, buttonPtr](const BurstResult &result) {
+            if (buttonPtr) {
+                buttonPtr->setEnabled(true);
+            }
+            const double seconds = qMax<qint64>(1, result.captureMs) / 1000.0;
+            QMessageBox::information(w, QStringLiteral("Серия"),
+                                     QStringLiteral("Снято %1 из %2 кадров (%3 кадр/с), пропущено %4.\n"
+                                                    "Записано файлов: %5, ошибок: %6, всего %7 с.")
+                                         .arg(result.grabbed)
+                                         .arg(result.requested)
+                                         .arg(result.grabbed / seconds, 0, 'f', 1)
+                                         .arg(result.dropped)
+                                         .arg(result.written)
+                                         .arg(result.failed)
+                                         .arg(result.totalMs / 1000.0, 0, 'f', 1));
+        });
+        if (!started) {
+            finishBurstCapture(); // вернуть прежние настройки видоискателя
+            return;
+        }
+        burstButton->setEnabled(false);
+        recordButton->setEnabled(false); // запись и переключение видоискателя перезапускают камеру
+        liveBox->setEnabled(false);
+    });
+
     QObject::connect(recordButton, &QPushButton::clicked, w, [camera, mediaRecorder, recordButton, recordingActive, lastRecordedVideoPath]() {
         if (!recordButton) {
             return;
@@ -129,14 +329,20 @@ int main(int argc, char* argv[]) {
         auto *controls = new QHBoxLayout();
         auto *replayButton = new QPushButton(QStringLiteral("Повтор"), dialog);
         auto *saveButton = new QPushButton(QStringLiteral("Сохранить"), dialog);
+        auto *progressBar = new QProgressBar(dialog);
+        auto *cancelButton = new QPushButton(QStringLiteral("Отмена"), dialog);
+        progressBar->hide();
+        cancelButton->hide();
         controls->addWidget(replayButton);
         controls->addStretch();
+        controls->addWidget(progressBar);
+        controls->addWidget(cancelButton);
         controls->addWidget(saveButton);
         layout->addLayout(controls);
 
         QObject::connect(replayButton, &QPushButton::clicked, player, &QMediaPlayer::play);
 
-        QObject::connect(saveButton, &QPushButton::clicked, dialog, [dialog, saveButton, videoPath, &filters]() {
+        QObject::connect(saveButton, &QPushButton::clicked, dialog, [dialog, saveButton, progressBar, cancelButton, videoPath, &filters]() {
             QList<QString> selectedFilters = filters;
             selectedFilters.removeDuplicates();
             if (selectedFilters.isEmpty()) {
@@ -158,41 +364,28 @@ int main(int argc, char* argv[]) {
             QPointer<QPushButton> savePtr(saveButton);
             saveButton->setEnabled(false);
 
-            auto completed = std::make_shared<int>(0);
-            auto failures = std::make_shared<int>(0);
             const int totalTasks = tasks.size();
+            watchExportTasks(dialog, tasks, progressBar, cancelButton, [dialog, savePtr, totalTasks](int failures, int canceled) {
+                if (savePtr) {
+                    savePtr->setEnabled(true);
+                }
 
-            for (const auto &task : tasks) {
-                auto *watcher = new QFutureWatcher<bool>(dialog);
-                QObject::connect(watcher, &QFutureWatcher<bool>::finished, dialog, [dialog, savePtr, completed, failures, totalTasks, watcher]() {
-                    const bool ok = !watcher->isCanceled() && watcher->future().result();
-                    watcher->deleteLater();
-                    if (!ok) {
-                        ++(*failures);
-                    }
-
-                    if (++(*completed) == totalTasks) {
-                        if (savePtr) {
-                            savePtr->setEnabled(true);
-                        }
-
-                        if (*failures == 0) {
-                            QMessageBox::information(dialog, QStringLiteral("Готово"), QStringLiteral("Отфильтрованные видео сохранены."));
-                        } else if (*failures == totalTasks) {
-                            QMessageBox::critical(dialog, QStringLiteral("Ошибка"), QStringLiteral("Не удалось сохранить выбранные видео."));
-                        } else {
-                            QMessageBox::warning(dialog, QStringLiteral("Частично сохранено"), QStringLiteral("Часть видео сохранить не удалось."));
-                        }
-                    }
-                });
-                watcher->setFuture(task);
-            }
+                if (canceled == totalTasks) {
+                    QMessageBox::information(dialog, QStringLiteral("Отменено"), QStringLiteral("Сохранение видео отменено."));
+                } else if (failures == 0 && canceled == 0) {
+                    QMessageBox::information(dialog, QStringLiteral("Готово"), QStringLiteral("Отфильтрованные видео сохранены."));
+                } else if (failures == totalTasks - canceled) {
+                    QMessageBox::critical(dialog, QStringLiteral("Ошибка"), QStringLiteral("Не удалось сохранить выбранные видео."));
+                } else {
+                    QMessageBox::warning(dialog, QStringLiteral("Частично сохранено"), QStringLiteral("Часть видео не сохранена."));
+                }
+            });
         });
 
         dialog->show();
     };
 
-    QObject::connect(mediaRecorder, &QMediaRecorder::stateChanged, w, [camera, recordButton, recordingActive, lastRecordedVideoPath, showVideoDialog](QMediaRecorder::State state) {
+    QObject::connect(mediaRecorder, &QMediaRecorder::stateChanged, w, [camera, recordButton, liveBox, recordingActive, lastRecordedVideoPath, showVideoDialog](QMediaRecorder::State state) {
         if (!recordButton) {
             return;
         }
@@ -200,12 +393,14 @@ int main(int argc, char* argv[]) {
         switch (state) {
         case QMediaRecorder::RecordingState:
             *recordingActive = true;
+            liveBox->setEnabled(false); // переключение видоискателя перезапускает камеру
             recordButton->setEnabled(true);
             recordButton->setText(QStringLiteral("Стоп"));
             break;
         case QMediaRecorder::StoppedState: {
             const bool wasRecording = *recordingActive;
             *recordingActive = false;
+            liveBox->setEnabled(true);
             recordButton->setEnabled(true);
             recordButton->setText(QStringLiteral("Видео"));
             camera->setCaptureMode(QCamera::CaptureStillImage);
@@ -232,15 +427,54 @@ int main(int argc, char* argv[]) {
     });
 
     auto type = std::make_shared<QString>("бф");
-    QObject::connect(imageCapture, &QCameraImageCapture::imageSaved, [w, &filters, type](int, const QString &tof) {
+    auto showCapture = [w, &filters, type](const QImage &captured) {
         QWidget *w2 = new QWidget();
         QVBoxLayout *mn = new QVBoxLayout(w2);
         QHBoxLayout *hblt = new QHBoxLayout();
         auto *save = new QPushButton("Сохранить");
+        // формат файлов выбирается на каждое сохранение
+        auto *formatBox = new QComboBox();
+        const QList<QPair<QString, ImageEncodeOptions>> presets = imageEncodePresets();
+        for (const auto &preset : presets) {
+            formatBox->addItem(preset.first);
+        }
+        // уровень сжатия и фильтр строк PNG; пресет PNG выставляет свои, их можно поменять
+        auto *pngLevelBox = new QSpinBox();
+        pngLevelBox->setRange(0, 9);
+        pngLevelBox->setPrefix(QStringLiteral("Сжатие PNG: "));
+        auto *pngFilterBox = new QComboBox();
+        const QList<QPair<QString, PngFilter>> pngFilters = pngFilterNames();
+        for (const auto &filter : pngFilters) {
+            pngFilterBox->addItem(QStringLiteral("Фильтр строк: %1").arg(filter.first));
+        }
+        auto showPreset = [presets, pngFilters, pngLevelBox, pngFilterBox](int index) {
+            const ImageEncodeOptions preset = presets.value(index, presets.first()).second;
+            const bool png = preset.format == ImageFormat::Png;
+            pngLevelBox->setEnabled(png);
+            pngFilterBox->setEnabled(png);
+            if (!png) {
+                return;
+            }
+            pngLevelBox->setValue(preset.pngLevel);
+            for (int i = 0; i < pngFilters.size(); ++i) {
+                if (pngFilters.at(i).second == preset.pngFilter) {
+                    pngFilterBox->setCurrentIndex(i);
+                }
+            }
+        };
+        showPreset(formatBox->currentIndex());
+        QObject::connect(formatBox, QOverload<int>::of(&QComboBox::currentIndexChanged), showPreset);
+        auto *progressBar = new QProgressBar();
+        auto *cancelButton = new QPushButton(QStringLiteral("Отмена"));
+        progressBar->hide();
+        cancelButton->hide();
         QLabel *lbl = new QLabel();
-        QImage *img = new QImage(tof);
-        setpic(img, lbl, *type);
-        QObject::connect(save, &QPushButton::clicked, [w, w2, save, img, &filters]() {
+        // снимок живёт, пока открыто его окно: его держат только обработчики кнопок
+        auto img = std::make_shared<QImage>(captured);
+        setpic(img.get(), lbl, *type);
+        prefetchPreviews(*img, filters);
+        QObject::connect(save, &QPushButton::clicked, [w, w2, save, formatBox, presets, pngLevelBox, pngFilterBox, pngFilters,
+                                                       progressBar, cancelButton, img, &filters]() {
             if (!img || img->isNull()) {
                 QMessageBox::warning(w2, QStringLiteral("Нет данных"), QStringLiteral("Нет снимка для сохранения."));
                 return;
@@ -258,7 +492,12 @@ int main(int argc, char* argv[]) {
                 return;
             }
 
-            const QList<QFuture<bool>> tasks = saveFilteredImages(*img, selectedFilters, directory);
+            ImageEncodeOptions encoding = presets.value(formatBox->currentIndex(), presets.first()).second;
+            if (encoding.format == ImageFormat::Png) {
+                encoding.pngLevel = pngLevelBox->value();
+                encoding.pngFilter = pngFilters.value(pngFilterBox->currentIndex(), pngFilters.first()).second;
+            }
+            const QList<QFuture<bool>> tasks = saveFilteredImages(*img, selectedFilters, directory, encoding);
             if (tasks.isEmpty()) {
                 QMessageBox::information(w2, QStringLiteral("Нечего сохранять"), QStringLiteral("Не удалось подготовить изображения для сохранения."));
                 return;
@@ -267,34 +506,22 @@ int main(int argc, char* argv[]) {
             QPointer<QPushButton> saveButton(save);
             save->setEnabled(false);
 
-            auto completed = std::make_shared<int>(0);
-            auto failures = std::make_shared<int>(0);
             const int totalTasks = tasks.size();
-
-            for (const auto &task : tasks) {
-                auto *watcher = new QFutureWatcher<bool>(w);
-                QObject::connect(watcher, &QFutureWatcher<bool>::finished, w, [w, saveButton, completed, failures, totalTasks, watcher]() {
-                    const bool ok = !watcher->isCanceled() && watcher->future().result();
-                    if (!ok) {
-                        ++(*failures);
-                    }
-
-                    watcher->deleteLater();
-                    if (++(*completed) == totalTasks) {
-                        if (saveButton) {
-                            saveButton->setEnabled(true);
-                        }
-                        if (*failures == 0) {
-                            QMessageBox::information(w, QStringLiteral("Готово"), QStringLiteral("Выбранные изображения сохранены."));
-                        } else if (*failures == totalTasks) {
-                            QMessageBox::critical(w, QStringLiteral("Ошибка"), QStringLiteral("Не удалось сохранить выбранные изображения."));
-                        } else {
-                            QMessageBox::warning(w, QStringLiteral("Частично сохранено"), QStringLiteral("Часть изображений сохранить не удалось."));
-                        }
-                    }
-                });
-                watcher->setFuture(task);
-            }
+            // сохранение продолжается и после закрытия окна снимка
+            watchExportTasks(w, tasks, progressBar, cancelButton, [w, saveButton, totalTasks](int failures, int canceled) {
+                if (saveButton) {
+                    saveButton->setEnabled(true);
+                }
+                if (canceled == totalTasks) {
+                    QMessageBox::information(w, QStringLiteral("Отменено"), QStringLiteral("Сохранение изображений отменено."));
+                } else if (failures == 0 && canceled == 0) {
+                    QMessageBox::information(w, QStringLiteral("Готово"), QStringLiteral("Выбранные изображения сохранены."));
+                } else if (failures == totalTasks - canceled) {
+                    QMessageBox::critical(w, QStringLiteral("Ошибка"), QStringLiteral("Не удалось сохранить выбранные изображения."));
+                } else {
+                    QMessageBox::warning(w, QStringLiteral("Частично сохранено"), QStringLiteral("Часть изображений не сохранена."));
+                }
+            });
         });
 
         auto *right_btn = new QPushButton("->");
@@ -313,7 +540,8 @@ int main(int argc, char* argv[]) {
             }
 
             *type = filters[currentIndex];
-            setpic(img, lbl, *type);
+            setpic(img.get(), lbl, *type);
+            prefetchPreviews(*img, filters); // отметки могли измениться; готовые берутся из кэша
         });
 
 
@@ -322,31 +550,121 @@ int main(int argc, char* argv[]) {
         hblt -> addWidget(lbl);
         hblt -> addStretch();
         mn -> addLayout(hblt);
+        mn -> addWidget(formatBox);
+        QHBoxLayout *pngOptions = new QHBoxLayout();
+        pngOptions -> addWidget(pngLevelBox);
+        pngOptions -> addWidget(pngFilterBox);
+        mn -> addLayout(pngOptions);
+        mn -> addWidget(progressBar);
+        mn -> addWidget(cancelButton);
         mn -> addWidget(save);
 
-        w2 -> setWindowTitle("Файл сохранен");
-        w2->setFixedSize(740, 450);
+        w2->setAttribute(Qt::WA_DeleteOnClose);
+        w2 -> setWindowTitle("Снимок");
+        w2->setFixedSize(740, 480);
         w2 -> setLayout(mn);
         w2->show();
-    });
+    };
+
+    // снимок берётся прямо из памяти камеры, без записи JPEG на диск и повторного
+    // чтения; на диск попадает только то, что сохранит пользователь. Если бэкенд
+    // так не умеет — по-старому, через сохранённый камерой файл.
+    if (imageCapture->isCaptureDestinationSupported(QCameraImageCapture::CaptureToBuffer)) {
+        imageCapture->setCaptureDestination(QCameraImageCapture::CaptureToBuffer);
+        const QList<QVideoFrame::PixelFormat> bufferFormats = imageCapture->supportedBufferFormats();
+        for (QVideoFrame::PixelFormat format : {QVideoFrame::Format_ARGB32, QVideoFrame::Format_RGB32}) {
+            if (bufferFormats.contains(format)) {
+                imageCapture->setBufferFormat(format); // несжатый кадр: нет даже JPEG в памяти
+                break;
+            }
+        }
+        QObject::connect(imageCapture, &QCameraImageCapture::imageAvailable, w, [showCapture, captureRequested](int, const QVideoFrame &frame) {
+            traceSince("capture.latency", *captureRequested);
+            QImage captured;
+            {
+                TraceScope scope("capture.frame_copy");
+                captured = imageFromVideoFrame(frame);
+            }
+            if (captured.isNull()) {
+                qWarning() << "Не удалось прочитать снимок из буфера камеры";
+                return;
+            }
+            showCapture(captured);
+        });
+    } else {
+        QObject::connect(imageCapture, &QCameraImageCapture::imageSaved, w, [showCapture, captureRequested](int, const QString &tof) {
+            traceSince("capture.latency", *captureRequested);
+            QImage captured;
+            {
+                TraceScope scope("capture.decode", tof);
+                captured = QImage(tof);
+            }
+            showCapture(captured);
+        });
+    }
 
     vb->addStretch(0);
-    vb->addWidget(btn1);
-    vb->addWidget(btn2);
-    vb->addWidget(btn3);
-    vb->addWidget(btn4);
-    vb->addWidget(btn5);
-    vb->addWidget(btn6);
-    vb->addWidget(btn7);
-    vb->addWidget(btn8);
-    vb->addWidget(btn9);
+    for (QCheckBox *box : filterBoxes) {
+        vb->addWidget(box);
+    }
+    // новая цепочка: выражение из кодов фильтров и имя; чекбокс появляется
+    // над кнопкой, цепочка сохраняется в настройках
+    auto *chainButton = new QPushButton(QStringLiteral("Цепочка…"));
+    QObject::connect(chainButton, &QPushButton::clicked, w, [w, vb, chainButton, registerFilterToggle]() {
+        QStringList codes;
+        QStringList taken;
+        for (const FilterSpec *spec : registeredFilters()) {
+            if (spec->id < FilterId::Chain) {
+                codes << spec->code;
+            }
+            taken << spec->code;
+        }
+        bool accepted = false;
+        const QString expression = QInputDialog::getText(
+            w, QStringLiteral("Цепочка фильтров"),
+            QStringLiteral("Фильтры через «+», параметры через «:»,\nнапример теп+пос:4+вгн. Коды: %1").arg(codes.join(QStringLiteral(", "))),
+            QLineEdit::Normal, QString(), &accepted).trimmed();
+        if (!accepted || expression.isEmpty()) {
+            return;
+        }
+        const QString name = QInputDialog::getText(w, QStringLiteral("Цепочка фильтров"), QStringLiteral("Название:"),
+                                                   QLineEdit::Normal, expression, &accepted).trimmed();
+        if (!accepted || name.isEmpty()) {
+            return;
+        }
+        if (taken.contains(name)) {
+            QMessageBox::warning(w, QStringLiteral("Цепочка фильтров"), QStringLiteral("Имя «%1» уже занято.").arg(name));
+            return;
+        }
+        QString error;
+        const FilterSpec *spec = registerFilterChain(name, name, expression, &error);
+        if (!spec) {
+            QMessageBox::warning(w, QStringLiteral("Цепочка фильтров"), QStringLiteral("Цепочка не создана: %1.").arg(error));
+            return;
+        }
+        saveFilterChain(name, expression);
+        auto *box = new QCheckBox(spec->title);
+        registerFilterToggle(box, spec->code);
+        vb->insertWidget(vb->indexOf(chainButton), box);
+        box->setChecked(true);
+    });
+    vb->addWidget(chainButton);
+    vb->addWidget(liveBox);
+    vb->addWidget(fpsLabel);
     vb->addStretch(0);
 
     mn->addWidget(viewfinder, 0, 0);
+    mn->addWidget(liveView, 0, 0);
     mn->addLayout(vb, 0, 1);
     mn->addWidget(shelk, 1, 0);
     mn->addWidget(recordButton, 1, 1);
+    auto *burstRow = new QHBoxLayout();
+    burstRow->addWidget(burstButton, 1);
+    burstRow->addWidget(burstCount);
+    mn->addLayout(burstRow, 2, 0, 1, 2);
 
     w->setLayout(mn);
-    return app.exec();
+    const int status = app.exec();
+    finishTracing(tracePath);
+    return status;
 }
@@ -0,0 +1,152 @@
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Параллельный проход по строкам изображения. Строки режутся на полосы, а
+// полосы разбираются потоками из общего счётчика: кто освободился, тот берёт
+// следующую, поэтому медленная полоса не задерживает остальные. Вызывающий
+// поток работает наравне с помощниками. Помощники ставятся в тот же
+// QThreadPool::globalInstance(), что и задачи QtConcurrent, так что вложенный
+// вызов (задача сохранения -> полосы фильтра) не плодит лишних потоков: если
+// пул занят, всю работу сделает сам вызывающий поток, а опоздавшие помощники
+// найдут счётчик исчерпанным и сразу выйдут.
+
+// Полоса не меньше ~16К пикселей, иначе накладные расходы съедают выигрыш.
+static const int parallelMinBandPixels = 16 * 1024;
+// Полос в несколько раз больше, чем потоков, — для балансировки нагрузки.
+static const int parallelBandsPerThread = 4;
+
+// Пул, куда ставятся помощники из текущего потока. По умолчанию общий; задачи
+// со своим пулом (экспорт видео) переключают его через ParallelPoolScope, чтобы
+// их вложенные полосы не занимали общий пул.
+static QThreadPool *&parallelPoolOverride() {
+    static thread_local QThreadPool *pool = nullptr;
+    return pool;
+}
+
+static QThreadPool *parallelPool() {
+    QThreadPool *pool = parallelPoolOverride();
+    return pool ? pool : QThreadPool::globalInstance();
+}
+
+struct ParallelPoolScope {
+    explicit ParallelPoolScope(QThreadPool *pool) : previous(parallelPoolOverride()) {
+        parallelPoolOverride() = pool;
+    }
+    ~ParallelPoolScope() {
+        parallelPoolOverride() = previous;
+    }
+
+    QThreadPool *previous;
+};
+
+struct ParallelState {
+    std::function<void(int index)> body;
+    int count = 0;
+    QThreadPool *pool = nullptr;
+    std::atomic<int> next{0};
+
+    QMutex mutex;
+    QWaitCondition idle;
+    int running = 0;
+
+    void drain() {
+        for (;;) {
+            const int index = next.fetch_add(1);
+            if (index >= count) {
+                return;
+            }
+            body(index);
+        }
+    }
+};
+
+class ParallelHelper : public QRunnable {
+public:
+    explicit ParallelHelper(std::shared_ptr<ParallelState> state) : state(std::move(state)), queued(traceMark()) {}
+
+    void run() override {
+        traceSince("pool.wait", queued);
+        {
+            QMutexLocker locker(&state->mutex);
+            if (state->next.load() >= state->count) {
+                return;
+            }
+            ++state->running;
+        }
+        ParallelPoolScope scope(state->pool); // вложенные вызовы остаются в том же пуле
+        state->drain();
+        QMutexLocker locker(&state->mutex);
+        if (--state->running == 0) {
+            state->idle.wakeAll();
+        }
+    }
+
+private:
+    std::shared_ptr<ParallelState> state;
+    qint64 queued; // для замера ожидания в очереди пула
+};
+
+static int parallelThreadCount() {
+    return qMax(1, parallelPool()->maxThreadCount());
+}
+
+// body(i) вызывается ровно один раз для каждого i из [0, count), не более чем
+// из maxWorkers потоков сразу. Индексы выдаются строго по возрастанию, и поток
+// берёт индекс только когда готов его выполнять, поэтому body(i) может ждать
+// результатов body(j) при j < i — такой индекс уже кем-то выполняется.
+static void parallelForIndices(int count, int maxWorkers, const std::function<void(int index)> &body) {
+    if (count <= 0) {
+        return;
+    }
+
+    const int workers = qMin(count, qMin(qMax(1, maxWorkers), parallelThreadCount()));
+    if (workers == 1) {
+        for (int i = 0; i < count; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    auto state = std::make_shared<ParallelState>();
+    state->body = body;
+    state->count = count;
+    state->pool = parallelPool();
+
+    QThreadPool *pool = state->pool;
+    for (int i = 0; i < workers - 1; ++i) {
+        pool->start(new ParallelHelper(state));
+    }
+
+    state->drain();
+
+    // все индексы разобраны; ждём только тех помощников, что ещё дорабатывают свой
+    QMutexLocker locker(&state->mutex);
+    while (state->running > 0) {
+        state->idle.wait(&state->mutex);
+    }
+}
+
+// body(y0, y1) вызывается для непересекающихся диапазонов строк [y0, y1),
+// вместе покрывающих [0, height). Возвращается после обработки всех строк.
+static void parallelForRows(int height, int width, const std::function<void(int y0, int y1)> &body) {
+    if (height <= 0) {
+        return;
+    }
+
+    const int threads = parallelThreadCount();
+    const int minRows = qMax(1, (parallelMinBandPixels + qMax(1, width) - 1) / qMax(1, width));
+    const int targetBands = threads * parallelBandsPerThread;
+    const int bandRows = qMax(minRows, (height + targetBands - 1) / targetBands);
+    const int bandCount = (height + bandRows - 1) / bandRows;
+
+    parallelForIndices(bandCount, threads, [&](int band) {
+        const int y0 = band * bandRows;
+        body(y0, qMin(height, y0 + bandRows));
+    });
+}
@@ -0,0 +1,168 @@
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QList>
+#include <QMetaObject>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Очередь экспорта видео. Каждый процесс-кодировщик (libx264) сам запускает
+// столько потоков, сколько ядер, поэтому несколько одновременных экспортов
+// забивают процессор в разы. Планировщик ограничивает число одновременно
+// работающих кодировщиков, выдаёт каждому -threads из общего бюджета ядер, а
+// работу видео на нашей стороне (перекачку кадров и фильтры) держит в своём
+// пуле. Общий QThreadPool остаётся свободным для сохранения снимков, поэтому
+// они не стоят в очереди за многоминутным роликом.
+
+// Ожидания внешних процессов режутся на отрезки такой длины, между которыми
+// проверяется отмена, — отменённый экспорт освобождает ядра за миллисекунды.
+static const int exportPollMs = 20;
+
+struct ExportJob {
+    int encoders = 1; // сколько процессов-кодировщиков займёт задача
+    // Запускается в потоке приложения. Задача не блокирует его: ждёт процессы
+    // по сигналам или уходит в exportPool(). done() вызывается ровно один раз,
+    // из любого потока.
+    std::function<void(int threadsPerEncoder, const std::function<void()> &done)> start;
+    qint64 queued = -1; // traceMark() при постановке в очередь
+};
+
+struct ExportScheduler {
+    QMutex mutex;
+    QList<ExportJob> queue;
+    int runningEncoders = 0;
+    int runningJobs = 0;
+
+    const int cores = qMax(1, QThread::idealThreadCount());
+    // бюджет: примерно по два потока на кодировщик
+    const int maxEncoders = qMax(1, cores / 2);
+
+    QThreadPool pool;
+
+    ExportScheduler() {
+        pool.setMaxThreadCount(cores);
+    }
+};
+
+static ExportScheduler &exportScheduler() {
+    static ExportScheduler scheduler;
+    return scheduler;
+}
+
+// Пул для работы видеоэкспорта на нашей стороне.
+static QThreadPool *exportPool() {
+    return &exportScheduler().pool;
+}
+
+// Выполнить fn в потоке приложения, где у QProcess работают сигналы.
+static void runInApplicationThread(const std::function<void()> &fn) {
+    QCoreApplication *app = QCoreApplication::instance();
+    if (!app || QThread::currentThread() == app->thread()) {
+        fn();
+        return;
+    }
+    QMetaObject::invokeMethod(app, fn, Qt::QueuedConnection);
+}
+
+static void startQueuedExports() {
+    ExportScheduler &s = exportScheduler();
+    QList<ExportJob> ready;
+    int threads = 1;
+    {
+        QMutexLocker locker(&s.mutex);
+        while (!s.queue.isEmpty()) {
+            const ExportJob &next = s.queue.first();
+            const int encoders = qMax(1, next.encoders);
+            // задача больше всего бюджета запускается, только когда всё остальное закончилось
+            if (s.runningJobs > 0 && s.runningEncoders + encoders > s.maxEncoders) {
+                break;
+            }
+            s.runningEncoders += encoders;
+            ++s.runningJobs;
+            ready.append(s.queue.takeFirst());
+        }
+        // Ядра делятся между кодировщиками, которые реально работают, а не
+        // между всем бюджетом: одинокий экспорт получает все ядра. Уже
+        // запущенные процессы своих потоков не отдают: пока они не закончатся,
+        // следующие задачи немного перегружают процессор.
+        threads = qMax(1, s.cores / qMax(1, s.runningEncoders));
+    }
+
+    for (const ExportJob &job : ready) {
+        const int encoders = qMax(1, job.encoders);
+        traceSince("export.queue_wait", job.queued);
+        runInApplicationThread([job, threads, encoders]() {
+            job.start(threads, [encoders]() {
+                ExportScheduler &s = exportScheduler();
+                {
+                    QMutexLocker locker(&s.mutex);
+                    s.runningEncoders -= encoders;
+                    --s.runningJobs;
+                }
+                startQueuedExports();
+            });
+        });
+    }
+}
+
+static void scheduleExport(ExportJob job) {
+    job.queued = traceMark();
+    {
+        ExportScheduler &s = exportScheduler();
+        QMutexLocker locker(&s.mutex);
+        s.queue.append(job);
+    }
+    startQueuedExports();
+}
+
+// Задача экспорта со своим QFutureInterface: снаружи видны прогресс и отмена
+// через QFuture::cancel(), а body сама решает, где проверять task.isCanceled().
+// Задача, отменённая ещё в очереди пула, не запускается вовсе.
+static QFuture<bool> startExportTask(QThreadPool *pool, const std::function<bool(QFutureInterface<bool> &task)> &body) {
+    QFutureInterface<bool> task;
+    task.reportStarted();
+    const QFuture<bool> future = task.future();
+    const qint64 queued = traceMark();
+    QtConcurrent::run(pool, [task, body, queued]() mutable {
+        traceSince("export.task_wait", queued);
+        if (!task.isCanceled()) {
+            task.reportResult(body(task));
+        }
+        task.reportFinished();
+    });
+    return future;
+}
+
+// Ждёт в потоке приложения, пока закончатся все задачи. Поток не опрашивает
+// их, а крутит цикл событий (запасной путь экспорта ждёт ffmpeg по сигналам
+// QProcess) и выходит по QFutureWatcher::finished последней задачи.
+static void waitForFutures(const QList<QFuture<void>> &futures) {
+    QEventLoop loop;
+    int pending = 0;
+    std::vector<std::unique_ptr<QFutureWatcher<void>>> watchers;
+    for (const QFuture<void> &future : futures) {
+        if (future.isFinished()) {
+            continue;
+        }
+        ++pending;
+        std::unique_ptr<QFutureWatcher<void>> watcher(new QFutureWatcher<void>);
+        // у задачи, закончившейся до setFuture, finished всё равно приходит
+        QObject::connect(watcher.get(), &QFutureWatcher<void>::finished, &loop, [&loop, &pending]() {
+            if (--pending == 0) {
+                loop.quit();
+            }
+        });
+        watcher->setFuture(future);
+        watchers.push_back(std::move(watcher));
+    }
+    if (pending > 0) {
+        loop.exec();
+    }
+}
@@ -5,440 +5,2364 @@
 #include <QHash>
 #include <QList>
 #include <QFile>
+#include <QMutex>
 #include <QProcess>
+#include <QSemaphore>
+#include <QThread>
 #include <QStandardPaths>
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
 #include <random>
 #include <vector>
 
+#include "trace.cpp"
+#include "kernels.cpp"
+#include "parallel.cpp"
+#include "bufferpool.cpp"
+#include "encoders.cpp"
+#include "filters.cpp"
+#include "scheduler.cpp"
+
 static inline int clampInt(int v) { return v < 0 ? 0 : (v > 255 ? 255 : v); }
-static inline int quantizeLUTValue(int v, const std::vector<int> &lut) {
-    return lut[v];
+
+// Построчная обработка ARGB32-изображения полосами на всех ядрах.
+// fn(line, width, y) вызывается из разных потоков для разных строк.
+template <typename RowFn>
+static void parallelRows(QImage &img, RowFn fn) {
+    const int w = img.width();
+    const int bpl = img.bytesPerLine();
+    uchar *bits = img.bits(); // отсоединяемся один раз, до запуска потоков
+    parallelForRows(img.height(), w, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            fn(reinterpret_cast<QRgb*>(bits + size_t(y) * bpl), w, y);
+        }
+    });
 }
 
-QImage vintageFilter(const QImage &src,
+// Поканальные фильтры компилируются в ChannelLut один раз на каждую пару
+// (фильтр, параметры); дальше горячий цикл — только выборка из таблицы.
+enum class LutKind : quint32 {
+    Identity,
+    Negative,
+    Warm,
+    Cold,
+    Posterize
+};
+
+static quint32 lutParamKey(float v) {
+    quint32 bits;
+    std::memcpy(&bits, &v, sizeof bits);
+    return bits;
+}
+
+static const ChannelLut &cachedChannelLut(LutKind kind, quint32 param, const std::function<ChannelLut()> &build) {
+    static QMutex mutex;
+    static QHash<quint64, std::shared_ptr<const ChannelLut>> cache;
+
+    const quint64 key = (quint64(kind) << 32) | param;
+    QMutexLocker locker(&mutex);
+    std::shared_ptr<const ChannelLut> &entry = cache[key];
+    if (!entry) {
+        entry = std::make_shared<const ChannelLut>(build());
+    }
+    // записи из кэша не удаляются, поэтому ссылка остаётся действительной
+    return *entry;
+}
+
+// Фильтры ниже принимают кадр и по значению-rvalue: тогда кадр, которым
+// вызывающий больше не пользуется, меняется на месте без копии. Версии с
+// const QImage & копируют его в кадр из пула.
+static QImage lutFilter(QImage &&src, const ChannelLut &lut) {
+    QImage img = ownedArgb32(std::move(src));
+    const PixelKernels &kernels = pixelKernels();
+    parallelRows(img, [&](QRgb *line, int w, int) { kernels.lut(line, w, lut); });
+    return img;
+}
+
+static VintageReference vintageReference(float intensity, float contrast)
+{
+    const float toneAmount = 0.25f * intensity;
+    const float desatAmount = 0.25f * intensity;
+
+    VintageReference p;
+    p.desatKeep = 1.0f - desatAmount;
+    p.desat = desatAmount;
+    p.toneR = 0.30f * toneAmount;
+    p.toneG = 0.12f * toneAmount;
+    p.toneBMul = 1.0f - 0.20f * toneAmount;
+    p.contrastMul = 1.0f + contrast * 0.6f;
+    return p;
+}
+
+// Формула vintageReferencePixel, сложенная в матрицу: для канала o
+// out = c * s_o * (keep * in_o + desat * lum) + c * (a_o - 128) + 128,
+// где s_o, a_o — множитель и добавка тона, c — контраст.
+static VintageParams vintageParams(float intensity, float contrast)
+{
+    const VintageReference ref = vintageReference(intensity, contrast);
+    const double luma[3] = {0.299, 0.587, 0.114};
+    const double toneScale[3] = {1.0 - ref.toneR, 1.0 - ref.toneG, ref.toneBMul};
+    const double toneAdd[3] = {255.0 * ref.toneR, 255.0 * ref.toneG, 0.0};
+    const double c = ref.contrastMul;
+
+    VintageParams p;
+    for (int o = 0; o < 3; ++o) {
+        for (int i = 0; i < 3; ++i) {
+            const double weight = c * toneScale[o] * ((o == i ? ref.desatKeep : 0.0) + ref.desat * luma[i]);
+            p.weight[o][i] = qint16(qBound(-32768L, std::lround(weight * 16384.0), 32767L));
+        }
+        p.offset[o] = qint32(std::lround((c * (toneAdd[o] - 128.0) + 128.0) * 16384.0)) + 128;
+    }
+    return p;
+}
+
+static void fillVignetteRows(qint16 *factors, int w, int h, float amount, int firstRow, int rows)
+{
+    const float cx = w * 0.5f;
+    const float cy = h * 0.5f;
+    const float maxDist = std::sqrt(cx*cx + cy*cy);
+    parallelForRows(rows, w, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            qint16 *row = factors + size_t(y) * w;
+            for (int x = 0; x < w; ++x) {
+                row[x] = toQ15(vignetteFactor(x, firstRow + y, cx, cy, maxDist, amount));
+            }
+        }
+    });
+}
+
+static std::shared_ptr<const VignetteMask> buildVignetteMask(int w, int h, float amount)
+{
+    auto mask = std::make_shared<VignetteMask>();
+    mask->width = w;
+    mask->height = h;
+    mask->factors.resize(size_t(h / 2 + 1) * w);
+    fillVignetteRows(mask->factors.data(), w, h, amount, 0, h / 2 + 1);
+    return mask;
+}
+
+// Маска только для строк [y0, y1) — для полос большого снимка, которым не нужна
+// (и не по карману) маска на весь кадр. Не кэшируется.
+static std::shared_ptr<const VignetteMask> buildVignetteMaskRows(int w, int h, float amount, int y0, int y1)
+{
+    auto mask = std::make_shared<VignetteMask>();
+    mask->width = w;
+    mask->height = h;
+    mask->firstRow = y0;
+    mask->rows = y1 - y0;
+    mask->factors.resize(size_t(y1 - y0) * w);
+    fillVignetteRows(mask->factors.data(), w, h, amount, y0, y1 - y0);
+    return mask;
+}
+
+// Маска виньетки зависит только от размера кадра и силы эффекта, поэтому
+// строится один раз и переиспользуется всеми снимками и кадрами того же
+// размера. Держим несколько последних масок: размеров в работе обычно один-два.
+static std::shared_ptr<const VignetteMask> vignetteMask(int w, int h, float amount)
+{
+    static const int maxMasks = 4;
+    static QMutex mutex;
+    static QList<QPair<quint32, std::shared_ptr<const VignetteMask>>> masks; // свежие в начале
+
+    const quint32 amountKey = lutParamKey(amount);
+    QMutexLocker locker(&mutex);
+    for (int i = 0; i < masks.size(); ++i) {
+        const VignetteMask &m = *masks.at(i).second;
+        if (masks.at(i).first == amountKey && m.width == w && m.height == h) {
+            masks.move(i, 0);
+            return masks.first().second;
+        }
+    }
+
+    std::shared_ptr<const VignetteMask> mask = buildVignetteMask(w, h, amount);
+    masks.prepend(qMakePair(amountKey, mask));
+    while (masks.size() > maxMasks) {
+        masks.removeLast();
+    }
+    return mask;
+}
+
+// Общая часть vintageFilter и совместного прохода: обработка строк [y0, y1)
+// в памяти out. Шум считается по (seed, x, y), поэтому полосы независимы.
+struct VintageJob {
+    VintageParams params;
+    std::shared_ptr<const VignetteMask> vignette;
+    int grainScale = 0; // амплитуда шума, Q6
+    quint32 seed = 0;
+
+    void run(const RowTarget &out, int w, int y0, int y1) const {
+        const PixelKernels &kernels = pixelKernels();
+        std::vector<qint16> noise(grainScale > 0 ? w : 0);
+        for (int y = y0; y < y1; ++y) {
+            if (!noise.empty()) {
+                kernels.grain(noise.data(), w, grainRowKey(seed, y), grainScale);
+            }
+            kernels.vintage(reinterpret_cast<QRgb*>(out.line(y)), w, params,
+                            vignette ? vignette->row(y) : nullptr,
+                            noise.empty() ? nullptr : noise.data());
+        }
+    }
+};
+
+// y0, y1 — строки полосы большого снимка: маска виньетки тогда строится только
+// на них. По умолчанию весь кадр и маска из кэша.
+static VintageJob vintageJob(int w, int h, float intensity, float vignette, float grain, float contrast, quint32 seed,
+                             int y0 = 0, int y1 = -1)
+{
+    VintageJob job;
+    job.params = vintageParams(intensity, contrast);
+    const float vignetteAmount = vignette * intensity;
+    if (vignetteAmount > 0.0f) {
+        job.vignette = y0 == 0 && (y1 < 0 || y1 == h) ? vignetteMask(w, h, vignetteAmount)
+                                                      : buildVignetteMaskRows(w, h, vignetteAmount, y0, y1);
+    }
+    job.grainScale = grain > 0.0f ? toQ6(grain * 255.0f) : 0;
+    job.seed = seed;
+    return job;
+}
+
+// seed задаёт зерно: при одинаковом seed результат одинаков от запуска к запуску.
+QImage vintageFilter(QImage &&src,
                      float intensity = 0.8f,
                      float vignette = 0.6f,
                      float grain = 0.04f,
-                     float contrast = 0.15f)
+                     float contrast = 0.15f,
+                     quint32 seed = 0)
 {
     if (intensity <= 0.0f && vignette <= 0.0f && grain <= 0.0f && fabs(contrast) < 1e-6f)
-        return src;
+        return std::move(src);
 
-    QImage img = src.convertToFormat(QImage::Format_ARGB32);
+    QImage img = ownedArgb32(std::move(src));
     const int w = img.width();
     const int h = img.height();
-    const float cx = w * 0.5f;
-    const float cy = h * 0.5f;
-    const float maxDist = std::sqrt(cx*cx + cy*cy);
+    const VintageJob job = vintageJob(w, h, intensity, vignette, grain, contrast, seed);
+
+    const RowTarget out{img.bits(), img.bytesPerLine(), 0};
+    parallelForRows(h, w, [&](int y0, int y1) { job.run(out, w, y0, y1); });
+    return img;
+}
+
+QImage vintageFilter(const QImage &src,
+                     float intensity = 0.8f,
+                     float vignette = 0.6f,
+                     float grain = 0.04f,
+                     float contrast = 0.15f,
+                     quint32 seed = 0)
+{
+    return vintageFilter(QImage(src), intensity, vignette, grain, contrast, seed);
+}
+
+static ToneParams warmToneParams(float intensity)
+{
+    // повышаем R ближе к 255, чуть увеличиваем G, уменьшаем B
+    return ToneParams{{0.45f * intensity, 0.20f * intensity, 0.0f},
+                      {1.0f, 1.0f, 1.0f - 0.25f * intensity}};
+}
+
+static ToneParams coldToneParams(float intensity)
+{
+    return ToneParams{{0.0f, 0.12f * intensity, 0.45f * intensity},
+                      {1.0f - 0.30f * intensity, 1.0f, 1.0f}};
+}
+
+static ChannelLut toneLut(const ToneParams &params)
+{
+    ChannelLut lut = {};
+    for (int v = 0; v < 256; ++v) {
+        const QRgb p = tonePixel(qRgb(v, v, v), params);
+        lut.table[0][v] = uchar(qRed(p));
+        lut.table[1][v] = uchar(qGreen(p));
+        lut.table[2][v] = uchar(qBlue(p));
+    }
+    return lut;
+}
+
+static const ChannelLut &warmLut(float intensity)
+{
+    return cachedChannelLut(LutKind::Warm, lutParamKey(intensity),
+                            [intensity]() { return toneLut(warmToneParams(intensity)); });
+}
+
+static const ChannelLut &coldLut(float intensity)
+{
+    return cachedChannelLut(LutKind::Cold, lutParamKey(intensity),
+                            [intensity]() { return toneLut(coldToneParams(intensity)); });
+}
+
+QImage warmFilter(QImage &&src, float intensity = 0.6f)
+{
+    if (intensity <= 0.0f) return std::move(src);
+    if (intensity > 1.0f) intensity = 1.0f;
+
+    return lutFilter(std::move(src), warmLut(intensity));
+}
+
+QImage warmFilter(const QImage &src, float intensity = 0.6f)
+{
+    return warmFilter(QImage(src), intensity);
+}
+
+QImage coldFilter(QImage &&src, float intensity = 0.6f)
+{
+    if (intensity <= 0.0f) return std::move(src);
+    if (intensity > 1.0f) intensity = 1.0f;
+
+    return lutFilter(std::move(src), coldLut(intensity));
+}
+
+QImage coldFilter(const QImage &src, float intensity = 0.6f)
+{
+    return coldFilter(QImage(src), intensity);
+}
+
+static const ChannelLut &posterizeLut(int levels)
+{
+    return cachedChannelLut(LutKind::Posterize, quint32(levels), [levels]() {
+        ChannelLut lut = {};
+        const int steps = levels - 1;
+        for (int v = 0; v < 256; ++v) {
+            int idx = int(std::round((v * 1.0f * steps) / 255.0f));
+            int quant = int(std::round((idx * 255.0f) / (float)steps));
+            lut.table[0][v] = lut.table[1][v] = lut.table[2][v] = uchar(clampInt(quant));
+        }
+        return lut;
+    });
+}
+
+// Способ распределить ошибку квантования при постеризации.
+enum class PosterizeDither {
+    None,
+    FloydSteinberg, // диффузия ошибки, строки идут волной по потокам
+    Bayer,          // упорядоченный, матрица 8x8
+    BlueNoise       // пороговая маска 64x64 с синим шумом
+};
+
+// Ошибка квантования пикселя: её доли уходят в строку ниже.
+struct DiffusionError {
+    float r, g, b;
+};
+
+// Флойд–Стейнберг. Ошибка копится не в копии всего кадра, а в кольце строк:
+// строка y читает свою строку кольца и дописывает в следующую. Строки разбирают
+// потоки по возрастанию, и строка y обгоняет строку y-1 не ближе чем на два
+// пикселя — ровно столько, сколько нужно, чтобы до пикселя (x, y) уже дошли все
+// вклады сверху, а вклад слева приходил последним. Порядок сложений поэтому тот
+// же, что и в однопоточном проходе, и результат совпадает бит в бит.
+//
+// Обрабатываются строки [0, h) памяти bits. Для полос большого снимка above —
+// ошибки последней строки предыдущей полосы (nullptr у первой), а в below
+// записываются ошибки последней строки этой полосы вместо того, чтобы
+// раскладывать их в строку, которой ещё нет. Вклады из above прибавляются в
+// том же порядке, что и в целом кадре, так что полосы дают тот же результат.
+static void floydSteinbergRows(uchar *bits, int bpl, int w, int h, const ChannelLut &lut,
+                               const std::vector<DiffusionError> *above, std::vector<DiffusionError> *below)
+{
+    struct RGBf { float r, g, b; unsigned char a; };
+
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    // прогресс публикуется порциями, чтобы соседние строки не дёргали один атомик на каждый пиксель
+    const int chunk = 64;
+    const int workers = qMin(h, parallelThreadCount());
+    const int ringRows = workers + 1; // один поток — два буфера, как в обычном проходе
+    std::vector<RGBf> ring(size_t(ringRows) * w);
+    std::unique_ptr<std::atomic<int>[]> progress(new std::atomic<int>[h]);
+    for (int y = 0; y < h; ++y) {
+        progress[y].store(0, std::memory_order_relaxed);
+    }
+    if (below) {
+        below->resize(size_t(w));
+    }
+
+    auto waitFor = [&](int y, int done) {
+        while (progress[y].load(std::memory_order_acquire) < done) {
+            QThread::yieldCurrentThread();
+        }
+    };
+
+    auto loadRow = [&](RGBf *row, int y) {
+        const QRgb *line = reinterpret_cast<const QRgb*>(bits + size_t(y) * bpl);
+        for (int x = 0; x < w; ++x) {
+            const QRgb p = line[x];
+            row[x] = RGBf{float(qRed(p)), float(qGreen(p)), float(qBlue(p)), uchar(qAlpha(p))};
+        }
+    };
+
+    parallelForIndices(h, workers, [&](int y) {
+        RGBf *cur = ring.data() + size_t(y % ringRows) * w;
+        RGBf *next = nullptr;
+        if (y == 0) {
+            loadRow(cur, 0);
+            if (above) {
+                // вклады пикселей x-1, x, x+1 строки выше — в порядке их обхода
+                const DiffusionError *err = above->data();
+                for (int x = 0; x < w; ++x) {
+                    RGBf &c = cur[x];
+                    if (x > 0) {
+                        c.r += err[x - 1].r * (1.0f / 16.0f);
+                        c.g += err[x - 1].g * (1.0f / 16.0f);
+                        c.b += err[x - 1].b * (1.0f / 16.0f);
+                    }
+                    c.r += err[x].r * (5.0f / 16.0f);
+                    c.g += err[x].g * (5.0f / 16.0f);
+                    c.b += err[x].b * (5.0f / 16.0f);
+                    if (x + 1 < w) {
+                        c.r += err[x + 1].r * (3.0f / 16.0f);
+                        c.g += err[x + 1].g * (3.0f / 16.0f);
+                        c.b += err[x + 1].b * (3.0f / 16.0f);
+                    }
+                }
+            }
+        }
+        if (y + 1 < h) {
+            // буфер следующей строки освобождается, когда её предыдущий владелец закончил
+            if (y + 1 >= ringRows) {
+                waitFor(y + 1 - ringRows, w);
+            }
+            next = ring.data() + size_t((y + 1) % ringRows) * w;
+            loadRow(next, y + 1); // строка y+1 ещё не начата, её пиксели исходные
+        }
+        DiffusionError *carry = !next && below ? below->data() : nullptr;
+
+        QRgb *line = reinterpret_cast<QRgb*>(bits + size_t(y) * bpl);
+        for (int x0 = 0; x0 < w; x0 += chunk) {
+            const int x1 = qMin(w, x0 + chunk);
+            if (y > 0) {
+                waitFor(y - 1, qMin(w, x1 + 2));
+            }
+
+            for (int x = x0; x < x1; ++x) {
+                const RGBf c = cur[x];
+                const int oldR = clampInt(int(std::round(c.r)));
+                const int oldG = clampInt(int(std::round(c.g)));
+                const int oldB = clampInt(int(std::round(c.b)));
+
+                const int newR = lut.table[0][oldR];
+                const int newG = lut.table[1][oldG];
+                const int newB = lut.table[2][oldB];
+
+                line[x] = qRgba(newR, newG, newB, c.a);
+
+                const float errR = oldR - newR;
+                const float errG = oldG - newG;
+                const float errB = oldB - newB;
+
+                auto addError = [&](RGBf &nc, float factor) {
+                    nc.r += errR * factor;
+                    nc.g += errG * factor;
+                    nc.b += errB * factor;
+                };
+
+                if (x + 1 < w) addError(cur[x + 1], 7.0f / 16.0f);
+                if (next) {
+                    if (x > 0) addError(next[x - 1], 3.0f / 16.0f);
+                    addError(next[x], 5.0f / 16.0f);
+                    if (x + 1 < w) addError(next[x + 1], 1.0f / 16.0f);
+                } else if (carry) {
+                    carry[x] = DiffusionError{errR, errG, errB};
+                }
+            }
+
+            progress[y].store(x1, std::memory_order_release);
+        }
+    });
+}
+
+static void floydSteinbergDither(QImage &img, const ChannelLut &lut)
+{
+    floydSteinbergRows(img.bits(), img.bytesPerLine(), img.width(), img.height(), lut, nullptr, nullptr);
+}
+
+// Ранги порогов 64x64 с синим шумом, построенные методом void-and-cluster
+// (Ulichney). Маска строится один раз за процесс, генератор с постоянным зерном,
+// так что картинка от запуска к запуску не меняется.
+static const int blueNoiseSize = 64;
+
+static std::vector<int> buildBlueNoiseRanks()
+{
+    const int n = blueNoiseSize * blueNoiseSize;
+    const int mask = blueNoiseSize - 1;
+
+    // гауссово ядро по тороидальному расстоянию, sigma = 1.5
+    std::vector<float> kernel(n);
+    for (int dy = 0; dy < blueNoiseSize; ++dy) {
+        for (int dx = 0; dx < blueNoiseSize; ++dx) {
+            const int ty = qMin(dy, blueNoiseSize - dy);
+            const int tx = qMin(dx, blueNoiseSize - dx);
+            kernel[dy * blueNoiseSize + dx] = std::exp(-float(tx*tx + ty*ty) / (2.0f * 1.5f * 1.5f));
+        }
+    }
+
+    std::vector<char> pattern(n, 0);
+    std::vector<float> energy(n, 0.0f);
+    auto toggle = [&](int p, bool on) {
+        pattern[p] = on;
+        const float sign = on ? 1.0f : -1.0f;
+        const int py = p / blueNoiseSize;
+        const int px = p % blueNoiseSize;
+        for (int q = 0; q < n; ++q) {
+            const int dy = (q / blueNoiseSize - py) & mask;
+            const int dx = (q % blueNoiseSize - px) & mask;
+            energy[q] += sign * kernel[dy * blueNoiseSize + dx];
+        }
+    };
+    auto tightestCluster = [&]() {
+        int best = -1;
+        for (int p = 0; p < n; ++p) {
+            if (pattern[p] && (best < 0 || energy[p] > energy[best])) best = p;
+        }
+        return best;
+    };
+    auto largestVoid = [&]() {
+        int best = -1;
+        for (int p = 0; p < n; ++p) {
+            if (!pattern[p] && (best < 0 || energy[p] < energy[best])) best = p;
+        }
+        return best;
+    };
+
+    // начальный узор: ~10% случайных точек, затем переносим точки из самых
+    // плотных скоплений в самые большие пустоты, пока это что-то меняет
+    std::mt19937 rng(20240611u);
+    const int initial = n / 10;
+    for (int placed = 0; placed < initial; ) {
+        const int p = int(rng() % unsigned(n));
+        if (!pattern[p]) {
+            toggle(p, true);
+            ++placed;
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        const int cluster = tightestCluster();
+        toggle(cluster, false);
+        const int hole = largestVoid();
+        toggle(hole, true);
+        if (hole == cluster) break;
+    }
+
+    const std::vector<char> prototype = pattern;
+    const std::vector<float> prototypeEnergy = energy;
+    std::vector<int> ranks(n, 0);
+
+    // точки прототипа получают младшие ранги: снимаем их от самых плотных
+    for (int rank = initial - 1; rank >= 0; --rank) {
+        const int cluster = tightestCluster();
+        toggle(cluster, false);
+        ranks[cluster] = rank;
+    }
+
+    // остальные ранги — заполнением самых больших пустот
+    pattern = prototype;
+    energy = prototypeEnergy;
+    for (int rank = initial; rank < n; ++rank) {
+        const int hole = largestVoid();
+        toggle(hole, true);
+        ranks[hole] = rank;
+    }
+
+    return ranks;
+}
+
+static const std::vector<int> &blueNoiseRanks()
+{
+    static const std::vector<int> ranks = buildBlueNoiseRanks();
+    return ranks;
+}
+
+// Пороговое (упорядоченное) сглаживание: к каждому каналу прибавляется смещение
+// из матрицы size x size (size — степень двойки), затем обычная таблица
+// постеризации. Пиксели независимы, так что кадр делится на полосы как угодно,
+// а внутренний цикл — сложение и выборка из таблицы без ветвлений.
+static void thresholdDither(QImage &img, const ChannelLut &lut, const std::vector<int> &offsets, int size)
+{
+    const int mask = size - 1;
+    parallelRows(img, [&](QRgb *line, int w, int y) {
+        const int *row = offsets.data() + (y & mask) * size;
+        for (int x = 0; x < w; ++x) {
+            const QRgb p = line[x];
+            const int off = row[x & mask];
+            line[x] = qRgba(lut.table[0][clampInt(qRed(p) + off)],
+                            lut.table[1][clampInt(qGreen(p) + off)],
+                            lut.table[2][clampInt(qBlue(p) + off)],
+                            qAlpha(p));
+        }
+    });
+}
+
+// Порог t из (0, 1) превращается в смещение в пределах половины шага квантования.
+static int thresholdOffset(float t, int levels)
+{
+    const float step = 255.0f / float(levels - 1);
+    return int(std::round((t - 0.5f) * step));
+}
+
+static std::vector<int> bayerOffsets(int levels)
+{
+    static const int bayer[8][8] = {
+        { 0, 32,  8, 40,  2, 34, 10, 42},
+        {48, 16, 56, 24, 50, 18, 58, 26},
+        {12, 44,  4, 36, 14, 46,  6, 38},
+        {60, 28, 52, 20, 62, 30, 54, 22},
+        { 3, 35, 11, 43,  1, 33,  9, 41},
+        {51, 19, 59, 27, 49, 17, 57, 25},
+        {15, 47,  7, 39, 13, 45,  5, 37},
+        {63, 31, 55, 23, 61, 29, 53, 21}
+    };
+    std::vector<int> offsets(64);
+    for (int i = 0; i < 64; ++i) {
+        offsets[i] = thresholdOffset((bayer[i / 8][i % 8] + 0.5f) / 64.0f, levels);
+    }
+    return offsets;
+}
+
+static std::vector<int> blueNoiseOffsets(int levels)
+{
+    const std::vector<int> &ranks = blueNoiseRanks();
+    std::vector<int> offsets(ranks.size());
+    for (size_t i = 0; i < ranks.size(); ++i) {
+        offsets[i] = thresholdOffset((ranks[i] + 0.5f) / float(ranks.size()), levels);
+    }
+    return offsets;
+}
+
+QImage posterizeEffect(const QImage &srcImage, int levels, PosterizeDither dither)
+{
+    if (levels < 2) levels = 2;
+    const ChannelLut &lut = posterizeLut(levels);
+
+    if (dither == PosterizeDither::None) {
+        return lutFilter(QImage(srcImage), lut);
+    }
+
+    QImage img = ownedArgb32(QImage(srcImage));
+    switch (dither) {
+    case PosterizeDither::FloydSteinberg:
+        floydSteinbergDither(img, lut);
+        break;
+    case PosterizeDither::Bayer:
+        thresholdDither(img, lut, bayerOffsets(levels), 8);
+        break;
+    case PosterizeDither::BlueNoise:
+        thresholdDither(img, lut, blueNoiseOffsets(levels), blueNoiseSize);
+        break;
+    case PosterizeDither::None:
+        break;
+    }
+    return img;
+}
+
+QImage posterizeEffect(const QImage &srcImage, int levels = 12, bool dither = false)
+{
+    return posterizeEffect(srcImage, levels, dither ? PosterizeDither::FloydSteinberg : PosterizeDither::None);
+}
+
+
+QImage hardSolarizeInvert(QImage &&src, int threshold = 128)
+{
+    QImage img = ownedArgb32(std::move(src));
+    const PixelKernels &kernels = pixelKernels();
+    parallelRows(img, [&](QRgb *line, int w, int) { kernels.solarize(line, w, threshold); });
+    return img;
+}
+
+QImage hardSolarizeInvert(const QImage &src, int threshold = 128)
+{
+    return hardSolarizeInvert(QImage(src), threshold);
+}
+
+QImage toSepia(QImage &&srcImage) {
+    QImage img = ownedArgb32(std::move(srcImage));
+
+    const PixelKernels &kernels = pixelKernels();
+    const SepiaTables &tables = sepiaTables();
+    parallelRows(img, [&](QRgb *line, int w, int) { kernels.sepia(line, w, tables); });
+    return img;
+}
+
+QImage toSepia(const QImage &srcImage) {
+    return toSepia(QImage(srcImage));
+}
+
+// Режим самопроверки (lab-2 --selftest): каждый SIMD-набор ядер, доступный на
+// этом процессоре, сравнивается побитово со скалярной версией. Табличные
+// фильтры, сепия и соляризация проверяются на всех 2^24 значениях RGB, винтаж
+// с шумом — на случайных строках разной длины, чтобы задеть хвосты всех ширин
+// векторов. Отдельно проверяется, что таблицы сепии и фиксированная точка
+// винтажа отличаются от исходных формул не больше чем на 1 в каждом канале:
+// винтаж без виньетки и шума — на всех 2^24 цветах, с ними и с другими
+// параметрами — на случайных пикселях.
+static bool selfTestFilterKernels()
+{
+    const QList<const PixelKernels*> sets = supportedPixelKernels();
+    const float intensities[] = {0.05f, 0.6f, 1.0f};
+    const int thresholds[] = {0, 128, 255};
+    const int widths[] = {1, 3, 4, 7, 8, 15, 16, 17, 31, 33, 64, 257};
+
+    QList<const ChannelLut*> luts;
+    for (const float intensity : intensities) {
+        luts << &warmLut(intensity) << &coldLut(intensity);
+    }
+    luts << &posterizeLut(2) << &posterizeLut(12);
+    const SepiaTables &sepia = sepiaTables();
+
+    std::mt19937 rng(20240601u);
+    std::uniform_real_distribution<float> distUniform(-1.0f, 1.0f);
+    // строка на каждое значение R: все сочетания G и B, случайная альфа
+    std::vector<QRgb> line(256 * 256);
+    auto fillLine = [&line, &rng](int r) {
+        for (int gb = 0; gb < 256 * 256; ++gb) {
+            line[gb] = qRgba(r, gb >> 8, gb & 0xff, int(rng() & 0xff));
+        }
+    };
+
+    bool ok = true;
+    int sepiaOffByOne = 0;
+    for (int r = 0; r < 256; ++r) {
+        fillLine(r);
+        std::vector<QRgb> tabled = line;
+        sepiaRowScalar(tabled.data(), int(tabled.size()), sepia);
+        for (size_t i = 0; i < line.size(); ++i) {
+            const QRgb expected = sepiaReferencePixel(line[i]);
+            const int diff = qMax(qMax(qAbs(qRed(expected) - qRed(tabled[i])), qAbs(qGreen(expected) - qGreen(tabled[i]))),
+                                  qAbs(qBlue(expected) - qBlue(tabled[i])));
+            if (diff > 1) {
+                ok = false;
+            } else if (diff == 1) {
+                ++sepiaOffByOne;
+            }
+        }
+    }
+    qInfo() << "Таблицы сепии:" << sepiaOffByOne << "цветов отличаются от формулы на 1"
+            << (ok ? "" : ", есть отличия больше 1");
+
+    auto channelDiff = [](QRgb a, QRgb b) {
+        return qMax(qMax(qAbs(qRed(a) - qRed(b)), qAbs(qGreen(a) - qGreen(b))), qAbs(qBlue(a) - qBlue(b)));
+    };
+    bool vintageOk = true;
+    int vintageOffByOne = 0;
+    auto checkVintage = [&](QRgb fixed, QRgb expected) {
+        const int diff = channelDiff(fixed, expected);
+        if (diff > 1) {
+            vintageOk = false;
+        } else if (diff == 1) {
+            ++vintageOffByOne;
+        }
+    };
+    {
+        const VintageReference ref = vintageReference(0.8f, 0.15f);
+        const VintageParams v = vintageParams(0.8f, 0.15f);
+        for (int r = 0; r < 256; ++r) {
+            fillLine(r);
+            std::vector<QRgb> fixed = line;
+            vintageRowScalar(fixed.data(), int(fixed.size()), v, nullptr, nullptr);
+            for (size_t i = 0; i < line.size(); ++i) {
+                checkVintage(fixed[i], vintageReferencePixel(line[i], ref, 1.0f, 0.0f));
+            }
+        }
+    }
+    std::uniform_real_distribution<float> distUnit(0.0f, 1.0f);
+    for (const float intensity : {0.0f, 0.05f, 0.6f, 1.0f}) {
+        for (const float contrast : {-1.0f, -0.4f, 0.0f, 0.15f, 0.7f, 1.0f}) {
+            const VintageReference ref = vintageReference(intensity, contrast);
+            const VintageParams v = vintageParams(intensity, contrast);
+            for (int i = 0; i < 16384; ++i) {
+                const QRgb p = static_cast<QRgb>(rng());
+                // виньетка и шум сравниваются уже квантованными, как их видит ядро
+                const qint16 vignette = toQ15(distUnit(rng));
+                const qint16 noise = toQ6(distUniform(rng) * 255.0f * distUnit(rng));
+                QRgb fixed = p;
+                vintageRowScalar(&fixed, 1, v, &vignette, &noise);
+                checkVintage(fixed, vintageReferencePixel(p, ref, vignette / 32767.0f, noise / 64.0f));
+            }
+        }
+    }
+    qInfo() << "Винтаж в фиксированной точке:" << vintageOffByOne << "пикселей отличаются от формулы на 1"
+            << (vintageOk ? "" : ", есть отличия больше 1");
+    ok = ok && vintageOk;
+
+    for (const PixelKernels *set : sets) {
+        if (set == &scalarKernels) {
+            continue;
+        }
+        bool setOk = true;
+        auto compare = [&](const char *filter, const std::vector<QRgb> &src,
+                           const std::function<void(const PixelKernels &, QRgb *)> &run) {
+            std::vector<QRgb> expected = src;
+            std::vector<QRgb> actual = src;
+            run(scalarKernels, expected.data());
+            run(*set, actual.data());
+            if (std::memcmp(expected.data(), actual.data(), src.size() * sizeof(QRgb)) != 0) {
+                qWarning() << "SIMD-ядро" << set->name << "расходится со скалярным:" << filter
+                           << "ширина" << int(src.size());
+                setOk = false;
+            }
+        };
+
+        for (int r = 0; r < 256 && setOk; ++r) {
+            fillLine(r);
+            const int w = int(line.size());
+            for (const ChannelLut *lut : luts) {
+                compare("lut", line, [&](const PixelKernels &k, QRgb *px) { k.lut(px, w, *lut); });
+            }
+            compare("sepia", line, [&](const PixelKernels &k, QRgb *px) { k.sepia(px, w, sepia); });
+            for (const int threshold : thresholds) {
+                compare("solarize", line, [&](const PixelKernels &k, QRgb *px) { k.solarize(px, w, threshold); });
+            }
+        }
+
+        for (const int w : widths) {
+            std::vector<QRgb> src(w);
+            std::vector<qint16> noise(w);
+            for (QRgb &p : src) {
+                p = static_cast<QRgb>(rng());
+            }
+            compare("lut", src, [&](const PixelKernels &k, QRgb *px) { k.lut(px, w, *luts.first()); });
+            compare("sepia", src, [&](const PixelKernels &k, QRgb *px) { k.sepia(px, w, sepia); });
+            for (const quint32 seed : {0u, 12345u}) {
+                std::vector<qint16> expected(w), actual(w);
+                const quint32 rowKey = grainRowKey(seed, w);
+                const int scale = toQ6(0.04f * 255.0f);
+                scalarKernels.grain(expected.data(), w, rowKey, scale);
+                set->grain(actual.data(), w, rowKey, scale);
+                if (std::memcmp(expected.data(), actual.data(), size_t(w) * sizeof(qint16)) != 0) {
+                    qWarning() << "SIMD-ядро" << set->name << "расходится со скалярным: grain ширина" << w;
+                    setOk = false;
+                }
+            }
+            for (const float intensity : intensities) {
+                const int h = 2 * w + 1;
+                const VintageParams v = vintageParams(intensity, 0.15f);
+                const std::shared_ptr<const VignetteMask> mask = buildVignetteMask(w, h, 0.6f * intensity);
+                for (const int y : {0, w, h - 1}) {
+                    for (QRgb &p : src) {
+                        p = static_cast<QRgb>(rng());
+                    }
+                    for (qint16 &n : noise) {
+                        n = toQ6(distUniform(rng) * 0.04f * 255.0f);
+                    }
+                    const qint16 *vignette = mask->row(y);
+                    compare("vintage", src, [&](const PixelKernels &k, QRgb *px) { k.vintage(px, w, v, vignette, noise.data()); });
+                    compare("vintage", src, [&](const PixelKernels &k, QRgb *px) { k.vintage(px, w, v, nullptr, nullptr); });
+                }
+            }
+        }
+
+        qInfo() << "SIMD-ядро" << set->name << (setOk ? "совпадает со скалярным" : "НЕ совпадает со скалярным");
+        ok = ok && setOk;
+    }
+
+    if (sets.size() == 1) {
+        qInfo() << "SIMD-ядра недоступны на этом процессоре, используется скалярная версия";
+    }
+    return ok;
+}
+
+static const ChannelLut &identityLut()
+{
+    return cachedChannelLut(LutKind::Identity, 0, []() {
+        ChannelLut lut = {};
+        for (int v = 0; v < 256; ++v) {
+            lut.table[0][v] = lut.table[1][v] = lut.table[2][v] = uchar(v);
+        }
+        return lut;
+    });
+}
+
+static const ChannelLut &negativeLut()
+{
+    return cachedChannelLut(LutKind::Negative, 0, []() {
+        ChannelLut lut = {};
+        for (int v = 0; v < 256; ++v) {
+            lut.table[0][v] = lut.table[1][v] = lut.table[2][v] = uchar(255 - v);
+        }
+        return lut;
+    });
+}
+
+// Тёплый и холодный: intensity <= 0 ничего не меняет, больше 1 — обрезается.
+static const ChannelLut &toneFilterLut(FilterId id, float intensity)
+{
+    if (intensity <= 0.0f) {
+        return identityLut();
+    }
+    intensity = qMin(intensity, 1.0f);
+    return id == FilterId::Warm ? warmLut(intensity) : coldLut(intensity);
+}
+
+static BandKernel lutKernel(const ChannelLut &lut)
+{
+    const PixelKernels &kernels = pixelKernels();
+    const ChannelLut *table = &lut;
+    return rowKernel([&kernels, table](QRgb *line, int w, int) { kernels.lut(line, w, *table); });
+}
+
+static void registerBuiltinFilters(FilterRegistry &registry)
+{
+    const int perChannel = FilterPerChannel | FilterInPlace;
+
+    FilterSpec none;
+    none.id = FilterId::None;
+    none.code = QStringLiteral("бф");
+    none.title = QStringLiteral("Без фильтра");
+    none.slug = QStringLiteral("no_filter");
+    none.traits = perChannel;
+    none.prepare = [](int, int, const FilterValues &) { return rowKernel([](QRgb *, int, int) {}); };
+    none.channelLut = [](const FilterValues &) -> const ChannelLut & { return identityLut(); };
+    registry.add(none);
+
+    FilterSpec gray;
+    gray.id = FilterId::Gray;
+    gray.code = QStringLiteral("чб");
+    gray.title = QStringLiteral("ЧБ");
+    gray.slug = QStringLiteral("bw");
+    gray.ffmpeg = QStringLiteral("format=gray");
+    gray.outputFormat = QImage::Format_Grayscale8;
+    gray.prepare = [](int, int, const FilterValues &) -> BandKernel {
+        // яркость пишется прямо в строки результата, без промежуточного кадра на полосу
+        return [](const QImage &band, int y0, const RowTarget &out) {
+            const int w = band.width();
+            for (int i = 0; i < band.height(); ++i) {
+                const QRgb *line = reinterpret_cast<const QRgb*>(band.constScanLine(i));
+                uchar *dst = out.line(y0 + i);
+                for (int x = 0; x < w; ++x) {
+                    dst[x] = uchar(qGray(line[x]));
+                }
+            }
+        };
+    };
+    registry.add(gray);
+
+    FilterSpec sepia;
+    sepia.id = FilterId::Sepia;
+    sepia.code = QStringLiteral("сеп");
+    sepia.title = QStringLiteral("Сепия");
+    sepia.slug = QStringLiteral("sepia");
+    sepia.ffmpeg = QStringLiteral("colorchannelmixer=.393:.769:.189:0:.349:.686:.168:0:.272:.534:.131");
+    sepia.traits = FilterInPlace;
+    sepia.prepare = [](int, int, const FilterValues &) {
+        const PixelKernels &kernels = pixelKernels();
+        const SepiaTables *tables = &sepiaTables();
+        return rowKernel([&kernels, tables](QRgb *line, int w, int) { kernels.sepia(line, w, *tables); });
+    };
+    registry.add(sepia);
+
+    FilterSpec negative;
+    negative.id = FilterId::Negative;
+    negative.code = QStringLiteral("нег");
+    negative.title = QStringLiteral("Негатив");
+    negative.slug = QStringLiteral("negative");
+    negative.ffmpeg = QStringLiteral("negate");
+    negative.traits = perChannel;
+    negative.prepare = [](int, int, const FilterValues &) {
+        return rowKernel([](QRgb *line, int w, int) {
+            for (int x = 0; x < w; ++x) {
+                line[x] ^= 0x00ffffffu;
+            }
+        });
+    };
+    negative.channelLut = [](const FilterValues &) -> const ChannelLut & { return negativeLut(); };
+    registry.add(negative);
+
+    FilterSpec posterize;
+    posterize.id = FilterId::Posterize;
+    posterize.code = QStringLiteral("пос");
+    posterize.title = QStringLiteral("Постеризация");
+    posterize.slug = QStringLiteral("posterize");
+    posterize.ffmpeg = QStringLiteral("lutrgb=r='floor(val/64)*64':g='floor(val/64)*64':b='floor(val/64)*64'");
+    posterize.params = {FilterParam{QStringLiteral("levels"), 12.0f, 2.0f, 256.0f}};
+    posterize.traits = perChannel;
+    posterize.channelLut = [](const FilterValues &v) -> const ChannelLut & { return posterizeLut(qMax(2, int(v.value(0, 12.0f)))); };
+    posterize.prepare = [](int, int, const FilterValues &v) { return lutKernel(posterizeLut(qMax(2, int(v.value(0, 12.0f))))); };
+    registry.add(posterize);
+
+    FilterSpec solarize;
+    solarize.id = FilterId::Solarize;
+    solarize.code = QStringLiteral("сол");
+    solarize.title = QStringLiteral("Соляризация");
+    solarize.slug = QStringLiteral("solarize");
+    solarize.ffmpeg = QStringLiteral("lutyuv=y='if(lt(val,128),val,255-val)'");
+    solarize.params = {FilterParam{QStringLiteral("threshold"), 128.0f, 0.0f, 255.0f}};
+    solarize.traits = FilterInPlace;
+    solarize.prepare = [](int, int, const FilterValues &v) {
+        const PixelKernels &kernels = pixelKernels();
+        const int threshold = int(v.value(0, 128.0f));
+        return rowKernel([&kernels, threshold](QRgb *line, int w, int) { kernels.solarize(line, w, threshold); });
+    };
+    registry.add(solarize);
+
+    for (const FilterId id : {FilterId::Cold, FilterId::Warm}) {
+        const bool warm = id == FilterId::Warm;
+        FilterSpec tone;
+        tone.id = id;
+        tone.code = warm ? QStringLiteral("теп") : QStringLiteral("хол");
+        tone.title = warm ? QStringLiteral("Теплый") : QStringLiteral("Холодный");
+        tone.slug = warm ? QStringLiteral("warm") : QStringLiteral("cold");
+        tone.ffmpeg = warm ? QStringLiteral("colorbalance=rs=0.35:bs=-0.25") : QStringLiteral("colorbalance=bs=0.35:rs=-0.25");
+        tone.params = {FilterParam{QStringLiteral("intensity"), 0.6f, 0.0f, 1.0f}};
+        tone.traits = perChannel;
+        tone.channelLut = [id](const FilterValues &v) -> const ChannelLut & { return toneFilterLut(id, v.value(0, 0.6f)); };
+        tone.prepare = [id](int, int, const FilterValues &v) { return lutKernel(toneFilterLut(id, v.value(0, 0.6f))); };
+        registry.add(tone);
+    }
+
+    FilterSpec vintage;
+    vintage.id = FilterId::Vintage;
+    vintage.code = QStringLiteral("вин");
+    vintage.title = QStringLiteral("Винтаж");
+    vintage.slug = QStringLiteral("vintage");
+    vintage.ffmpeg = QStringLiteral("curves=blue='0/0 0.5/0.4 1/1',vignette=PI/3");
+    vintage.params = {FilterParam{QStringLiteral("intensity"), 0.8f, 0.0f, 1.0f},
+                      FilterParam{QStringLiteral("vignette"), 0.6f, 0.0f, 1.0f},
+                      FilterParam{QStringLiteral("grain"), 0.04f, 0.0f, 1.0f},
+                      FilterParam{QStringLiteral("contrast"), 0.15f, -1.0f, 1.0f},
+                      FilterParam{QStringLiteral("seed"), 0.0f, 0.0f, 16777215.0f}};
+    vintage.traits = FilterInPlace;
+    vintage.prepareRows = [](int w, int h, int firstRow, int lastRow, const FilterValues &v) -> BandKernel {
+        const float intensity = v.value(0, 0.8f);
+        const float vignette = v.value(1, 0.6f);
+        const float grain = v.value(2, 0.04f);
+        const float contrast = v.value(3, 0.15f);
+        if (intensity <= 0.0f && vignette <= 0.0f && grain <= 0.0f && fabs(contrast) < 1e-6f) {
+            return rowKernel([](QRgb *, int, int) {});
+        }
+        const VintageJob job = vintageJob(w, h, intensity, vignette, grain, contrast, quint32(v.value(4, 0.0f)),
+                                          firstRow, lastRow);
+        return [job](const QImage &band, int y0, const RowTarget &out) {
+            const int lineWidth = band.width();
+            for (int i = 0; i < band.height(); ++i) {
+                uchar *line = out.line(y0 + i);
+                if (line != band.constScanLine(i)) {
+                    std::memcpy(line, band.constScanLine(i), size_t(lineWidth) * sizeof(QRgb));
+                }
+            }
+            job.run(out, lineWidth, y0, y0 + band.height());
+        };
+    };
+    const auto vintageRows = vintage.prepareRows;
+    vintage.prepare = [vintageRows](int w, int h, const FilterValues &v) { return vintageRows(w, h, 0, h, v); };
+    registry.add(vintage);
+
+    FilterSpec vignette;
+    vignette.id = FilterId::Vignette;
+    vignette.code = QStringLiteral("вгн");
+    vignette.title = QStringLiteral("Виньетка");
+    vignette.slug = QStringLiteral("vignette");
+    vignette.ffmpeg = QStringLiteral("vignette=PI/4");
+    vignette.params = {FilterParam{QStringLiteral("amount"), 0.6f, 0.0f, 1.0f}};
+    vignette.traits = FilterInPlace;
+    vignette.prepareRows = [](int w, int h, int firstRow, int lastRow, const FilterValues &v) -> BandKernel {
+        const float amount = v.value(0, 0.6f);
+        if (amount <= 0.0f) {
+            return rowKernel([](QRgb *, int, int) {});
+        }
+        // та же маска, что у винтажа, множитель Q15
+        const std::shared_ptr<const VignetteMask> mask = firstRow == 0 && lastRow == h
+                                                             ? vignetteMask(w, h, amount)
+                                                             : buildVignetteMaskRows(w, h, amount, firstRow, lastRow);
+        return rowKernel([mask](QRgb *line, int w, int y) {
+            const qint16 *factors = mask->row(y);
+            for (int x = 0; x < w; ++x) {
+                const int f = factors[x];
+                const QRgb p = line[x];
+                line[x] = qRgba((qRed(p) * f + 0x4000) >> 15, (qGreen(p) * f + 0x4000) >> 15,
+                                (qBlue(p) * f + 0x4000) >> 15, qAlpha(p));
+            }
+        });
+    };
+    const auto vignetteRows = vignette.prepareRows;
+    vignette.prepare = [vignetteRows](int w, int h, const FilterValues &v) { return vignetteRows(w, h, 0, h, v); };
+    registry.add(vignette);
+
+    // Флойд–Стейнберг тянет ошибку в соседние пиксели, поэтому только целым кадром.
+    FilterSpec posterizeDither;
+    posterizeDither.id = FilterId::PosterizeDither;
+    posterizeDither.code = QStringLiteral("пдз");
+    posterizeDither.title = QStringLiteral("Постеризация с диффузией");
+    posterizeDither.slug = QStringLiteral("posterize_dither");
+    posterizeDither.ffmpeg = posterize.ffmpeg;
+    posterizeDither.params = posterize.params;
+    posterizeDither.traits = FilterNeedsNeighbors;
+    posterizeDither.whole = [](const QImage &src, const FilterValues &v) {
+        return posterizeEffect(src, qMax(2, int(v.value(0, 12.0f))), PosterizeDither::FloydSteinberg);
+    };
+    // полосами: ошибки последней строки полосы переносятся в следующую
+    posterizeDither.stream = [](int, int, const FilterValues &v) -> BandKernel {
+        struct Carry {
+            std::vector<DiffusionError> above;
+            std::vector<DiffusionError> below;
+            bool first = true;
+        };
+        const ChannelLut *lut = &posterizeLut(qMax(2, int(v.value(0, 12.0f))));
+        auto carry = std::make_shared<Carry>();
+        return [lut, carry](const QImage &band, int y0, const RowTarget &out) {
+            const int lineWidth = band.width();
+            for (int i = 0; i < band.height(); ++i) {
+                uchar *line = out.line(y0 + i);
+                if (line != band.constScanLine(i)) {
+                    std::memcpy(line, band.constScanLine(i), size_t(lineWidth) * sizeof(QRgb));
+                }
+            }
+            floydSteinbergRows(out.line(y0), out.bytesPerLine, lineWidth, band.height(), *lut,
+                               carry->first ? nullptr : &carry->above, &carry->below);
+            carry->above.swap(carry->below);
+            carry->first = false;
+        };
+    };
+    registry.add(posterizeDither);
+}
+
+static QString filterSlug(const QString &code) {
+    if (const FilterSpec *spec = findFilter(code)) {
+        return spec->slug;
+    }
+
+    QString simplified = code.simplified();
+    simplified.replace(QChar(' '), QChar('_'));
+    QString sanitized;
+    sanitized.reserve(simplified.size());
+    for (const QChar ch : simplified) {
+        if (ch.isLetterOrNumber() && ch.unicode() < 128) {
+            sanitized.append(ch);
+        }
+    }
+    if (sanitized.isEmpty()) {
+        sanitized = QString::number(qHash(code));
+    }
+    return sanitized;
+}
+
+// Кадр-rvalue фильтры с FilterInPlace меняют на месте, если он ни с кем не
+// разделён; остальные пишут в кадр из пула.
+static QImage applyFilter(QImage &&source, const FilterSpec &spec, const FilterValues &values) {
+    if (source.isNull() || spec.id == FilterId::None) {
+        return std::move(source);
+    }
+    TraceScope scope("filter.apply", spec.code);
+    if (spec.has(FilterNeedsNeighbors)) {
+        return spec.whole(source, values);
+    }
+
+    QImage src;
+    {
+        TraceScope convertScope("image.convert");
+        src = spec.has(FilterInPlace) ? ownedArgb32(std::move(source)) : argb32View(source);
+    }
+    const int w = src.width();
+    const int h = src.height();
+    const int bpl = src.bytesPerLine();
+    const BandKernel kernel = spec.prepare(w, h, values);
+
+    // на месте полосы читаются и пишутся в одну и ту же память
+    QImage result = spec.has(FilterInPlace) ? QImage() : pooledImage(w, h, spec.outputFormat);
+    const RowTarget out = spec.has(FilterInPlace) ? RowTarget{src.bits(), bpl, 0}
+                                                  : RowTarget{result.bits(), result.bytesPerLine(), 0};
+    const uchar *bits = src.constBits();
+    parallelForRows(h, w, [&](int y0, int y1) {
+        const QImage band(bits + size_t(y0) * bpl, w, y1 - y0, bpl, QImage::Format_ARGB32);
+        kernel(band, y0, out);
+    });
+    return spec.has(FilterInPlace) ? src : result;
+}
+
+static QImage applyFilter(const QImage &source, const FilterSpec &spec, const FilterValues &values) {
+    return applyFilter(QImage(source), spec, values);
+}
+
+static QImage applyFilter(QImage &&source, const QString &type) {
+    const FilterSpec *spec = findFilter(type);
+    if (!spec) {
+        return std::move(source);
+    }
+    return applyFilter(std::move(source), *spec, spec->defaults());
+}
+
+static QImage applyFilter(const QImage &source, const QString &type) {
+    return applyFilter(QImage(source), type);
+}
+
+// Как applyFilter, но результат пишется в *target: его буфер переиспользуется,
+// если размер и формат уже подходят, иначе пересоздаётся. source — ARGB32.
+// Нужен тем, кто фильтрует поток кадров одного размера и не хочет выделять
+// кадр на каждый вызов; фильтры с FilterNeedsNeighbors всё равно считают
+// новый кадр целиком.
+static void applyFilterInto(const QImage &source, const FilterSpec &spec, const FilterValues &values, QImage *target) {
+    TraceScope scope("filter.apply", spec.code);
+    if (spec.has(FilterNeedsNeighbors)) {
+        *target = spec.whole(source, values);
+        return;
+    }
+
+    const int w = source.width();
+    const int h = source.height();
+    if (target->width() != w || target->height() != h || target->format() != spec.outputFormat) {
+        *target = pooledImage(w, h, spec.outputFormat);
+    }
+    const int bpl = source.bytesPerLine();
+    const BandKernel kernel = spec.prepare(w, h, values);
+    const RowTarget out{target->bits(), target->bytesPerLine(), 0};
+    const uchar *bits = source.constBits();
+    parallelForRows(h, w, [&](int y0, int y1) {
+        const QImage band(bits + size_t(y0) * bpl, w, y1 - y0, bpl, QImage::Format_ARGB32);
+        kernel(band, y0, out);
+    });
+}
+
+// Полоса около 256 КБ помещается в L2, и все выходы читают её уже из кэша.
+static const int fusedBandBytes = 256 * 1024;
+
+// Все фильтры из codes за один проход: исходник один раз приводится к ARGB32 и
+// читается полосами, каждая полоса сразу раскладывается по всем выходам.
+// Фильтрам, которым нужны соседние пиксели, отдаётся весь кадр отдельно.
+// Параметры у всех фильтров — по умолчанию, как в applyFilter; неизвестные коды
+// дают копию исходника.
+static QList<QImage> applyFilters(const QImage &source, const QList<QString> &codes) {
+    QList<QImage> results;
+    if (source.isNull() || codes.isEmpty()) {
+        return results;
+    }
+    TraceScope scope("filter.fused");
+    if (scope.active()) {
+        scope.setDetail(QStringList(codes).join(QLatin1Char(',')));
+    }
+
+    QImage src;
+    {
+        TraceScope convertScope("image.convert");
+        src = argb32View(source);
+    }
+    const int w = src.width();
+    const int h = src.height();
+
+    struct FusedOutput {
+        QImage image;
+        BandKernel kernel; // пустой — выход считается целым кадром
+        RowTarget target;
+    };
+    std::vector<FusedOutput> outputs;
+    outputs.reserve(size_t(codes.size()));
+    const FilterSpec *none = findFilter(FilterId::None);
+    for (const QString &code : codes) {
+        const FilterSpec *spec = findFilter(code);
+        if (!spec) {
+            spec = none;
+        }
+
+        FusedOutput o;
+        if (spec->has(FilterNeedsNeighbors)) {
+            o.image = spec->whole(src, spec->defaults());
+            o.target = RowTarget{nullptr, 0, 0};
+        } else {
+            o.image = pooledImage(w, h, spec->outputFormat);
+            o.kernel = spec->prepare(w, h, spec->defaults());
+            o.target = RowTarget{o.image.bits(), o.image.bytesPerLine(), 0};
+        }
+        outputs.push_back(o);
+    }
+
+    const int bandRows = qMax(1, fusedBandBytes / qMax(1, src.bytesPerLine()));
+    parallelForRows(h, w, [&](int from, int to) {
+        for (int y0 = from; y0 < to; y0 += bandRows) {
+            const int rows = qMin(bandRows, to - y0);
+            const QImage band(src.constScanLine(y0), w, rows, src.bytesPerLine(), QImage::Format_ARGB32);
+            for (const FusedOutput &o : outputs) {
+                if (o.kernel) {
+                    o.kernel(band, y0, o.target);
+                }
+            }
+        }
+    });
+
+    for (const FusedOutput &o : outputs) {
+        results.append(o.image);
+    }
+    return results;
+}
+
+// Самопроверка цепочек (часть --selftest): слитый проход цепочки — и один,
+// и в совместном проходе applyFilters — побитово совпадает с применением её
+// стадий по очереди через applyFilter. Кадры разного размера, в том числе
+// больше порога пула и с высотой, не кратной полосам потоков.
+static bool selfTestFilterChains()
+{
+    const QStringList chains = {
+        QStringLiteral("теп+пос:4+вгн"),       // таблицы сливаются, затем виньетка
+        QStringLiteral("нег+теп:0.3+хол:0.2"), // только таблицы: одна таблица
+        QStringLiteral("сеп+сол:100+чб"),      // последняя стадия пишет серый кадр
+        QStringLiteral("чб+сол+нег"),          // серый кадр посередине
+        QStringLiteral("вгн:0.3+пдз:6+теп"),   // граница прохода у диффузии
+        QStringLiteral("пдз:3+сеп"),
+    };
+    const QSize sizes[] = {QSize(97, 61), QSize(640, 357)};
+
+    std::mt19937 rng(20240715u);
+    bool ok = true;
+    for (const QSize &size : sizes) {
+        QImage source(size, QImage::Format_ARGB32);
+        for (int y = 0; y < source.height(); ++y) {
+            QRgb *line = reinterpret_cast<QRgb*>(source.scanLine(y));
+            for (int x = 0; x < source.width(); ++x) {
+                line[x] = static_cast<QRgb>(rng());
+            }
+        }
+
+        for (const QString &expression : chains) {
+            QList<FilterStage> stages;
+            QString error;
+            const FilterSpec *chain = registerFilterChain(expression, expression, expression, &error);
+            if (!chain || !parseFilterChain(expression, &stages, &error)) {
+                qWarning() << "Цепочка" << expression << "не разбирается:" << error;
+                ok = false;
+                continue;
+            }
+            QImage expected = source;
+            for (const FilterStage &stage : stages) {
+                expected = applyFilter(expected, *stage.spec, stage.values);
+            }
+
+            const QImage fused = applyFilter(source, *chain, chain->defaults());
+            const QImage joint = applyFilters(source, QList<QString>() << QStringLiteral("нег") << expression).last();
+            for (const QImage &actual : {fused, joint}) {
+                bool same = actual.format() == expected.format() && actual.size() == expected.size();
+                const size_t lineBytes = size_t(expected.width()) * size_t(expected.depth() / 8);
+                for (int y = 0; same && y < expected.height(); ++y) {
+                    same = std::memcmp(actual.constScanLine(y), expected.constScanLine(y), lineBytes) == 0;
+                }
+                if (!same) {
+                    qWarning() << "Цепочка" << expression << "расходится с последовательным применением, кадр" << size;
+                    ok = false;
+                }
+            }
+        }
+    }
+    // выражение ffmpeg есть только у цепочек без своих параметров, а поиск цепочек не регистрирует
+    const FilterSpec *plain = findFilter(QStringLiteral("чб+сол+нег"));
+    const FilterSpec *tuned = findFilter(QStringLiteral("теп+пос:4+вгн"));
+    if (!plain || plain->ffmpeg.isEmpty() || !tuned || !tuned->ffmpeg.isEmpty()) {
+        qWarning() << "Выражение ffmpeg цепочки не учитывает параметры стадий";
+        ok = false;
+    }
+    if (findFilter(QStringLiteral("нег+нег+нег"))) {
+        qWarning() << "Поиск фильтра зарегистрировал цепочку";
+        ok = false;
+    }
+    qInfo() << "Цепочки фильтров" << (ok ? "совпадают с последовательным применением" : "НЕ совпадают с последовательным применением");
+    return ok;
+}
+
+// Предпросмотр в окне снимка. Фильтр применяется не к полному кадру, а к его
+// уменьшенной до размера окна копии (прокси), и не в потоке интерфейса.
+// Готовые миниатюры кэшируются по (снимок, фильтр), так что повторное
+// пролистывание фильтров ничего не считает. Миниатюра хранится как QFuture:
+// запрос к ещё считающейся миниатюре ждёт ту же задачу, а не запускает новую.
+static const int previewWidth = 640;
+static const int previewHeight = 360;
+
+struct PreviewCache {
+    static const int maxThumbnails = 24; // ~0.9 МБ каждая
+    static const int maxProxies = 4;
+
+    struct Thumbnail {
+        qint64 image;
+        QString code;
+        QFuture<QImage> future;
+    };
+
+    QMutex mutex;
+    QList<Thumbnail> thumbnails;              // свежие в начале
+    QList<QPair<qint64, QImage>> proxies;     // свежие в начале
+};
+
+static PreviewCache &previewCache() {
+    static PreviewCache cache;
+    return cache;
+}
+
+static QImage previewProxy(const QImage &source) {
+    PreviewCache &cache = previewCache();
+    const qint64 key = source.cacheKey();
+    {
+        QMutexLocker locker(&cache.mutex);
+        for (int i = 0; i < cache.proxies.size(); ++i) {
+            if (cache.proxies.at(i).first == key) {
+                cache.proxies.move(i, 0);
+                return cache.proxies.first().second;
+            }
+        }
+    }
+
+    // уменьшение — без блокировки: одновременный второй запрос просто посчитает его ещё раз
+    TraceScope scope("preview.proxy");
+    const QImage proxy = source.scaled(previewWidth, previewHeight, Qt::KeepAspectRatio, Qt::SmoothTransformation)
+                             .convertToFormat(QImage::Format_ARGB32);
+    QMutexLocker locker(&cache.mutex);
+    cache.proxies.prepend(qMakePair(key, proxy));
+    while (cache.proxies.size() > PreviewCache::maxProxies) {
+        cache.proxies.removeLast();
+    }
+    return proxy;
+}
+
+// Миниатюры для codes, которых ещё нет в кэше, считаются одной фоновой задачей
+// совместным проходом applyFilters по прокси.
+static QList<QFuture<QImage>> previewThumbnails(const QImage &source, const QList<QString> &codes) {
+    PreviewCache &cache = previewCache();
+    const qint64 key = source.cacheKey();
+    QList<QFuture<QImage>> futures;
+    QList<QString> missing;
+    QList<QFutureInterface<QImage>> pending;
+    {
+        QMutexLocker locker(&cache.mutex);
+        for (const QString &code : codes) {
+            int found = -1;
+            for (int i = 0; i < cache.thumbnails.size(); ++i) {
+                if (cache.thumbnails.at(i).image == key && cache.thumbnails.at(i).code == code) {
+                    found = i;
+                    break;
+                }
+            }
+            if (found >= 0) {
+                cache.thumbnails.move(found, 0);
+                futures.append(cache.thumbnails.first().future);
+                continue;
+            }
+
+            QFutureInterface<QImage> thumbnail;
+            thumbnail.reportStarted();
+            PreviewCache::Thumbnail entry;
+            entry.image = key;
+            entry.code = code;
+            entry.future = thumbnail.future();
+            cache.thumbnails.prepend(entry);
+            futures.append(entry.future);
+            missing.append(code);
+            pending.append(thumbnail);
+        }
+        while (cache.thumbnails.size() > PreviewCache::maxThumbnails) {
+            cache.thumbnails.removeLast(); // считающаяся миниатюра всё равно достанется ждущим
+        }
+    }
+
+    if (!missing.isEmpty()) {
+        const qint64 queued = traceMark();
+        QtConcurrent::run([source, missing, pending, queued]() mutable {
+            traceSince("preview.queue_wait", queued);
+            TraceScope scope("preview.thumbnails");
+            const QList<QImage> filtered = applyFilters(previewProxy(source), missing);
+            for (int i = 0; i < pending.size(); ++i) {
+                pending[i].reportResult(filtered.at(i));
+                pending[i].reportFinished();
+            }
+        });
+    }
+    return futures;
+}
+
+// Заранее считает миниатюры всех отмеченных фильтров, чтобы "->" их только показывал.
+static void prefetchPreviews(const QImage &source, const QList<QString> &codes) {
+    if (!source.isNull() && !codes.isEmpty()) {
+        previewThumbnails(source, codes);
+    }
+}
+
+// Показывает в lbl миниатюру img с фильтром type. Возвращается сразу; если
+// миниатюры ещё нет, она появится, когда посчитается, — если к тому времени
+// в lbl не запросили другую.
+void setpic(QImage *img, QLabel *lbl, QString type) {
+    if (!lbl) {
+        return;
+    }
+    if (!img || img->isNull()) {
+        lbl->setProperty("previewImage", QVariant());
+        lbl->clear();
+        return;
+    }
+
+    const qint64 key = img->cacheKey();
+    lbl->setProperty("previewImage", key);
+    lbl->setProperty("previewFilter", type);
 
-    const float contrastMul = 1.0f + contrast * 0.6f;
+    const QFuture<QImage> thumbnail = previewThumbnails(*img, QList<QString>() << type).first();
+    if (thumbnail.isFinished()) {
+        TraceScope scope("preview.show", type);
+        lbl->setPixmap(QPixmap::fromImage(thumbnail.result()));
+        return;
+    }
 
-    std::mt19937 rng((unsigned)std::random_device{}());
-    std::uniform_real_distribution<float> distUniform(-1.0f, 1.0f);
+    // от запроса до показа: сколько пользователь ждал миниатюру
+    const qint64 requested = traceMark();
+    auto *watcher = new QFutureWatcher<QImage>(lbl);
+    QObject::connect(watcher, &QFutureWatcher<QImage>::finished, lbl, [watcher, lbl, key, type, requested]() {
+        watcher->deleteLater();
+        if (lbl->property("previewImage").toLongLong() == key && lbl->property("previewFilter").toString() == type) {
+            TraceScope scope("preview.show", type);
+            lbl->setPixmap(QPixmap::fromImage(watcher->future().result()));
+            traceSince("preview.latency", requested, type);
+        }
+    });
+    watcher->setFuture(thumbnail);
+}
 
-    const float toneAmount = 0.25f * intensity;
-    const float desatAmount = 0.25f * intensity;
-    const float vignetteAmount = vignette * intensity;
-    const float grainAmount = grain;
+// Выход экспорта: фильтр, файл и QFutureInterface, через который сообщаются
+// прогресс и результат, даже если выход считается в общей задаче с другими.
+struct EncodedOutput {
+    QString code;
+    QString filePath;
+    QFutureInterface<bool> result;
+};
+
+// Сколько отфильтрованных кадров снимка может одновременно ждать записи.
+static const int imageExportFrames = 3;
+
+// Сохранение снимка идёт потоком: фильтры считаются группами (совместным
+// проходом applyFilters) в фоновой задаче, каждый результат сразу уходит в
+// свою задачу записи и освобождается, как только записан. В памяти не
+// больше maxFrames отфильтрованных кадров, сколько бы фильтров ни было
+// отмечено: следующая группа ждёт, пока запись освободит место. Результат
+// пишется в своём формате (у "чб" — 8-битный серый), без перевода в ARGB32;
+// формат файла и сжатие задаёт encoding.
+QList<QFuture<bool>> saveFilteredImages(const QImage &sourceImage, QList<QString> filters, const QString &directory,
+                                        const ImageEncodeOptions &encoding = ImageEncodeOptions(),
+                                        int maxFrames = imageExportFrames) {
+    QList<QFuture<bool>> tasks;
+    if (sourceImage.isNull()) {
+        return tasks;
+    }
+    if (filters.isEmpty()) {
+        return tasks;
+    }
 
-    for (int y = 0; y < h; ++y) {
-        QRgb *line = reinterpret_cast<QRgb*>(img.scanLine(y));
-        for (int x = 0; x < w; ++x) {
-            QRgb p = line[x];
-            int a = qAlpha(p);
-            float r = qRed(p);
-            float g = qGreen(p);
-            float b = qBlue(p);
+    filters.removeDuplicates();
 
-            float lum = 0.299f * r + 0.587f * g + 0.114f * b;
-            r = r * (1.0f - desatAmount) + lum * desatAmount;
-            g = g * (1.0f - desatAmount) + lum * desatAmount;
-            b = b * (1.0f - desatAmount) + lum * desatAmount;
+    QDir targetDir(directory);
+    if (!targetDir.exists()) {
+        targetDir.mkpath(QStringLiteral("."));
+    }
 
-            r = r + (255.0f - r) * (0.30f * toneAmount);
-            g = g + (255.0f - g) * (0.12f * toneAmount);
-            b = b * (1.0f - 0.20f * toneAmount);
+    const QString baseName = QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd_HHmmss"));
+    auto outputs = std::make_shared<QList<EncodedOutput>>();
+    int index = 0;
 
-            r = (r - 128.0f) * contrastMul + 128.0f;
-            g = (g - 128.0f) * contrastMul + 128.0f;
-            b = (b - 128.0f) * contrastMul + 128.0f;
+    for (const QString &code : filters) {
+        const QString slug = filterSlug(code);
+        const QString fileName = QStringLiteral("%1_%2_%3.%4")
+                                     .arg(baseName)
+                                     .arg(index, 2, 10, QLatin1Char('0'))
+                                     .arg(slug.isEmpty() ? QStringLiteral("image") : slug)
+                                     .arg(imageFormatSuffix(encoding.format));
+
+        EncodedOutput output;
+        output.code = code;
+        output.filePath = targetDir.filePath(fileName);
+        output.result.reportStarted();
+        tasks.append(output.result.future());
+        outputs->append(output);
+        ++index;
+    }
 
-            if (vignetteAmount > 0.0f) {
-                float dx = x - cx;
-                float dy = y - cy;
-                float d = std::sqrt(dx*dx + dy*dy);
-                float t = d / maxDist; // 0..1
-                float vign = 1.0f - vignetteAmount * (t * t);
-                if (vign < 0.0f) vign = 0.0f;
-                r *= vign;
-                g *= vign;
-                b *= vign;
+    auto frameSlots = std::make_shared<QSemaphore>(qMax(1, maxFrames));
+    QImage source;
+    {
+        TraceScope scope("image.convert");
+        source = argb32View(sourceImage);
+    }
+    QtConcurrent::run([source, outputs, frameSlots, encoding]() {
+        QThreadPool *pool = QThreadPool::globalInstance();
+        int next = 0;
+        while (next < outputs->size()) {
+            // место под первый кадр группы ждём, отдав поток пулу, остальные — сколько свободно
+            {
+                TraceScope scope("image.slot_wait");
+                pool->releaseThread();
+                frameSlots->acquire();
+                pool->reserveThread();
             }
-
-            if (grainAmount > 0.0f) {
-                float n = distUniform(rng) * grainAmount * 255.0f;
-                r += n;
-                g += n;
-                b += n;
+            int taken = 1;
+            while (next + taken < outputs->size() && frameSlots->tryAcquire()) {
+                ++taken;
             }
 
-            int nr = qBound(0, int(std::round(r)), 255);
-            int ng = qBound(0, int(std::round(g)), 255);
-            int nb = qBound(0, int(std::round(b)), 255);
-            line[x] = qRgba(nr, ng, nb, a);
+            QList<QString> codes;
+            QList<int> indices;
+            for (int i = next; i < next + taken; ++i) {
+                EncodedOutput &output = (*outputs)[i];
+                if (output.result.isCanceled()) {
+                    output.result.reportFinished();
+                    frameSlots->release();
+                    continue;
+                }
+                codes.append(output.code);
+                indices.append(i);
+            }
+            next += taken;
+
+            QList<QImage> filtered = applyFilters(source, codes);
+            for (int k = 0; k < indices.size(); ++k) {
+                EncodedOutput output = outputs->at(indices.at(k));
+                QImage image = filtered.at(k);
+                const qint64 queued = traceMark();
+                QtConcurrent::run(pool, [output, image, frameSlots, encoding, queued]() mutable {
+                    traceSince("image.write_wait", queued);
+                    TraceScope scope("image.output", output.code);
+                    bool ok = false;
+                    if (!output.result.isCanceled()) {
+                        output.result.setProgressRange(0, 1);
+                        ok = writeImage(image, output.filePath, encoding);
+                        if (!ok) {
+                            qWarning() << "Не удалось сохранить" << output.filePath;
+                        } else if (output.result.isCanceled()) {
+                            QFile::remove(output.filePath); // отменили во время записи
+                        } else {
+                            output.result.setProgressValue(1);
+                        }
+                    }
+                    image = QImage(); // кадр освобождается раньше, чем его место отдаётся следующему
+                    frameSlots->release();
+                    output.result.reportResult(ok);
+                    output.result.reportFinished();
+                });
+            }
+            filtered.clear(); // теперь каждый кадр держит только его задача записи
         }
-    }
+    });
 
-    return img;
+    return tasks;
 }
 
-QImage warmFilter(const QImage &src, float intensity = 0.6f)
-{
-    if (intensity <= 0.0f) return src;
-    if (intensity > 1.0f) intensity = 1.0f;
-
-    QImage img = src.convertToFormat(QImage::Format_ARGB32);
-    const int h = img.height();
-    for (int y = 0; y < h; ++y) {
-        QRgb *line = reinterpret_cast<QRgb*>(img.scanLine(y));
-        const int w = img.width();
-        for (int x = 0; x < w; ++x) {
-            QRgb p = line[x];
-            int a = qAlpha(p);
-            int r = qRed(p);
-            int g = qGreen(p);
-            int b = qBlue(p);
-
-            // повышаем R ближе к 255, чуть увеличиваем G, уменьшаем B
-            int nr = int(std::round(r + (255 - r) * (0.45f * intensity)));
-            int ng = int(std::round(g + (255 - g) * (0.20f * intensity)));
-            int nb = int(std::round(b * (1.0f - 0.25f * intensity)));
-
-            line[x] = qRgba(qBound(0, nr, 255), qBound(0, ng, 255), qBound(0, nb, 255), a);
-        }
-    }
-    return img;
+static QString ffmpegFilterForCode(const QString &code) {
+    const FilterSpec *spec = findFilter(code);
+    return spec ? spec->ffmpeg : QString();
 }
 
-QImage coldFilter(const QImage &src, float intensity = 0.6f)
-{
-    if (intensity <= 0.0f) return src;
-    if (intensity > 1.0f) intensity = 1.0f;
-
-    QImage img = src.convertToFormat(QImage::Format_ARGB32);
-    const int h = img.height();
-    for (int y = 0; y < h; ++y) {
-        QRgb *line = reinterpret_cast<QRgb*>(img.scanLine(y));
-        const int w = img.width();
-        for (int x = 0; x < w; ++x) {
-            QRgb p = line[x];
-            int a = qAlpha(p);
-            int r = qRed(p);
-            int g = qGreen(p);
-            int b = qBlue(p);
+static bool runFfmpeg(const QString &ffmpegPath, const QStringList &arguments, const QString &what) {
+    TraceScope scope("ffmpeg.run", what);
+    QProcess process;
+    process.start(ffmpegPath, arguments, QIODevice::ReadOnly);
+    const bool started = process.waitForStarted();
+    if (!started) {
+        qWarning() << "Не удалось запустить ffmpeg для" << what;
+        return false;
+    }
 
-            int nb = int(std::round(b + (255 - b) * (0.45f * intensity)));
-            int ng = int(std::round(g + (255 - g) * (0.12f * intensity)));
-            int nr = int(std::round(r * (1.0f - 0.30f * intensity)));
+    if (!process.waitForFinished(-1)) {
+        qWarning() << "ffmpeg не завершился корректно для" << what;
+        return false;
+    }
 
-            line[x] = qRgba(qBound(0, nr, 255), qBound(0, ng, 255), qBound(0, nb, 255), a);
-        }
+    const int exitCode = process.exitCode();
+    if (exitCode != 0) {
+        qWarning() << "ffmpeg завершился с ошибкой" << exitCode << "для" << what;
+        return false;
     }
-    return img;
+    return true;
 }
 
-QImage posterizeEffect(const QImage &srcImage, int levels = 12, bool dither = false)
-{
-    if (levels < 2) levels = 2;
-    QImage img = srcImage.convertToFormat(QImage::Format_ARGB32);
-    const int w = img.width();
-    const int h = img.height();
-
-    std::vector<int> lut(256);
-    const int steps = levels - 1;
-    for (int v = 0; v < 256; ++v) {
-        int idx = int(std::round((v * 1.0f * steps) / 255.0f));
-        int quant = int(std::round((idx * 255.0f) / (float)steps));
-        lut[v] = clampInt(quant);
+static bool removeExistingFile(const QString &filePath) {
+    if (QFile::exists(filePath) && !QFile::remove(filePath)) {
+        qWarning() << "Не удалось перезаписать" << filePath;
+        return false;
     }
+    return true;
+}
 
-    if (!dither) {
-        for (int y = 0; y < h; ++y) {
-            QRgb *line = reinterpret_cast<QRgb*>(img.scanLine(y));
-            for (int x = 0; x < w; ++x) {
-                QRgb p = line[x];
-                int a = qAlpha(p);
-                int r = quantizeLUTValue(qRed(p), lut);
-                int g = quantizeLUTValue(qGreen(p), lut);
-                int b = quantizeLUTValue(qBlue(p), lut);
-                line[x] = qRgba(r, g, b, a);
-            }
+// Вызывается, когда процессы выходов уже остановлены: у отменённых выходов
+// здесь удаляется недописанный файл.
+static void reportEncoded(QList<EncodedOutput> &outputs, const QVector<bool> &ok) {
+    for (int i = 0; i < outputs.size(); ++i) {
+        EncodedOutput &output = outputs[i];
+        if (output.result.isCanceled()) {
+            QFile::remove(output.filePath);
+        } else {
+            output.result.reportResult(ok.value(i) && QFile::exists(output.filePath));
         }
-        return img;
+        output.result.reportFinished();
     }
+}
 
-    struct RGBf { float r, g, b; unsigned char a; };
-    std::vector<RGBf> buf(w * h);
-    for (int y = 0; y < h; ++y) {
-        const QRgb *sline = reinterpret_cast<const QRgb*>(srcImage.constScanLine(y));
-        for (int x = 0; x < w; ++x) {
-            QRgb p = sline[x];
-            RGBf &c = buf[y * w + x];
-            c.r = static_cast<float>(qRed(p));
-            c.g = static_cast<float>(qGreen(p));
-            c.b = static_cast<float>(qBlue(p));
-            c.a = static_cast<unsigned char>(qAlpha(p));
+// Выходы, отменённые пока задача ждала в очереди, завершаются сразу и в
+// экспорт не попадают.
+static void finishCanceled(QList<EncodedOutput> &outputs) {
+    for (int i = outputs.size() - 1; i >= 0; --i) {
+        if (outputs.at(i).result.isCanceled()) {
+            outputs[i].result.reportFinished();
+            outputs.removeAt(i);
         }
     }
-    QImage dst(w, h, QImage::Format_ARGB32);
-
-    auto quantizeChannel = [&](float v, const std::vector<int> &lut) -> int {
-        int vi = clampInt(int(std::round(v)));
-        return lut[vi];
-    };
-
-    for (int y = 0; y < h; ++y) {
-        for (int x = 0; x < w; ++x) {
-            RGBf &c = buf[y * w + x];
-            int oldR = clampInt(int(std::round(c.r)));
-            int oldG = clampInt(int(std::round(c.g)));
-            int oldB = clampInt(int(std::round(c.b)));
-
-            int newR = quantizeChannel(c.r, lut);
-            int newG = quantizeChannel(c.g, lut);
-            int newB = quantizeChannel(c.b, lut);
-
-            dst.setPixel(x, y, qRgba(newR, newG, newB, c.a));
-
-            float errR = oldR - newR;
-            float errG = oldG - newG;
-            float errB = oldB - newB;
-
-            auto addError = [&](int nx, int ny, float factor) {
-                if (nx < 0 || nx >= w || ny < 0 || ny >= h) return;
-                RGBf &nc = buf[ny * w + nx];
-                nc.r += errR * factor;
-                nc.g += errG * factor;
-                nc.b += errB * factor;
-            };
+}
 
-            addError(x + 1, y    , 7.0f / 16.0f);
-            addError(x - 1, y + 1, 3.0f / 16.0f);
-            addError(x    , y + 1, 5.0f / 16.0f);
-            addError(x + 1, y + 1, 1.0f / 16.0f);
+static bool allCanceled(const QList<EncodedOutput> &outputs) {
+    for (const EncodedOutput &output : outputs) {
+        if (!output.result.isCanceled()) {
+            return false;
         }
     }
-
-    return dst;
+    return true;
 }
 
+// Прогресс выхода в единицах total (кадры или миллисекунды); total == 0 — длина
+// неизвестна, прогресс не показывается.
+static void reportProgress(QList<EncodedOutput> &outputs, qint64 value, qint64 total) {
+    if (total <= 0) {
+        return;
+    }
+    for (EncodedOutput &output : outputs) {
+        output.result.setProgressRange(0, int(total));
+        output.result.setProgressValue(int(qBound<qint64>(0, value, total)));
+    }
+}
 
-QImage hardSolarizeInvert(const QImage &src, int threshold = 128)
-{
-    QImage img = src.convertToFormat(QImage::Format_ARGB32);
-    const int h = img.height();
-    for (int y = 0; y < h; ++y) {
-        QRgb *line = reinterpret_cast<QRgb*>(img.scanLine(y));
-        const int w = img.width();
-        for (int x = 0; x < w; ++x) {
-            QRgb p = line[x];
-            int a = qAlpha(p);
-            int r = qRed(p);
-            int g = qGreen(p);
-            int b = qBlue(p);
+// Длительность входа из журнала ffmpeg ("Duration: 00:01:02.50"), 0 — ещё нет.
+static qint64 ffmpegDurationMs(const QByteArray &log) {
+    const int at = log.indexOf("Duration: ");
+    if (at < 0 || log.size() < at + 21) {
+        return 0;
+    }
+    const QList<QByteArray> parts = log.mid(at + 10, 11).split(':');
+    if (parts.size() != 3) {
+        return 0;
+    }
+    const double seconds = parts.at(0).toInt() * 3600.0 + parts.at(1).toInt() * 60.0 + parts.at(2).toDouble();
+    return qint64(seconds * 1000.0);
+}
 
-            int lum = qGray(p);
-            if (lum > threshold) {
-                line[x] = qRgba(255 - 3*r, 255 - 3*g, 255 - 3*b, a);
-            }
+// Запасной путь без ffprobe: фильтры ffmpeg (приближения наших) в одном запуске,
+// split раздаёт декодированные кадры по веткам -filter_complex. Процесс ждётся
+// по сигналу finished, поток при этом не занят. Вызывается в потоке приложения.
+// Прогресс — out_time из -progress против Duration из журнала. Ветку графа
+// остановить нельзя, поэтому процесс убивается, когда отменены все выходы, а
+// файлы отменённых по одному удаляются после его завершения.
+static void startFilterGraphExport(const QString &videoPath, const QString &ffmpegPath,
+                                   const std::shared_ptr<QList<EncodedOutput>> &outputs, int threadsPerEncoder,
+                                   const std::function<void()> &done) {
+    finishCanceled(*outputs);
+    auto ok = std::make_shared<QVector<bool>>(outputs->size(), false);
+    QStringList branches;
+    QStringList codes;
+    QStringList maps;
+    for (int i = 0; i < outputs->size(); ++i) {
+        const EncodedOutput &output = outputs->at(i);
+        const QString filterExpr = ffmpegFilterForCode(output.code);
+        codes << output.code;
+        if (filterExpr.isEmpty() || !removeExistingFile(output.filePath)) {
+            continue;
         }
+        const int branch = branches.size();
+        branches << QStringLiteral("[s%1]%2[v%1]").arg(branch).arg(filterExpr);
+        maps << QStringLiteral("-map") << QStringLiteral("[v%1]").arg(branch)
+             << QStringLiteral("-map") << QStringLiteral("0:a?")
+             << QStringLiteral("-c:v") << QStringLiteral("libx264")
+             << QStringLiteral("-preset") << QStringLiteral("veryfast")
+             << QStringLiteral("-crf") << QStringLiteral("22")
+             << QStringLiteral("-threads") << QString::number(threadsPerEncoder)
+             << QStringLiteral("-c:a") << QStringLiteral("copy")
+             << output.filePath;
+        (*ok)[i] = true;
+    }
+    if (branches.isEmpty()) {
+        reportEncoded(*outputs, *ok);
+        done();
+        return;
     }
-    return img;
-}
 
-QImage toSepia(const QImage &srcImage) {
-    QImage img = srcImage.convertToFormat(QImage::Format_ARGB32);
+    QString graph = QStringLiteral("[0:v]split=%1").arg(branches.size());
+    for (int i = 0; i < branches.size(); ++i) {
+        graph += QStringLiteral("[s%1]").arg(i);
+    }
+    graph += QStringLiteral(";") + branches.join(QStringLiteral(";"));
+
+    QStringList arguments;
+    arguments << QStringLiteral("-y") << QStringLiteral("-nostats")
+              << QStringLiteral("-progress") << QStringLiteral("pipe:1")
+              << QStringLiteral("-i") << videoPath
+              << QStringLiteral("-filter_complex") << graph << maps;
+
+    const QString what = QStringLiteral("фильтров ") + codes.join(QStringLiteral(", "));
+    auto *process = new QProcess;
+    auto finished = std::make_shared<bool>(false);
+    const qint64 started = traceMark();
+    auto finish = [process, outputs, ok, done, finished, what, started](bool success) {
+        if (*finished) {
+            return;
+        }
+        *finished = true;
+        traceSince("ffmpeg.filtergraph", started, what); // процесс ждут по сигналам, без потока
 
-        const int h = img.height();
-        for (int y = 0; y < h; ++y) {
-            QRgb *line = reinterpret_cast<QRgb*>(img.scanLine(y));
-            const int w = img.width();
-            for (int x = 0; x < w; ++x) {
-                QRgb p = line[x];
-                int a = qAlpha(p);
-                int r = qRed(p);
-                int g = qGreen(p);
-                int b = qBlue(p);
+        if (!success) {
+            *ok = QVector<bool>(ok->size(), false);
+        }
+        reportEncoded(*outputs, *ok);
+        process->deleteLater();
+        done();
+    };
+    QObject::connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), process,
+                     [finish, what](int exitCode, QProcess::ExitStatus status) {
+                         const bool success = status == QProcess::NormalExit && exitCode == 0;
+                         if (!success) {
+                             qWarning() << "ffmpeg завершился с ошибкой" << exitCode << "для" << what;
+                         }
+                         finish(success);
+                     });
+    QObject::connect(process, &QProcess::errorOccurred, process, [finish, what](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart) {
+            qWarning() << "Не удалось запустить ffmpeg для" << what;
+            finish(false);
+        }
+    });
+    auto durationMs = std::make_shared<qint64>(0);
+    auto log = std::make_shared<QByteArray>();
+    QObject::connect(process, &QProcess::readyReadStandardError, process, [process, durationMs, log]() {
+        const QByteArray chunk = process->readAllStandardError();
+        if (*durationMs == 0) {
+            log->append(chunk);
+            *durationMs = ffmpegDurationMs(*log);
+        }
+    });
+    auto pendingLine = std::make_shared<QByteArray>();
+    QObject::connect(process, &QProcess::readyReadStandardOutput, process, [process, outputs, durationMs, pendingLine]() {
+        pendingLine->append(process->readAllStandardOutput());
+        int end;
+        while ((end = pendingLine->indexOf('\n')) >= 0) {
+            const QByteArray line = pendingLine->left(end).trimmed();
+            pendingLine->remove(0, end + 1);
+            // out_time_ms у старых ffmpeg на деле тоже в микросекундах
+            if (line.startsWith("out_time_us=") || line.startsWith("out_time_ms=")) {
+                reportProgress(*outputs, line.mid(12).toLongLong() / 1000, *durationMs);
+            }
+        }
+    });
 
-                int tr = qBound(0, static_cast<int>(0.393*r + 0.769*g + 0.189*b), 255);
-                int tg = qBound(0, static_cast<int>(0.349*r + 0.686*g + 0.168*b), 255);
-                int tb = qBound(0, static_cast<int>(0.272*r + 0.534*g + 0.131*b), 255);
+    process->start(ffmpegPath, arguments, QIODevice::ReadOnly);
 
-                line[x] = qRgba(tr, tg, tb, a);
+    for (EncodedOutput &output : *outputs) {
+        auto *watcher = new QFutureWatcher<bool>(process);
+        QObject::connect(watcher, &QFutureWatcher<bool>::canceled, process, [process, outputs]() {
+            if (allCanceled(*outputs)) {
+                process->kill();
             }
-        }
-        return img;
+        });
+        watcher->setFuture(output.result.future());
+    }
 }
 
-static QString filterSlug(const QString &code) {
-    static const QHash<QString, QString> mapping = {
-        {QStringLiteral("бф"), QStringLiteral("no_filter")},
-        {QStringLiteral("чб"), QStringLiteral("bw")},
-        {QStringLiteral("нег"), QStringLiteral("negative")},
-        {QStringLiteral("сеп"), QStringLiteral("sepia")},
-        {QStringLiteral("пос"), QStringLiteral("posterize")},
-        {QStringLiteral("сол"), QStringLiteral("solarize")},
-        {QStringLiteral("хол"), QStringLiteral("cold")},
-        {QStringLiteral("теп"), QStringLiteral("warm")},
-        {QStringLiteral("вин"), QStringLiteral("vintage")}
-    };
-
-    const QString slug = mapping.value(code);
-    if (!slug.isEmpty()) {
-        return slug;
+struct VideoInfo {
+    int width = 0;
+    int height = 0;
+    QString frameRate; // как в ffprobe: "30/1", "30000/1001"; с ней декодер и кодировщики
+    qint64 frames = 0; // оценка числа кадров при frameRate для прогресса; 0 — неизвестно
+};
+
+static bool probeVideo(const QString &ffprobePath, const QString &videoPath, VideoInfo *info) {
+    TraceScope scope("video.probe", videoPath);
+    QProcess probe;
+    probe.start(ffprobePath, QStringList()
+                                 << QStringLiteral("-v") << QStringLiteral("error")
+                                 << QStringLiteral("-select_streams") << QStringLiteral("v:0")
+                                 << QStringLiteral("-show_entries") << QStringLiteral("stream=width,height,avg_frame_rate,r_frame_rate,nb_frames:format=duration")
+                                 << QStringLiteral("-of") << QStringLiteral("default=noprint_wrappers=1")
+                                 << videoPath,
+                QIODevice::ReadOnly);
+    if (!probe.waitForStarted() || !probe.waitForFinished(-1) || probe.exitCode() != 0) {
+        return false;
     }
 
-    QString simplified = code.simplified();
-    simplified.replace(QChar(' '), QChar('_'));
-    QString sanitized;
-    sanitized.reserve(simplified.size());
-    for (const QChar ch : simplified) {
-        if (ch.isLetterOrNumber() && ch.unicode() < 128) {
-            sanitized.append(ch);
+    QString averageRate;
+    QString baseRate;
+    qint64 frames = 0;
+    double duration = 0.0;
+    const QStringList lines = QString::fromUtf8(probe.readAllStandardOutput()).split(QLatin1Char('\n'));
+    for (const QString &line : lines) {
+        const int eq = line.indexOf(QLatin1Char('='));
+        if (eq < 0) {
+            continue;
+        }
+        const QString key = line.left(eq).trimmed();
+        const QString value = line.mid(eq + 1).trimmed();
+        if (key == QStringLiteral("width")) {
+            info->width = value.toInt();
+        } else if (key == QStringLiteral("height")) {
+            info->height = value.toInt();
+        } else if (key == QStringLiteral("avg_frame_rate")) {
+            averageRate = value;
+        } else if (key == QStringLiteral("r_frame_rate")) {
+            baseRate = value;
+        } else if (key == QStringLiteral("nb_frames")) {
+            frames = value.toLongLong(); // "N/A" у некоторых контейнеров даёт 0
+        } else if (key == QStringLiteral("duration")) {
+            duration = value.toDouble();
         }
     }
-    if (sanitized.isEmpty()) {
-        sanitized = QString::number(qHash(code));
+    info->frameRate = (averageRate.isEmpty() || averageRate.startsWith(QLatin1Char('0'))) ? baseRate : averageRate;
+    // Кадры перегоняются с постоянной частотой frameRate, поэтому их столько,
+    // сколько её укладывается в длительность; nb_frames у ролика с переменной
+    // частотой другой и годится, только когда длительности нет.
+    info->frames = frames;
+    if (duration > 0.0) {
+        const QStringList rate = info->frameRate.split(QLatin1Char('/'));
+        const double fps = rate.size() == 2 && rate.at(1).toDouble() > 0.0
+                               ? rate.at(0).toDouble() / rate.at(1).toDouble()
+                               : info->frameRate.toDouble();
+        info->frames = qint64(duration * fps + 0.5);
     }
-    return sanitized;
+    return info->width > 0 && info->height > 0 && !info->frameRate.isEmpty() && !info->frameRate.startsWith(QLatin1Char('0'));
 }
 
-static QImage applyFilter(const QImage &source, const QString &type) {
-    if (source.isNull()) {
-        return source;
-    }
+// Части короче не делаются: запуск пары процессов и лишний IDR на границе
+// дороже выигрыша.
+static const qint64 videoSegmentMinUs = 4 * 1000 * 1000;
+
+// Часть ролика для encodeInProcess: от ключевого кадра startUs (время потока,
+// микросекунды) длиной durationUs (0 — до конца).
+struct VideoSegment {
+    qint64 startUs = 0;
+    qint64 durationUs = 0;
+    QStringList filePaths; // файл части (MPEG-TS) на каждый выход
+    int concurrent = 1;    // сколько частей кодируется одновременно
+};
+
+// Микросекунды как секунды для -ss и -t.
+static QString ffmpegSeconds(qint64 us) {
+    return QStringLiteral("%1.%2").arg(us / 1000000).arg(us % 1000000, 6, 10, QLatin1Char('0'));
+}
 
-    if (type == QStringLiteral("чб")) {
-        return source.convertToFormat(QImage::Format_Grayscale8);
+// Времена ключевых кадров видеопотока по возрастанию и время последнего кадра
+// в *endUs, в микросекундах. ffprobe читает только заголовки пакетов, без
+// декодирования. Время округляется вниз: -ss с ним не отрежет сам ключевой кадр.
+static bool probeKeyframes(const QString &ffprobePath, const QString &videoPath, QVector<qint64> *keyframes,
+                           qint64 *endUs) {
+    TraceScope scope("video.probe_keyframes", videoPath);
+    QProcess probe;
+    probe.start(ffprobePath, QStringList()
+                                 << QStringLiteral("-v") << QStringLiteral("error")
+                                 << QStringLiteral("-select_streams") << QStringLiteral("v:0")
+                                 << QStringLiteral("-show_entries") << QStringLiteral("stream=time_base:packet=pts,flags")
+                                 << QStringLiteral("-of") << QStringLiteral("default=noprint_wrappers=1")
+                                 << videoPath,
+                QIODevice::ReadOnly);
+    if (!probe.waitForStarted() || !probe.waitForFinished(-1) || probe.exitCode() != 0) {
+        return false;
     }
-    if (type == QStringLiteral("нег")) {
-        QImage neg = source.convertToFormat(QImage::Format_ARGB32);
-        neg.invertPixels(QImage::InvertRgb);
-        return neg;
+
+    qint64 num = 0;
+    qint64 den = 0;
+    qint64 pts = 0;
+    bool havePts = false; // у пакета бывает "N/A"
+    qint64 last = 0;
+    QVector<qint64> keyPts;
+    const QList<QByteArray> lines = probe.readAllStandardOutput().split('\n');
+    for (const QByteArray &line : lines) {
+        if (line.startsWith("pts=")) {
+            pts = line.mid(4).trimmed().toLongLong(&havePts);
+        } else if (line.startsWith("flags=")) {
+            if (havePts) {
+                if (line.indexOf('K') >= 0) {
+                    keyPts.append(pts);
+                }
+                last = qMax(last, pts);
+            }
+            havePts = false;
+        } else if (line.startsWith("time_base=")) {
+            const QList<QByteArray> parts = line.mid(10).trimmed().split('/');
+            if (parts.size() == 2) {
+                num = parts.at(0).toLongLong();
+                den = parts.at(1).toLongLong();
+            }
+        }
     }
-    if (type == QStringLiteral("сеп")) {
-        return toSepia(source);
+    if (num <= 0 || den <= 0 || keyPts.isEmpty()) {
+        return false;
     }
-    if (type == QStringLiteral("пос")) {
-        return posterizeEffect(source);
+    keyframes->clear();
+    std::sort(keyPts.begin(), keyPts.end());
+    for (qint64 key : keyPts) {
+        // у роликов с правкой монтажа первый кадр бывает раньше нуля
+        const qint64 us = qMax<qint64>(0, key * num * 1000000 / den);
+        if (keyframes->isEmpty() || keyframes->last() != us) {
+            keyframes->append(us);
+        }
     }
-    if (type == QStringLiteral("сол")) {
-        return hardSolarizeInvert(source);
+    *endUs = last * num * 1000000 / den;
+    return true;
+}
+
+// Делит ролик на parts частей по ключевым кадрам, как можно ровнее по времени.
+// Меньше двух частей не получилось — пустой список.
+static QList<VideoSegment> planVideoSegments(const QVector<qint64> &keyframes, qint64 endUs, int parts) {
+    QList<VideoSegment> segments;
+    const qint64 start = keyframes.first();
+    const qint64 total = endUs - start;
+    parts = int(qMin<qint64>(parts, total / videoSegmentMinUs));
+    if (parts < 2) {
+        return segments;
     }
-    if (type == QStringLiteral("хол")) {
-        return coldFilter(source);
+    QVector<qint64> bounds;
+    bounds.append(start);
+    for (int i = 1; i < parts; ++i) {
+        const qint64 target = start + total * i / parts;
+        qint64 best = -1;
+        for (qint64 key : keyframes) {
+            if (key - bounds.last() >= videoSegmentMinUs && endUs - key >= videoSegmentMinUs
+                && (best < 0 || std::llabs(key - target) < std::llabs(best - target))) {
+                best = key;
+            }
+        }
+        if (best > bounds.last()) {
+            bounds.append(best);
+        }
     }
-    if (type == QStringLiteral("теп")) {
-        return warmFilter(source);
+    if (bounds.size() < 2) {
+        return segments;
     }
-    if (type == QStringLiteral("вин")) {
-        return vintageFilter(source);
+    for (int i = 0; i < bounds.size(); ++i) {
+        VideoSegment segment;
+        segment.startUs = bounds.at(i);
+        segment.durationUs = i + 1 < bounds.size() ? bounds.at(i + 1) - bounds.at(i) : 0;
+        segment.concurrent = bounds.size();
+        segments.append(segment);
     }
-
-    return source;
+    return segments;
 }
 
-void setpic(QImage *img, QLabel *lbl, QString type) {
-    if (!lbl) {
-        return;
+// Пишет весь буфер в stdin процесса; без цикла событий QProcess отдаёт данные
+// только внутри waitForBytesWritten. Ждёт отрезками exportPollMs и бросает
+// запись, как только stop() вернёт true.
+static bool writeToProcess(QProcess &process, const char *data, qint64 size, const std::function<bool()> &stop) {
+    TraceScope scope("video.encode_write");
+    if (process.write(data, size) != size) {
+        return false;
     }
-    if (!img || img->isNull()) {
-        lbl->clear();
-        return;
+    while (process.bytesToWrite() > 0) {
+        if (stop()) {
+            return false;
+        }
+        if (!process.waitForBytesWritten(exportPollMs) && process.state() != QProcess::Running) {
+            return false;
+        }
     }
-
-    const QImage filtered = applyFilter(*img, type);
-    QPixmap pix = QPixmap::fromImage(filtered);
-    pix = pix.scaled(640, 360, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    lbl->setPixmap(pix);
+    return true;
 }
 
-QList<QFuture<bool>> saveFilteredImages(const QImage &sourceImage, QList<QString> filters, const QString &directory) {
-    QList<QFuture<bool>> tasks;
-    if (sourceImage.isNull()) {
-        return tasks;
+// Читает ровно size байт из stdout; false — поток кончился раньше или stop()
+// вернул true, пока данных не было.
+static bool readFromProcess(QProcess &process, char *data, qint64 size, const std::function<bool()> &stop) {
+    TraceScope scope("video.decode_read");
+    qint64 done = 0;
+    while (done < size) {
+        if (process.bytesAvailable() == 0) {
+            if (stop()) {
+                return false;
+            }
+            if (!process.waitForReadyRead(exportPollMs)) {
+                if (process.state() != QProcess::Running && process.bytesAvailable() == 0) {
+                    return false;
+                }
+                continue;
+            }
+        }
+        const qint64 got = process.read(data + done, size - done);
+        if (got < 0) {
+            return false;
+        }
+        done += got;
     }
-    if (filters.isEmpty()) {
-        return tasks;
+    return true;
+}
+
+// Видео через наши фильтры: ffmpeg только декодирует кадры в BGRA (это память
+// QImage::Format_ARGB32) и кодирует готовые кадры обратно, а фильтры те же, что
+// у фото, — applyFilters с SIMD/LUT-ядрами. Кадры фильтруются параллельно, до
+// числа потоков одновременно, и уходят в кодировщики строго по порядку: очередь
+// задач FIFO, записывается всегда самая старая. Прогресс — записанные кадры
+// против оценки из ffprobe. Кодировщик отменённого выхода убивается сразу, а
+// когда отменены все, останавливается и декодер. С segment кодируется только
+// эта часть ролика и без звука; framesWritten — общий счётчик кадров всех
+// частей для прогресса.
+static QVector<bool> encodeInProcess(const QString &videoPath, const QString &ffmpegPath, const VideoInfo &info,
+                                     QList<EncodedOutput> &outputs, int threadsPerEncoder,
+                                     const VideoSegment *segment = nullptr,
+                                     std::atomic<qint64> *framesWritten = nullptr) {
+    const int count = outputs.size();
+    QVector<bool> ok(count, false);
+    QList<QString> codes;
+    for (const EncodedOutput &output : outputs) {
+        codes.append(output.code);
     }
 
-    filters.removeDuplicates();
+    const int w = info.width;
+    const int h = info.height;
+    const qint64 frameBytes = qint64(w) * h * 4;
 
-    QDir targetDir(directory);
-    if (!targetDir.exists()) {
-        targetDir.mkpath(QStringLiteral("."));
+    QStringList decodeArguments;
+    decodeArguments << QStringLiteral("-v") << QStringLiteral("error");
+    if (segment) {
+        // -ss — абсолютное время потока, а не от начала файла: так оно совпадает с pts из ffprobe
+        decodeArguments << QStringLiteral("-seek_timestamp") << QStringLiteral("1")
+                        << QStringLiteral("-ss") << ffmpegSeconds(segment->startUs);
+    }
+    decodeArguments << QStringLiteral("-i") << videoPath;
+    if (segment && segment->durationUs > 0) {
+        decodeArguments << QStringLiteral("-t") << ffmpegSeconds(segment->durationUs);
+    }
+    // декодер выдаёт ровно столько кадров, сколько кодировщики уложат в ту же
+    // частоту: иначе ролик с переменной частотой уплывает от звука
+    decodeArguments << QStringLiteral("-map") << QStringLiteral("0:v:0")
+                    << QStringLiteral("-r") << info.frameRate
+                    << QStringLiteral("-f") << QStringLiteral("rawvideo")
+                    << QStringLiteral("-pix_fmt") << QStringLiteral("bgra")
+                    << QStringLiteral("-");
+    QProcess decoder;
+    decoder.setStandardErrorFile(QProcess::nullDevice());
+    decoder.start(ffmpegPath, decodeArguments, QIODevice::ReadOnly);
+    if (!decoder.waitForStarted()) {
+        qWarning() << "Не удалось запустить ffmpeg для декодирования" << videoPath;
+        return ok;
     }
 
-    const QString baseName = QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd_HHmmss"));
-    int index = 0;
+    std::vector<std::unique_ptr<QProcess>> encoders;
+    for (int i = 0; i < count; ++i) {
+        const EncodedOutput &output = outputs.at(i);
+        const QString filePath = segment ? segment->filePaths.at(i) : output.filePath;
+        std::unique_ptr<QProcess> encoder(new QProcess);
+        if (!removeExistingFile(filePath)) {
+            encoders.push_back(std::move(encoder));
+            continue;
+        }
+        QStringList arguments;
+        arguments << QStringLiteral("-y") << QStringLiteral("-v") << QStringLiteral("error")
+                  << QStringLiteral("-f") << QStringLiteral("rawvideo")
+                  << QStringLiteral("-pix_fmt") << QStringLiteral("bgra")
+                  << QStringLiteral("-s") << QStringLiteral("%1x%2").arg(w).arg(h)
+                  << QStringLiteral("-framerate") << info.frameRate
+                  << QStringLiteral("-i") << QStringLiteral("-");
+        if (!segment) {
+            arguments << QStringLiteral("-i") << videoPath
+                      << QStringLiteral("-map") << QStringLiteral("0:v")
+                      << QStringLiteral("-map") << QStringLiteral("1:a?");
+        }
+        arguments << QStringLiteral("-c:v") << QStringLiteral("libx264")
+                  << QStringLiteral("-preset") << QStringLiteral("veryfast")
+                  << QStringLiteral("-crf") << QStringLiteral("22")
+                  << QStringLiteral("-pix_fmt") << QStringLiteral("yuv420p")
+                  << QStringLiteral("-threads") << QString::number(threadsPerEncoder);
+        if (segment) {
+            // звук добавляется один раз при склейке частей
+            arguments << QStringLiteral("-an") << QStringLiteral("-f") << QStringLiteral("mpegts");
+        } else {
+            arguments << QStringLiteral("-c:a") << QStringLiteral("copy") << QStringLiteral("-shortest");
+        }
+        arguments << filePath;
+        encoder->setStandardOutputFile(QProcess::nullDevice());
+        encoder->setStandardErrorFile(QProcess::nullDevice());
+        encoder->start(ffmpegPath, arguments);
+        ok[i] = encoder->waitForStarted();
+        if (!ok[i]) {
+            qWarning() << "Не удалось запустить ffmpeg для фильтра" << output.code;
+        }
+        encoders.push_back(std::move(encoder));
+    }
 
-    for (const QString &code : filters) {
-        const QString slug = filterSlug(code);
-        const QString fileName = QStringLiteral("%1_%2_%3.png")
-                                     .arg(baseName)
-                                     .arg(index, 2, 10, QLatin1Char('0'))
-                                     .arg(slug.isEmpty() ? QStringLiteral("image") : slug);
-        const QString filePath = targetDir.filePath(fileName);
-        const QImage processed = applyFilter(sourceImage, code).convertToFormat(QImage::Format_ARGB32);
+    auto dropCanceled = [&]() {
+        for (int i = 0; i < count; ++i) {
+            QProcess &encoder = *encoders[size_t(i)];
+            if (outputs.at(i).result.isCanceled() && encoder.state() != QProcess::NotRunning) {
+                ok[i] = false;
+                encoder.kill();
+                encoder.waitForFinished(-1);
+            }
+        }
+    };
+    auto nothingLeft = [&]() {
+        dropCanceled();
+        return !ok.contains(true);
+    };
 
-        tasks.append(QtConcurrent::run([processed, filePath]() -> bool {
-            if (filePath.isEmpty()) {
-                return false;
+    // кадры фильтруются в пуле экспорта, не в общем: он остаётся снимкам
+    QThreadPool *pool = exportPool();
+    // одновременно кодируемые части ролика делят окно между собой
+    const int window = qMax(2, (pool->maxThreadCount() - 1) / (segment ? qMax(1, segment->concurrent) : 1));
+    QList<QFuture<QList<QImage>>> pending;
+    std::atomic<qint64> ownCounter{0};
+    std::atomic<qint64> &written = framesWritten ? *framesWritten : ownCounter;
+    auto writeOldest = [&]() {
+        QList<QImage> frames;
+        {
+            TraceScope scope("video.filter_wait"); // кодировщики ждут отставший фильтр
+            frames = pending.first().result();
+        }
+        pending.removeFirst();
+        for (int i = 0; i < count; ++i) {
+            if (!ok[i]) {
+                continue;
             }
-            const bool ok = processed.save(filePath, "PNG");
-            if (!ok) {
-                qWarning() << "Не удалось сохранить" << filePath;
+            QImage frame = frames.at(i);
+            if (frame.format() != QImage::Format_ARGB32) {
+                TraceScope scope("image.convert");
+                frame = pooledArgb32Copy(frame);
             }
-            return ok;
+            const EncodedOutput &output = outputs.at(i);
+            ok[i] = writeToProcess(*encoders[size_t(i)], reinterpret_cast<const char*>(frame.constBits()), frameBytes,
+                                   [&output]() { return output.result.isCanceled(); });
+        }
+        reportProgress(outputs, ++written, info.frames);
+    };
+
+    for (;;) {
+        if (nothingLeft()) {
+            decoder.kill(); // все кодировщики отказали или отменены, дальше декодировать незачем
+            break;
+        }
+        QImage frame = pooledImage(w, h, QImage::Format_ARGB32); // освобождённые кадры возвращаются в пул
+        if (!readFromProcess(decoder, reinterpret_cast<char*>(frame.bits()), frameBytes, nothingLeft)) {
+            break;
+        }
+        const qint64 queued = traceMark();
+        pending.append(QtConcurrent::run(pool, [pool, frame, codes, queued]() {
+            traceSince("video.filter_queue_wait", queued);
+            ParallelPoolScope scope(pool);
+            return applyFilters(frame, codes);
         }));
+        if (pending.size() >= window) {
+            writeOldest();
+        }
+    }
+    while (!pending.isEmpty()) {
+        writeOldest();
+    }
+    if (nothingLeft()) {
+        decoder.kill();
+    }
 
-        ++index;
+    decoder.waitForFinished(-1);
+    const bool decoded = decoder.exitStatus() == QProcess::NormalExit && decoder.exitCode() == 0;
+    if (!decoded && ok.contains(true)) {
+        qWarning() << "ffmpeg не смог декодировать" << videoPath;
     }
 
-    return tasks;
+    TraceScope finishScope("video.encode_finish"); // кодировщики дописывают хвост после последнего кадра
+    for (int i = 0; i < count; ++i) {
+        QProcess &encoder = *encoders[size_t(i)];
+        if (encoder.state() == QProcess::NotRunning) {
+            continue;
+        }
+        encoder.closeWriteChannel();
+        const bool finished = encoder.waitForFinished(-1) && encoder.exitStatus() == QProcess::NormalExit
+                              && encoder.exitCode() == 0;
+        if (!finished) {
+            qWarning() << "ffmpeg завершился с ошибкой" << encoder.exitCode() << "для фильтра" << outputs.at(i).code;
+        }
+        ok[i] = ok[i] && finished && decoded;
+    }
+    return ok;
 }
 
-static QString ffmpegFilterForCode(const QString &code) {
-    if (code == QStringLiteral("чб")) {
-        return QStringLiteral("format=gray");
-    }
-    if (code == QStringLiteral("нег")) {
-        return QStringLiteral("negate");
-    }
-    if (code == QStringLiteral("сеп")) {
-        return QStringLiteral("colorchannelmixer=.393:.769:.189:0:.349:.686:.168:0:.272:.534:.131");
-    }
-    if (code == QStringLiteral("пос")) {
-        return QStringLiteral("lutrgb=r='floor(val/64)*64':g='floor(val/64)*64':b='floor(val/64)*64'");
+// Склеивает части выхода в filePath демультиплексором concat, без
+// перекодирования; звук исходника копируется один раз, здесь же.
+static bool concatSegments(const QString &ffmpegPath, const QString &videoPath, const QStringList &parts,
+                           const QString &filePath) {
+    TraceScope scope("video.concat", filePath);
+    const QString listPath = filePath + QStringLiteral(".parts.txt");
+    {
+        QFile list(listPath);
+        if (!list.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return false;
+        }
+        for (const QString &part : parts) {
+            QString quoted = QFileInfo(part).absoluteFilePath();
+            quoted.replace(QStringLiteral("'"), QStringLiteral("'\\''"));
+            list.write(QStringLiteral("file '%1'\n").arg(quoted).toUtf8());
+        }
     }
-    if (code == QStringLiteral("сол")) {
-        return QStringLiteral("lutyuv=y='if(lt(val,128),val,255-val)'");
+    const bool ok = removeExistingFile(filePath)
+                    && runFfmpeg(ffmpegPath, QStringList()
+                                                 << QStringLiteral("-y") << QStringLiteral("-v") << QStringLiteral("error")
+                                                 << QStringLiteral("-f") << QStringLiteral("concat")
+                                                 << QStringLiteral("-safe") << QStringLiteral("0")
+                                                 << QStringLiteral("-i") << listPath
+                                                 << QStringLiteral("-i") << videoPath
+                                                 << QStringLiteral("-map") << QStringLiteral("0:v")
+                                                 << QStringLiteral("-map") << QStringLiteral("1:a?")
+                                                 << QStringLiteral("-c") << QStringLiteral("copy")
+                                                 << QStringLiteral("-shortest")
+                                                 << filePath,
+                                 filePath);
+    QFile::remove(listPath);
+    if (!ok) {
+        QFile::remove(filePath);
     }
-    if (code == QStringLiteral("хол")) {
-        return QStringLiteral("colorbalance=bs=0.35:rs=-0.25");
+    return ok;
+}
+
+// Экспорт по частям: части ролика между ключевыми кадрами кодируются
+// одновременно, каждая своим декодером и своими кодировщиками, в файлы
+// MPEG-TS рядом с выходом, а потом части каждого выхода склеиваются. libx264
+// на коротком 720p/1080p ролике плохо загружает больше нескольких ядер, а
+// независимые части загружают все, так что время экспорта делится на число
+// частей. Кадры и фильтры те же, что у encodeInProcess целым роликом.
+static QVector<bool> encodeSegmented(const QString &videoPath, const QString &ffmpegPath, const VideoInfo &info,
+                                     QList<EncodedOutput> &outputs, int threadsPerEncoder,
+                                     QList<VideoSegment> segments) {
+    const int count = outputs.size();
+    for (int k = 0; k < segments.size(); ++k) {
+        for (const EncodedOutput &output : outputs) {
+            segments[k].filePaths.append(
+                QStringLiteral("%1.part%2.ts").arg(output.filePath).arg(k, 3, 10, QLatin1Char('0')));
+        }
     }
-    if (code == QStringLiteral("теп")) {
-        return QStringLiteral("colorbalance=rs=0.35:bs=-0.25");
+
+    std::atomic<qint64> written{0};
+    // std::vector, а не QVector: части пишут свои элементы одновременно, а
+    // неконстантный operator[] у QVector может отсоединять общие данные
+    std::vector<QVector<bool>> partOk(size_t(segments.size()));
+    {
+        // перекачка кадров блокирующая, поэтому у каждой части свой поток
+        QThreadPool parts;
+        parts.setMaxThreadCount(segments.size());
+        for (int k = 0; k < segments.size(); ++k) {
+            QtConcurrent::run(&parts, [&, k]() {
+                TraceScope scope("video.segment");
+                partOk[size_t(k)] = encodeInProcess(videoPath, ffmpegPath, info, outputs, threadsPerEncoder,
+                                                    &segments.at(k), &written);
+            });
+        }
+        // ожидание не должно занимать поток пула экспорта: в нём фильтруются кадры частей
+        exportPool()->releaseThread();
+        parts.waitForDone();
+        exportPool()->reserveThread();
     }
-    if (code == QStringLiteral("вин")) {
-        return QStringLiteral("curves=blue='0/0 0.5/0.4 1/1',vignette=PI/3");
+
+    QVector<bool> ok(count, false);
+    for (int i = 0; i < count; ++i) {
+        QStringList files;
+        bool partsOk = !outputs.at(i).result.isCanceled();
+        for (int k = 0; k < segments.size(); ++k) {
+            files.append(segments.at(k).filePaths.at(i));
+            partsOk = partsOk && partOk[size_t(k)].value(i);
+        }
+        ok[i] = partsOk && concatSegments(ffmpegPath, videoPath, files, outputs.at(i).filePath);
+        for (const QString &file : files) {
+            QFile::remove(file);
+        }
     }
-    return QString();
+    return ok;
 }
 
-QList<QFuture<bool>> saveFilteredVideos(const QString &videoPath, QList<QString> filters, const QString &directory) {
+// Видео с фильтром обрабатывается нашими же фильтрами (encodeInProcess), так что
+// ролик выглядит так же, как снимок с тем же фильтром; ffmpeg остаётся только
+// декодером и кодировщиком. Если выходов меньше, чем кодировщиков в бюджете,
+// ролик режется по ключевым кадрам на части, которые кодируются параллельно
+// (encodeSegmented). Без ffprobe — прежние фильтры ffmpeg одним запуском.
+// "Без фильтра" и всё при отсутствии ffmpeg просто копируется. Успех сообщается
+// отдельным QFuture<bool> на каждый выход; у него же есть прогресс, а cancel()
+// останавливает работу над выходом и удаляет недописанный файл.
+// Имена файлов начинаются с namePrefix, по умолчанию — с текущего времени.
+QList<QFuture<bool>> saveFilteredVideos(const QString &videoPath, QList<QString> filters, const QString &directory,
+                                        const QString &namePrefix = QString()) {
     QList<QFuture<bool>> tasks;
     if (videoPath.isEmpty() || !QFile::exists(videoPath)) {
         return tasks;
@@ -455,9 +2379,14 @@ QList<QFuture<bool>> saveFilteredVideos(const QString &videoPath, QList<QString>
     }
 
     const QString ffmpegPath = QStandardPaths::findExecutable(QStringLiteral("ffmpeg"));
-    const QString baseName = QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd_HHmmss"));
-    int index = 0;
+    const QString ffprobePath = QStandardPaths::findExecutable(QStringLiteral("ffprobe"));
+    const QString baseName = namePrefix.isEmpty()
+                                 ? QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd_HHmmss"))
+                                 : namePrefix;
 
+    auto encoded = std::make_shared<QList<EncodedOutput>>();
+
+    int index = 0;
     for (const QString &code : filters) {
         const QString slug = filterSlug(code);
         const QString fileName = QStringLiteral("%1_%2_%3.mp4")
@@ -465,68 +2394,91 @@ QList<QFuture<bool>> saveFilteredVideos(const QString &videoPath, QList<QString>
                                      .arg(index, 2, 10, QLatin1Char('0'))
                                      .arg(slug.isEmpty() ? QStringLiteral("video") : slug);
         const QString filePath = targetDir.filePath(fileName);
+        ++index;
 
-        tasks.append(QtConcurrent::run([videoPath, filePath, code, ffmpegPath]() -> bool {
-            if (filePath.isEmpty()) {
-                return false;
-            }
-
-            auto cleanTarget = [&filePath]() -> bool {
-                if (QFile::exists(filePath) && !QFile::remove(filePath)) {
-                    qWarning() << "Не удалось перезаписать" << filePath;
+        const FilterSpec *spec = findFilter(code);
+        const bool canFilter = spec && spec->id != FilterId::None
+                               && (!ffprobePath.isEmpty() || !spec->ffmpeg.isEmpty());
+        if (ffmpegPath.isEmpty() || !canFilter) {
+            tasks.append(startExportTask(QThreadPool::globalInstance(), [videoPath, filePath](QFutureInterface<bool> &task) -> bool {
+                if (!removeExistingFile(filePath)) {
                     return false;
                 }
-                return true;
-            };
-
-            if (!cleanTarget()) {
-                return false;
-            }
-
-            const QString filterExpr = ffmpegFilterForCode(code);
-
-            if (ffmpegPath.isEmpty() || filterExpr.isEmpty()) {
+                task.setProgressRange(0, 1);
+                TraceScope scope("video.copy", filePath);
                 if (!QFile::copy(videoPath, filePath)) {
                     qWarning() << "Не удалось сохранить" << filePath;
                     return false;
                 }
+                if (task.isCanceled()) {
+                    QFile::remove(filePath);
+                    return false;
+                }
+                task.setProgressValue(1);
                 return true;
-            }
+            }));
+            continue;
+        }
 
-            QStringList arguments;
-            arguments << QStringLiteral("-y")
-                      << QStringLiteral("-i") << videoPath
-                      << QStringLiteral("-vf") << filterExpr
-                      << QStringLiteral("-c:v") << QStringLiteral("libx264")
-                      << QStringLiteral("-preset") << QStringLiteral("veryfast")
-                      << QStringLiteral("-crf") << QStringLiteral("22")
-                      << QStringLiteral("-c:a") << QStringLiteral("copy")
-                      << filePath;
-
-            QProcess process;
-            process.start(ffmpegPath, arguments, QIODevice::ReadOnly);
-            const bool started = process.waitForStarted();
-            if (!started) {
-                qWarning() << "Не удалось запустить ffmpeg для фильтра" << code;
-                return false;
-            }
+        EncodedOutput output;
+        output.code = code;
+        output.filePath = filePath;
+        output.result.reportStarted();
+        tasks.append(output.result.future());
+        encoded->append(output);
+    }
 
-            if (!process.waitForFinished(-1)) {
-                qWarning() << "ffmpeg не завершился корректно для фильтра" << code;
-                return false;
-            }
+    if (encoded->isEmpty()) {
+        return tasks;
+    }
 
-            const int exitCode = process.exitCode();
-            if (exitCode != 0) {
-                qWarning() << "ffmpeg завершился с ошибкой" << exitCode << "для фильтра" << code;
-                return false;
+    // Выходов меньше, чем бюджет кодировщиков: ролик кодируется по частям, и
+    // задача берёт весь бюджет, по кодировщику на выход в каждой части.
+    const int maxEncoders = exportScheduler().maxEncoders;
+    const int parts = ffprobePath.isEmpty() ? 1 : qMax(1, maxEncoders / encoded->size());
+    ExportJob job;
+    job.encoders = encoded->size() * parts;
+    job.start = [videoPath, ffmpegPath, ffprobePath, encoded, parts](int threadsPerEncoder,
+                                                                     const std::function<void()> &done) {
+        finishCanceled(*encoded);
+        if (encoded->isEmpty()) {
+            done();
+            return;
+        }
+        if (ffprobePath.isEmpty()) {
+            startFilterGraphExport(videoPath, ffmpegPath, encoded, threadsPerEncoder, done);
+            return;
+        }
+        // перекачка кадров блокирующая, поэтому идёт в пуле экспорта
+        QtConcurrent::run(exportPool(), [videoPath, ffmpegPath, ffprobePath, encoded, parts, threadsPerEncoder, done]() {
+            TraceScope scope("video.export", videoPath);
+            VideoInfo info;
+            if (!probeVideo(ffprobePath, videoPath, &info)) {
+                const int threads = threadsPerEncoder * parts;
+                runInApplicationThread([videoPath, ffmpegPath, encoded, threads, done]() {
+                    startFilterGraphExport(videoPath, ffmpegPath, encoded, threads, done);
+                });
+                return;
             }
-
-            return QFile::exists(filePath);
-        }));
-
-        ++index;
-    }
+            QList<VideoSegment> segments;
+            QVector<qint64> keyframes;
+            qint64 endUs = 0;
+            if (parts > 1 && probeKeyframes(ffprobePath, videoPath, &keyframes, &endUs)) {
+                segments = planVideoSegments(keyframes, endUs, parts);
+            }
+            if (segments.isEmpty()) {
+                // ролик короткий или ключевых кадров мало: целиком, но со всеми потоками задачи
+                const int threads = threadsPerEncoder * parts;
+                reportEncoded(*encoded, encodeInProcess(videoPath, ffmpegPath, info, *encoded, threads));
+            } else {
+                // частей бывает меньше, чем заказано: их кодировщикам достаются и лишние потоки
+                const int threads = qMax(1, threadsPerEncoder * parts / segments.size());
+                reportEncoded(*encoded, encodeSegmented(videoPath, ffmpegPath, info, *encoded, threads, segments));
+            }
+            done();
+        });
+    };
+    scheduleExport(job);
 
     return tasks;
 }
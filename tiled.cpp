@@ -0,0 +1,973 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QTemporaryDir>
+
+#include <zlib.h>
+
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <jpeglib.h>
+
+// Полосовая обработка больших снимков. applyFilter держит в памяти весь кадр
+// и ещё по кадру на фильтр; панорама на 100+ Мп в ARGB32 — это 400 МБ на
+// копию. Здесь снимок читается полосами во всю ширину, каждая полоса сразу
+// проходит все фильтры и дописывается в их файлы, так что память задаёт
+// размер полосы, а не снимка.
+//
+// Полосы, а не квадратные плитки: PNG и QOI пишутся строго построчно сверху
+// вниз, и декодер PNG отдаёт строки в том же порядке. Фильтры, которым важно
+// положение строки в кадре (виньетка), готовят ядро на полосу через
+// prepareRows; диффузия ошибки в "пдз" переносит ошибку последней строки
+// полосы в первую строку следующей через stream, поэтому результат побитово
+// совпадает с обработкой целого кадра.
+//
+// Источник полос: собственный потоковый декодер PNG (inflate по мере чтения
+// строк), для JPEG — libjpeg, который держит один открытый декодер и отдаёт
+// строки по порядку, для остальных форматов — QImageReader::setClipRect, если
+// плагин умеет читать часть снимка, иначе снимок читается один раз целиком.
+// Целиком читается и снимок с поворотом в EXIF: его поворачивает QImageReader.
+// Прогрессивный JPEG тоже отдаёт строки по порядку, но libjpeg до последнего
+// скана держит коэффициенты всего кадра, около 6 байт на пиксель, так что его
+// память задаёт снимок, а не полоса, — с предупреждением.
+// Выход полосами пишется в PNG и QOI; JPEG и WebP Qt кодирует только целым
+// кадром, и фильтры с соседями без stream тоже считаются целым кадром — для
+// них снимок читается целиком, с предупреждением.
+
+// Полоса около 16 МБ ARGB32: у снимка 20000 пикселей в ширину это 200 строк.
+static const qint64 tiledStripBytes = 16 * 1024 * 1024;
+static const int tiledMinStripRows = 16;
+// пакетный режим обрабатывает полосами снимки от стольких пикселей
+static const qint64 tiledMinPixels = 50 * 1000 * 1000;
+
+static int tiledStripRows(int width) {
+    return int(qMax<qint64>(tiledMinStripRows, tiledStripBytes / (qint64(qMax(1, width)) * 4)));
+}
+
+// Снимок, который отдаёт строки полосами сверху вниз.
+class ImageStripSource {
+public:
+    virtual ~ImageStripSource() {}
+
+    int width() const { return w; }
+    int height() const { return h; }
+    // есть ли в файле альфа-канал: без него выход пишется в RGB
+    bool hasAlpha() const { return alpha; }
+    QString errorString() const { return error; }
+
+    // Высота полосы вместо rows: источник, которому дорого начинать полосу,
+    // просит полосы выше.
+    int preferredStripRows(int rows) const { return qMin(h, qMax(rows, minStripRows)); }
+
+    // Следующие rows строк в strip (ARGB32, ширина снимка, rows строк).
+    virtual bool readRows(int rows, QImage *strip) = 0;
+
+protected:
+    int w = 0;
+    int h = 0;
+    bool alpha = false;
+    int minStripRows = 0;
+    QString error;
+};
+
+static inline quint32 getBigEndian32(const uchar *p) {
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+// 16 бит в 8 с округлением, как Qt при переводе 16-битных PNG в ARGB32.
+static inline int pngSample16To8(int v) {
+    return (v - (v >> 8) + 0x80) >> 8;
+}
+
+// Обратный фильтр строки PNG на месте; prev — предыдущая строка без фильтра.
+static bool pngUnfilterRow(int type, uchar *row, const uchar *prev, int bytes, int bpp) {
+    switch (type) {
+    case 0:
+        return true;
+    case 1:
+        for (int i = bpp; i < bytes; ++i) {
+            row[i] = uchar(row[i] + row[i - bpp]);
+        }
+        return true;
+    case 2:
+        for (int i = 0; i < bytes; ++i) {
+            row[i] = uchar(row[i] + prev[i]);
+        }
+        return true;
+    case 3:
+        for (int i = 0; i < bytes; ++i) {
+            const int left = i >= bpp ? row[i - bpp] : 0;
+            row[i] = uchar(row[i] + ((left + prev[i]) >> 1));
+        }
+        return true;
+    case 4:
+        for (int i = 0; i < bytes; ++i) {
+            const int left = i >= bpp ? row[i - bpp] : 0;
+            const int upLeft = i >= bpp ? prev[i - bpp] : 0;
+            row[i] = uchar(row[i] + paethPredictor(left, prev[i], upLeft));
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Потоковый декодер PNG без чересстрочности: серый, RGB, палитра, серый с
+// альфой и RGBA, 1–16 бит, прозрачность из tRNS. В памяти — две строки и
+// буфер чтения; IDAT разжимаются ровно настолько, сколько строк попросили.
+class PngStripSource : public ImageStripSource {
+public:
+    explicit PngStripSource(const QString &path) : file(path) {
+        std::memset(&stream, 0, sizeof(stream));
+    }
+
+    ~PngStripSource() {
+        if (streamOpen) {
+            inflateEnd(&stream);
+        }
+    }
+
+    // Читает заголовки до первого IDAT. false — не PNG или PNG, который этот
+    // декодер не читает (чересстрочный): такой снимок читает QImageReader.
+    bool open() {
+        uchar signature[8];
+        if (!file.open(QIODevice::ReadOnly) || file.read(reinterpret_cast<char*>(signature), 8) != 8
+            || std::memcmp(signature, "\x89PNG\r\n\x1a\n", 8) != 0) {
+            return false;
+        }
+        bool haveHeader = false;
+        for (;;) {
+            if (!readChunkHeader()) {
+                return false;
+            }
+            if (std::memcmp(chunkType, "IDAT", 4) == 0) {
+                break;
+            }
+            QByteArray payload;
+            if (!readChunkPayload(&payload)) {
+                return false;
+            }
+            const uchar *p = reinterpret_cast<const uchar*>(payload.constData());
+            if (std::memcmp(chunkType, "IHDR", 4) == 0) {
+                if (payload.size() != 13 || !parseHeader(p)) {
+                    return false;
+                }
+                haveHeader = true;
+            } else if (std::memcmp(chunkType, "PLTE", 4) == 0) {
+                for (int i = 0; i + 2 < payload.size() && i / 3 < 256; i += 3) {
+                    palette[size_t(i / 3)] = qRgb(p[i], p[i + 1], p[i + 2]);
+                }
+            } else if (std::memcmp(chunkType, "tRNS", 4) == 0) {
+                parseTransparency(p, payload.size());
+            } else if (std::memcmp(chunkType, "IEND", 4) == 0) {
+                return false;
+            }
+        }
+        if (!haveHeader || inflateInit(&stream) != Z_OK) {
+            return false;
+        }
+        streamOpen = true;
+        chunkCrc = crc32(0L, reinterpret_cast<const Bytef*>(chunkType), 4);
+        current.assign(size_t(rowBytes) + 1, 0);
+        previous.assign(size_t(rowBytes), 0);
+        return true;
+    }
+
+    bool readRows(int rows, QImage *strip) override {
+        TraceScope scope("png.decode_rows");
+        for (int i = 0; i < rows; ++i) {
+            if (rowsRead >= h || !inflateRow()) {
+                if (error.isEmpty()) {
+                    error = QStringLiteral("PNG обрывается на строке %1").arg(rowsRead);
+                }
+                return false;
+            }
+            uchar *raw = current.data() + 1;
+            if (!pngUnfilterRow(current[0], raw, previous.data(), rowBytes, bytesPerPixel)) {
+                error = QStringLiteral("Неизвестный фильтр строки PNG %1").arg(current[0]);
+                return false;
+            }
+            convertRow(raw, reinterpret_cast<QRgb*>(strip->scanLine(i)));
+            std::memcpy(previous.data(), raw, size_t(rowBytes));
+            ++rowsRead;
+        }
+        return true;
+    }
+
+private:
+    bool parseHeader(const uchar *p) {
+        w = int(getBigEndian32(p));
+        h = int(getBigEndian32(p + 4));
+        depth = p[8];
+        colorType = p[9];
+        int channels = 0;
+        switch (colorType) {
+        case 0: channels = 1; break;
+        case 2: channels = 3; break;
+        case 3: channels = 1; break;
+        case 4: channels = 2; break;
+        case 6: channels = 4; break;
+        default: return false;
+        }
+        const bool depthOk = colorType == 0 ? (depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16)
+                             : colorType == 3 ? (depth == 1 || depth == 2 || depth == 4 || depth == 8)
+                                              : (depth == 8 || depth == 16);
+        // p[12] — чересстрочность (Adam7): её читает QImageReader
+        if (!depthOk || p[10] != 0 || p[11] != 0 || p[12] != 0 || w <= 0 || h <= 0 || w > (1 << 24)) {
+            return false;
+        }
+        rowBytes = int((qint64(w) * channels * depth + 7) / 8);
+        bytesPerPixel = qMax(1, channels * depth / 8);
+        alpha = colorType == 4 || colorType == 6;
+        return true;
+    }
+
+    void parseTransparency(const uchar *p, int size) {
+        if (colorType == 3) {
+            for (int i = 0; i < size && i < 256; ++i) {
+                palette[size_t(i)] = qRgba(qRed(palette[size_t(i)]), qGreen(palette[size_t(i)]),
+                                           qBlue(palette[size_t(i)]), p[i]);
+            }
+            alpha = size > 0;
+        } else if (colorType == 0 && size >= 2) {
+            keyGray = int(p[0]) << 8 | p[1];
+            hasKey = true;
+            alpha = true;
+        } else if (colorType == 2 && size >= 6) {
+            keyRed = int(p[0]) << 8 | p[1];
+            keyGreen = int(p[2]) << 8 | p[3];
+            keyBlue = int(p[4]) << 8 | p[5];
+            hasKey = true;
+            alpha = true;
+        }
+    }
+
+    bool readChunkHeader() {
+        uchar header[8];
+        if (file.read(reinterpret_cast<char*>(header), 8) != 8) {
+            error = QStringLiteral("PNG обрывается");
+            return false;
+        }
+        chunkLeft = getBigEndian32(header);
+        std::memcpy(chunkType, header + 4, 4);
+        return chunkLeft < 0x80000000u;
+    }
+
+    bool checkChunkCrc(uLong crc) {
+        uchar stored[4];
+        if (file.read(reinterpret_cast<char*>(stored), 4) != 4 || getBigEndian32(stored) != quint32(crc)) {
+            error = QStringLiteral("Неверная контрольная сумма блока %1").arg(QString::fromLatin1(chunkType, 4));
+            return false;
+        }
+        return true;
+    }
+
+    bool readChunkPayload(QByteArray *payload) {
+        *payload = file.read(qint64(chunkLeft));
+        if (payload->size() != int(chunkLeft)) {
+            return false;
+        }
+        uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(chunkType), 4);
+        if (chunkLeft > 0) {
+            crc = crc32(crc, reinterpret_cast<const Bytef*>(payload->constData()), uInt(chunkLeft));
+        }
+        return checkChunkCrc(crc);
+    }
+
+    // Следующая порция сжатых данных; IDAT идут подряд, данные могут быть
+    // разрезаны между ними как угодно.
+    bool refill() {
+        while (chunkLeft == 0) {
+            if (!checkChunkCrc(chunkCrc) || !readChunkHeader() || std::memcmp(chunkType, "IDAT", 4) != 0) {
+                return false;
+            }
+            chunkCrc = crc32(0L, reinterpret_cast<const Bytef*>(chunkType), 4);
+        }
+        input.resize(size_t(qMin<quint32>(chunkLeft, 64 * 1024)));
+        if (file.read(reinterpret_cast<char*>(input.data()), qint64(input.size())) != qint64(input.size())) {
+            return false;
+        }
+        chunkCrc = crc32(chunkCrc, input.data(), uInt(input.size()));
+        chunkLeft -= quint32(input.size());
+        stream.next_in = input.data();
+        stream.avail_in = uInt(input.size());
+        return true;
+    }
+
+    // Байт фильтра и сама строка в current.
+    bool inflateRow() {
+        stream.next_out = current.data();
+        stream.avail_out = uInt(current.size());
+        while (stream.avail_out > 0) {
+            if (stream.avail_in == 0 && !refill()) {
+                return false;
+            }
+            const int result = inflate(&stream, Z_NO_FLUSH);
+            if (result == Z_STREAM_END && stream.avail_out > 0) {
+                return false;
+            }
+            if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+                error = QStringLiteral("Повреждённые данные PNG");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int sample(const uchar *raw, int x) const {
+        if (depth == 8) {
+            return raw[x];
+        }
+        if (depth == 16) {
+            return int(raw[2 * x]) << 8 | raw[2 * x + 1];
+        }
+        const int bit = x * depth;
+        return (raw[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+    }
+
+    int to8(int v) const {
+        if (depth == 16) {
+            return pngSample16To8(v);
+        }
+        return depth == 8 ? v : v * 255 / ((1 << depth) - 1);
+    }
+
+    void convertRow(const uchar *raw, QRgb *out) const {
+        switch (colorType) {
+        case 0:
+            for (int x = 0; x < w; ++x) {
+                const int v = sample(raw, x);
+                const int g = to8(v);
+                out[x] = qRgba(g, g, g, hasKey && v == keyGray ? 0 : 255);
+            }
+            break;
+        case 2:
+            for (int x = 0; x < w; ++x) {
+                const int r = sample(raw, 3 * x);
+                const int g = sample(raw, 3 * x + 1);
+                const int b = sample(raw, 3 * x + 2);
+                const bool key = hasKey && r == keyRed && g == keyGreen && b == keyBlue;
+                out[x] = qRgba(to8(r), to8(g), to8(b), key ? 0 : 255);
+            }
+            break;
+        case 3:
+            for (int x = 0; x < w; ++x) {
+                out[x] = palette[size_t(sample(raw, x))];
+            }
+            break;
+        case 4:
+            for (int x = 0; x < w; ++x) {
+                const int g = to8(sample(raw, 2 * x));
+                out[x] = qRgba(g, g, g, to8(sample(raw, 2 * x + 1)));
+            }
+            break;
+        case 6:
+            for (int x = 0; x < w; ++x) {
+                out[x] = qRgba(to8(sample(raw, 4 * x)), to8(sample(raw, 4 * x + 1)), to8(sample(raw, 4 * x + 2)),
+                               to8(sample(raw, 4 * x + 3)));
+            }
+            break;
+        }
+    }
+
+    QFile file;
+    z_stream stream;
+    bool streamOpen = false;
+    char chunkType[4] = {0, 0, 0, 0};
+    quint32 chunkLeft = 0;
+    uLong chunkCrc = 0;
+    std::vector<uchar> input;
+    std::vector<uchar> current;  // байт фильтра и строка, как в потоке
+    std::vector<uchar> previous; // предыдущая строка без фильтра
+    int depth = 8;
+    int colorType = 0;
+    int rowBytes = 0;
+    int bytesPerPixel = 1;
+    int rowsRead = 0;
+    QRgb palette[256] = {};
+    bool hasKey = false;
+    int keyGray = -1;
+    int keyRed = -1;
+    int keyGreen = -1;
+    int keyBlue = -1;
+};
+
+static bool imageFormatHasAlpha(QImage::Format format) {
+    return QImage::toPixelFormat(format).alphaUsage() == QPixelFormat::UsesAlpha;
+}
+
+// Потоковый декодер JPEG на libjpeg: один декодер на весь снимок,
+// jpeg_read_scanlines отдаёт строки сверху вниз, поэтому каждая строка
+// декодируется один раз. Цвета переводятся так же, как в плагине JPEG Qt:
+// серый, RGB и CMYK от Adobe (инвертированный). Ошибки libjpeg приходят через
+// longjmp в open и readRows; после их setjmp не создаётся объектов с
+// деструкторами, которые longjmp пропустил бы.
+class JpegStripSource : public ImageStripSource {
+public:
+    explicit JpegStripSource(const QString &path) : file(path), buffer(64 * 1024) {
+        std::memset(&info, 0, sizeof(info));
+        std::memset(&failure, 0, sizeof(failure));
+        std::memset(&input, 0, sizeof(input));
+    }
+
+    ~JpegStripSource() {
+        if (created) {
+            jpeg_destroy_decompress(&info);
+        }
+    }
+
+    // Читает заголовок и запускает декодер. false — не JPEG или JPEG, который
+    // libjpeg не открыл: такой снимок читает QImageReader.
+    bool open() {
+        uchar signature[2];
+        if (!file.open(QIODevice::ReadOnly) || file.read(reinterpret_cast<char*>(signature), 2) != 2
+            || signature[0] != 0xff || signature[1] != 0xd8 || !file.seek(0)) {
+            return false;
+        }
+        info.err = jpeg_std_error(&failure.manager);
+        failure.manager.error_exit = failJpeg;
+        failure.manager.output_message = ignoreJpegMessage;
+        if (setjmp(failure.jump)) {
+            return false;
+        }
+        jpeg_create_decompress(&info);
+        created = true;
+        info.client_data = this;
+        input.init_source = idleJpegInput;
+        input.fill_input_buffer = fillJpegInput;
+        input.skip_input_data = skipJpegInput;
+        input.resync_to_restart = jpeg_resync_to_restart;
+        input.term_source = idleJpegInput;
+        info.src = &input;
+        if (jpeg_read_header(&info, TRUE) != JPEG_HEADER_OK) {
+            return false;
+        }
+        // Прогрессивный JPEG libjpeg держит весь кадр коэффициентами (около
+        // 6 байт на пиксель), пока не прочтёт последний скан.
+        if (jpeg_has_multiple_scans(&info)) {
+            qWarning() << "Прогрессивный JPEG" << file.fileName() << "декодируется целиком в памяти";
+        }
+        if (info.num_components == 1) {
+            info.out_color_space = JCS_GRAYSCALE;
+        } else if (info.num_components == 4) {
+            info.out_color_space = JCS_CMYK;
+        } else {
+            info.out_color_space = JCS_RGB;
+        }
+        jpeg_start_decompress(&info);
+        w = int(info.output_width);
+        h = int(info.output_height);
+        row.resize(size_t(w) * size_t(info.output_components));
+        return true;
+    }
+
+    bool readRows(int rows, QImage *strip) override {
+        TraceScope scope("jpeg.decode_rows");
+        if (setjmp(failure.jump)) {
+            error = QString::fromLatin1(failure.message);
+            return false;
+        }
+        for (int i = 0; i < rows; ++i) {
+            JSAMPROW line = row.data();
+            if (jpeg_read_scanlines(&info, &line, 1) != 1) {
+                error = QStringLiteral("JPEG обрывается на строке %1").arg(info.output_scanline);
+                return false;
+            }
+            convertRow(reinterpret_cast<QRgb*>(strip->scanLine(i)));
+        }
+        return true;
+    }
+
+private:
+    struct Failure {
+        jpeg_error_mgr manager;
+        jmp_buf jump;
+        char message[JMSG_LENGTH_MAX];
+    };
+
+    static void failJpeg(j_common_ptr common) {
+        Failure *failure = reinterpret_cast<Failure*>(common->err);
+        (*common->err->format_message)(common, failure->message);
+        longjmp(failure->jump, 1);
+    }
+
+    static void ignoreJpegMessage(j_common_ptr) {}
+
+    static void idleJpegInput(j_decompress_ptr) {}
+
+    static boolean fillJpegInput(j_decompress_ptr info) {
+        JpegStripSource *self = static_cast<JpegStripSource*>(info->client_data);
+        qint64 read = self->file.read(reinterpret_cast<char*>(self->buffer.data()), qint64(self->buffer.size()));
+        if (read <= 0) {
+            // файл оборвался: как libjpeg, подставляем конец снимка, недостающие строки — серые
+            self->buffer[0] = 0xff;
+            self->buffer[1] = JPEG_EOI;
+            read = 2;
+        }
+        self->input.next_input_byte = self->buffer.data();
+        self->input.bytes_in_buffer = size_t(read);
+        return TRUE;
+    }
+
+    static void skipJpegInput(j_decompress_ptr info, long count) {
+        if (count <= 0) {
+            return;
+        }
+        JpegStripSource *self = static_cast<JpegStripSource*>(info->client_data);
+        while (count > long(self->input.bytes_in_buffer)) {
+            count -= long(self->input.bytes_in_buffer);
+            fillJpegInput(info);
+        }
+        self->input.next_input_byte += count;
+        self->input.bytes_in_buffer -= size_t(count);
+    }
+
+    void convertRow(QRgb *out) const {
+        const JSAMPLE *in = row.data();
+        if (info.out_color_space == JCS_GRAYSCALE) {
+            for (int x = 0; x < w; ++x) {
+                out[x] = qRgb(in[x], in[x], in[x]);
+            }
+        } else if (info.out_color_space == JCS_CMYK) {
+            for (int x = 0; x < w; ++x, in += 4) {
+                const int k = in[3];
+                out[x] = qRgb(k * in[0] / 255, k * in[1] / 255, k * in[2] / 255);
+            }
+        } else {
+            for (int x = 0; x < w; ++x, in += 3) {
+                out[x] = qRgb(in[0], in[1], in[2]);
+            }
+        }
+    }
+
+    QFile file;
+    std::vector<JOCTET> buffer;
+    std::vector<JSAMPLE> row;
+    jpeg_decompress_struct info;
+    Failure failure;
+    jpeg_source_mgr input;
+    bool created = false;
+};
+
+// Полосы через QImageReader::setClipRect: плагин пропускает строки выше
+// полосы без вывода и останавливается на её нижнем краю, так что в памяти
+// только полоса. Ценой повторного разбора начала файла на каждую полосу,
+// поэтому полос не больше clipRectMaxStrips: весь снимок разбирается около
+// (clipRectMaxStrips + 1) / 2 раз, а в памяти — четверть снимка.
+static const int clipRectMaxStrips = 4;
+
+class ClipRectStripSource : public ImageStripSource {
+public:
+    ClipRectStripSource(const QString &path, const QSize &size, QImage::Format format) : path(path) {
+        w = size.width();
+        h = size.height();
+        alpha = imageFormatHasAlpha(format);
+        minStripRows = (h + clipRectMaxStrips - 1) / clipRectMaxStrips;
+    }
+
+    bool readRows(int rows, QImage *strip) override {
+        TraceScope scope("image.decode_rows", path);
+        QImageReader reader(path);
+        reader.setClipRect(QRect(0, next, w, rows));
+        const QImage part = reader.read();
+        if (part.width() != w || part.height() != rows) {
+            error = reader.errorString();
+            return false;
+        }
+        const QImage argb = argb32View(part);
+        for (int y = 0; y < rows; ++y) {
+            std::memcpy(strip->scanLine(y), argb.constScanLine(y), size_t(w) * sizeof(QRgb));
+        }
+        next += rows;
+        return true;
+    }
+
+private:
+    QString path;
+    int next = 0;
+};
+
+// Плагин не умеет читать часть снимка: снимок читается один раз целиком, дальше
+// полосы копируются из него. Память не ограничена, зато выходы всё равно
+// пишутся полосами.
+class WholeImageStripSource : public ImageStripSource {
+public:
+    explicit WholeImageStripSource(QImage &&decoded) : image(ownedArgb32(std::move(decoded))) {
+        w = image.width();
+        h = image.height();
+        alpha = image.hasAlphaChannel() && !isOpaque(image);
+    }
+
+    bool readRows(int rows, QImage *strip) override {
+        for (int y = 0; y < rows; ++y) {
+            std::memcpy(strip->scanLine(y), image.constScanLine(next + y), size_t(w) * sizeof(QRgb));
+        }
+        next += rows;
+        return true;
+    }
+
+private:
+    QImage image;
+    int next = 0;
+};
+
+// Источник полос для файла path; nullptr — снимок не читается (причина в *error).
+// Снимок с поворотом в EXIF читается целиком и поворачивается, как в конвейере
+// пакетного режима: полосами поворот не применить.
+static std::unique_ptr<ImageStripSource> openImageStrips(const QString &path, QString *error) {
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    const bool oriented = reader.transformation() != QImageIOHandler::TransformationNone;
+    if (!oriented) {
+        std::unique_ptr<PngStripSource> png(new PngStripSource(path));
+        if (png->open()) {
+            return std::unique_ptr<ImageStripSource>(png.release());
+        }
+        std::unique_ptr<JpegStripSource> jpeg(new JpegStripSource(path));
+        if (jpeg->open()) {
+            return std::unique_ptr<ImageStripSource>(jpeg.release());
+        }
+        const QSize size = reader.size();
+        if (size.isValid() && reader.supportsOption(QImageIOHandler::ClipRect)) {
+            return std::unique_ptr<ImageStripSource>(new ClipRectStripSource(path, size, reader.imageFormat()));
+        }
+        qWarning() << "Снимок" << path << "нельзя читать полосами, читается целиком";
+    } else {
+        qWarning() << "Снимок" << path << "повёрнут в EXIF, читается целиком";
+    }
+    QImage image;
+    {
+        TraceScope scope("image.decode", path);
+        image = reader.read();
+    }
+    if (image.isNull()) {
+        *error = reader.errorString();
+        return nullptr;
+    }
+    return std::unique_ptr<ImageStripSource>(new WholeImageStripSource(std::move(image)));
+}
+
+// Файл, который пишется полосами: PNG или QOI. При ошибке файл удаляется.
+class StripFileWriter {
+public:
+    static bool supports(ImageFormat format) {
+        return format == ImageFormat::Png || format == ImageFormat::Qoi;
+    }
+
+    // channels: 1 — строки Grayscale8, 3 или 4 — строки ARGB32 без альфы и с ней.
+    StripFileWriter(const QString &path, int width, int height, int channels, const ImageEncodeOptions &encoding)
+        : file(path) {
+        failed = !file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        if (failed) {
+            return;
+        }
+        if (encoding.format == ImageFormat::Qoi) {
+            qoi.reset(new QoiEncoder(width, height, qMax(3, channels)));
+        } else {
+            png.reset(new PngStreamWriter(&file, width, height, channels, encoding.pngLevel, encoding.pngFilter,
+                                          encoding.parallelDeflate));
+        }
+    }
+
+    ~StripFileWriter() {
+        if (!finished) {
+            discard();
+        }
+    }
+
+    StripFileWriter(const StripFileWriter &) = delete;
+    StripFileWriter &operator=(const StripFileWriter &) = delete;
+
+    bool write(const QImage &rows) {
+        if (failed) {
+            return false;
+        }
+        if (png) {
+            failed = !png->writeRows(rows);
+        } else {
+            TraceScope scope("qoi.encode");
+            qoi->rows(argb32View(rows));
+            const QByteArray data = qoi->take();
+            failed = file.write(data) != data.size();
+        }
+        return !failed;
+    }
+
+    bool finish() {
+        if (!failed) {
+            if (png) {
+                failed = !png->finish();
+            } else {
+                qoi->finish();
+                const QByteArray data = qoi->take();
+                failed = file.write(data) != data.size();
+            }
+        }
+        if (failed) {
+            discard();
+            return false;
+        }
+        finished = true;
+        file.close();
+        return true;
+    }
+
+private:
+    void discard() {
+        png.reset();
+        file.close();
+        file.remove();
+        finished = true;
+    }
+
+    QFile file;
+    std::unique_ptr<PngStreamWriter> png;
+    std::unique_ptr<QoiEncoder> qoi;
+    bool failed = false;
+    bool finished = false;
+};
+
+// Один выход полосовой обработки: фильтр и его файл.
+struct TiledOutput {
+    const FilterSpec *spec = nullptr; // nullptr — без фильтра
+    FilterValues values;
+    QString filePath;
+    BandKernel kernel; // ядро на весь кадр; пустое — готовится на полосу через prepareRows
+    bool stream = false;
+    std::unique_ptr<StripFileWriter> writer;
+};
+
+// Полоса strip со строки y0 через фильтр выхода в кадр из пула.
+static QImage filterStrip(TiledOutput &output, const QImage &strip, int y0, int imageHeight) {
+    if (!output.spec) {
+        return strip;
+    }
+    const int w = strip.width();
+    const int rows = strip.height();
+    QImage result = pooledImage(w, rows, output.spec->outputFormat);
+    const RowTarget out{result.bits(), result.bytesPerLine(), y0};
+    if (output.stream) {
+        // ядро с переносом между полосами само делит полосу между потоками
+        output.kernel(strip, y0, out);
+        return result;
+    }
+    const BandKernel kernel = output.kernel ? output.kernel
+                                            : output.spec->prepareRows(w, imageHeight, y0, y0 + rows, output.values);
+    const uchar *bits = strip.constBits();
+    const int bpl = strip.bytesPerLine();
+    parallelForRows(rows, w, [&](int b0, int b1) {
+        const QImage band(bits + size_t(b0) * bpl, w, b1 - b0, bpl, QImage::Format_ARGB32);
+        kernel(band, y0 + b0, out);
+    });
+    return result;
+}
+
+// Снимок inputPath с каждым фильтром из codes в файлы outputPaths (по одному
+// на код), полосами по stripRows строк (0 — около tiledStripBytes на полосу).
+// Каждая полоса читается один раз и проходит все фильтры. Выходы, которые
+// полосами не пишутся (JPEG, WebP, фильтры с соседями без stream), считаются
+// после этого целым кадром. Возвращает, какие файлы записаны.
+static QList<bool> processImageTiled(const QString &inputPath, const QList<QString> &codes,
+                                     const QStringList &outputPaths, const ImageEncodeOptions &encoding,
+                                     int stripRows = 0) {
+    QList<bool> written;
+    for (int i = 0; i < codes.size(); ++i) {
+        written.append(false);
+    }
+    TraceScope scope("tiled.image", inputPath);
+    QString error;
+    std::unique_ptr<ImageStripSource> source = openImageStrips(inputPath, &error);
+    if (!source) {
+        qWarning() << "Не удалось прочитать" << inputPath << ":" << error;
+        return written;
+    }
+    const int w = source->width();
+    const int h = source->height();
+    const int rowsPerStrip = qMin(h, stripRows > 0 ? stripRows : source->preferredStripRows(tiledStripRows(w)));
+
+    std::vector<TiledOutput> outputs;
+    QList<int> outputIndex; // номер выхода в codes
+    QList<int> wholeFrame;  // номера выходов, которые считаются целым кадром
+    for (int i = 0; i < codes.size(); ++i) {
+        TiledOutput output;
+        output.spec = findFilter(codes.at(i));
+        if (output.spec && output.spec->id == FilterId::None) {
+            output.spec = nullptr;
+        }
+        const bool neighbors = output.spec && output.spec->has(FilterNeedsNeighbors);
+        if (!StripFileWriter::supports(encoding.format) || (neighbors && !output.spec->stream)) {
+            wholeFrame.append(i);
+            continue;
+        }
+        output.filePath = outputPaths.at(i);
+        if (output.spec) {
+            output.values = output.spec->defaults();
+            output.stream = neighbors;
+            if (neighbors) {
+                output.kernel = output.spec->stream(w, h, output.values);
+            } else if (!output.spec->prepareRows) {
+                output.kernel = output.spec->prepare(w, h, output.values);
+            }
+        }
+        const bool gray = output.spec && output.spec->outputFormat == QImage::Format_Grayscale8;
+        const int channels = gray ? 1 : (source->hasAlpha() ? 4 : 3);
+        output.writer.reset(new StripFileWriter(output.filePath, w, h, channels, encoding));
+        outputs.push_back(std::move(output));
+        outputIndex.append(i);
+    }
+
+    bool ok = true;
+    for (int y0 = 0; y0 < h && ok && !outputs.empty(); y0 += rowsPerStrip) {
+        TraceScope stripScope("tiled.strip");
+        const int rows = qMin(rowsPerStrip, h - y0);
+        QImage strip = pooledImage(w, rows, QImage::Format_ARGB32);
+        if (!source->readRows(rows, &strip)) {
+            qWarning() << "Не удалось прочитать" << inputPath << ":" << source->errorString();
+            ok = false;
+            break;
+        }
+        for (TiledOutput &output : outputs) {
+            const QImage filtered = filterStrip(output, strip, y0, h);
+            if (!output.writer->write(filtered)) {
+                qWarning() << "Не удалось записать" << output.filePath;
+                ok = false;
+            }
+        }
+    }
+    for (size_t k = 0; k < outputs.size(); ++k) {
+        // при ok == false writer удаляет недописанный файл сам
+        written[outputIndex.at(int(k))] = ok && outputs[k].writer->finish();
+    }
+    outputs.clear();
+    source.reset();
+
+    if (!wholeFrame.isEmpty()) {
+        qWarning() << "Снимок" << inputPath << "целиком в памяти: формат или фильтр не пишутся полосами";
+        QImageReader reader(inputPath);
+        QImage image;
+        {
+            TraceScope decodeScope("image.decode", inputPath);
+            image = reader.read();
+        }
+        if (image.isNull()) {
+            qWarning() << "Не удалось прочитать" << inputPath << ":" << reader.errorString();
+            return written;
+        }
+        for (int i : wholeFrame) {
+            written[i] = writeImage(applyFilter(image, codes.at(i)), outputPaths.at(i), encoding);
+        }
+    }
+    return written;
+}
+
+// Совпадает ли PNG path, прочитанный своим же декодером, с expected (ARGB32).
+static bool sameAsPng(const QImage &expected, const QString &path) {
+    const int w = expected.width();
+    const int h = expected.height();
+    PngStripSource decoded(path);
+    QImage result = pooledImage(w, h, QImage::Format_ARGB32);
+    bool same = decoded.open() && decoded.width() == w && decoded.height() == h && decoded.readRows(h, &result);
+    for (int y = 0; y < h && same; ++y) {
+        same = std::memcmp(expected.constScanLine(y), result.constScanLine(y), size_t(w) * sizeof(QRgb)) == 0;
+    }
+    return same;
+}
+
+// Проверка полосовой обработки: снимок нечётного размера пишется в PNG, режется
+// на полосы не кратного высоте размера и проходит все фильтры реестра и
+// несколько цепочек; каждый выход, прочитанный своим же декодером, обязан
+// побитово совпасть с applyFilter того же снимка целиком.
+static bool selfTestTiled() {
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        qWarning() << "selftest tiled: нет временного каталога";
+        return false;
+    }
+    QList<QString> codes;
+    for (const FilterSpec *spec : registeredFilters()) {
+        codes.append(spec->code);
+    }
+    for (const QString &expression : {QStringLiteral("теп+вгн:0.8+пдз:4"), QStringLiteral("пдз:3+сеп"),
+                                      QStringLiteral("сеп+сол:100+чб")}) {
+        if (!registerFilterChain(expression, expression, expression, nullptr)) {
+            qWarning() << "selftest tiled: цепочка" << expression << "не разбирается";
+            return false;
+        }
+        codes << expression;
+    }
+
+    std::mt19937 random(24);
+    bool ok = true;
+    const int sizes[][2] = {{211, 97}, {64, 40}};
+    for (int s = 0; s < 2; ++s) {
+        const int w = sizes[s][0];
+        const int h = sizes[s][1];
+        const bool withAlpha = s == 1;
+        QImage source(w, h, QImage::Format_ARGB32);
+        for (int y = 0; y < h; ++y) {
+            QRgb *line = reinterpret_cast<QRgb*>(source.scanLine(y));
+            for (int x = 0; x < w; ++x) {
+                const quint32 noise = random();
+                line[x] = qRgba((x * 255 / w + int(noise & 31)) & 255, (y * 255 / h + int(noise >> 8 & 31)) & 255,
+                                int(noise >> 16 & 255), withAlpha ? int(noise >> 24) : 255);
+            }
+        }
+        const QString sourcePath = QDir(dir.path()).filePath(QStringLiteral("source%1.png").arg(s));
+        ImageEncodeOptions encoding;
+        if (!writeImage(source, sourcePath, encoding)) {
+            qWarning() << "selftest tiled: не записан" << sourcePath;
+            return false;
+        }
+
+        QStringList outputPaths;
+        for (int i = 0; i < codes.size(); ++i) {
+            outputPaths.append(QDir(dir.path()).filePath(QStringLiteral("out%1_%2.png").arg(s).arg(i)));
+        }
+        const QList<bool> written = processImageTiled(sourcePath, codes, outputPaths, encoding, 17);
+        for (int i = 0; i < codes.size(); ++i) {
+            if (!written.at(i) || !sameAsPng(argb32View(applyFilter(source, codes.at(i))), outputPaths.at(i))) {
+                qWarning().noquote() << QStringLiteral("selftest tiled: %1 на %2x%3 расходится с целым кадром")
+                                            .arg(codes.at(i)).arg(w).arg(h);
+                ok = false;
+            }
+        }
+    }
+
+    // Снимок с поворотом в EXIF выходит повёрнутым, как у конвейера. Поворот
+    // пишет только плагин JPEG, поэтому без него проверка пропускается.
+    const QString orientedPath = QDir(dir.path()).filePath(QStringLiteral("oriented.jpg"));
+    QImageWriter writer(orientedPath, "jpeg");
+    if (writer.supportsOption(QImageIOHandler::ImageTransformation)) {
+        QImage source(37, 23, QImage::Format_RGB32);
+        for (int y = 0; y < source.height(); ++y) {
+            for (int x = 0; x < source.width(); ++x) {
+                source.setPixel(x, y, qRgb(x * 7, y * 11, int(random() & 255)));
+            }
+        }
+        writer.setTransformation(QImageIOHandler::TransformationRotate90);
+        const QString outputPath = QDir(dir.path()).filePath(QStringLiteral("oriented.png"));
+        bool same = writer.write(source)
+                    && processImageTiled(orientedPath, QList<QString>() << QStringLiteral("сеп"),
+                                         QStringList() << outputPath, ImageEncodeOptions(), 17).value(0);
+        if (same) {
+            QImageReader reader(orientedPath);
+            reader.setAutoTransform(true);
+            const QImage expected = argb32View(applyFilter(reader.read(), QStringLiteral("сеп")));
+            same = expected.width() == source.height() && sameAsPng(expected, outputPath);
+        }
+        if (!same) {
+            qWarning() << "selftest tiled: поворот из EXIF не применён";
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,330 @@
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Трассировка этапов сохранения и съёмки. Каждый этап оборачивается в
+// TraceScope("png.deflate"); при включённой трассировке его длительность
+// попадает в буфер своего потока (событие для Chrome trace) и в счётчики с
+// гистограммой по имени этапа. Очереди пулов меряются парой traceMark() при
+// постановке и traceSince() при запуске. Выключенная трассировка стоит одно
+// чтение атомарного флага на этап: ни часов, ни блокировок, ни памяти.
+//
+// Включается переменной окружения LAB2_TRACE=файл.json (или --trace в
+// пакетном режиме); файл открывается в chrome://tracing или Perfetto, а
+// сводная таблица печатается при выходе.
+
+static std::atomic<bool> traceOn{false};
+
+// гистограмма по степеням двойки микросекунд: корзина i — до 2^(i+1) мкс
+static const int traceBuckets = 32;
+// дальше события потока не пишутся, счётчики продолжают считаться
+static const size_t traceMaxEventsPerThread = 256 * 1024;
+
+struct TraceEvent {
+    const char *name;
+    qint64 startNs;
+    qint64 durationNs;
+    QString detail;
+};
+
+struct TraceStat {
+    qint64 count = 0;
+    qint64 totalNs = 0;
+    qint64 maxNs = 0;
+    qint64 buckets[traceBuckets] = {};
+
+    void add(qint64 ns) {
+        ++count;
+        totalNs += ns;
+        maxNs = qMax(maxNs, ns);
+        int bucket = 0;
+        for (qint64 us = ns / 2000; us > 0 && bucket < traceBuckets - 1; us >>= 1) {
+            ++bucket;
+        }
+        ++buckets[bucket];
+    }
+
+    void merge(const TraceStat &other) {
+        count += other.count;
+        totalNs += other.totalNs;
+        maxNs = qMax(maxNs, other.maxNs);
+        for (int i = 0; i < traceBuckets; ++i) {
+            buckets[i] += other.buckets[i];
+        }
+    }
+
+    // верхняя граница корзины, в которую попадает доля q событий
+    double percentileMs(double q) const {
+        qint64 seen = 0;
+        for (int i = 0; i < traceBuckets; ++i) {
+            seen += buckets[i];
+            if (seen >= q * count) {
+                return qMin(double(qint64(2) << i) / 1000.0, maxNs / 1e6);
+            }
+        }
+        return maxNs / 1e6;
+    }
+};
+
+// Буфер пишет только свой поток; блокировка нужна лишь против выгрузки.
+struct TraceThreadBuffer {
+    QMutex mutex;
+    int tid = 0;
+    QString name;
+    std::vector<TraceEvent> events;
+    qint64 droppedEvents = 0;
+    std::unordered_map<const char *, TraceStat> stats; // имена — строковые литералы
+};
+
+struct TraceState {
+    QElapsedTimer clock;
+    QMutex mutex;
+    std::vector<std::shared_ptr<TraceThreadBuffer>> threads;
+};
+
+static TraceState &traceState() {
+    static TraceState state;
+    return state;
+}
+
+static inline bool traceEnabled() {
+    return traceOn.load(std::memory_order_relaxed);
+}
+
+static inline qint64 traceNowNs() {
+    return traceState().clock.nsecsElapsed();
+}
+
+static TraceThreadBuffer &traceThreadBuffer() {
+    static thread_local std::shared_ptr<TraceThreadBuffer> buffer;
+    if (!buffer) {
+        buffer = std::make_shared<TraceThreadBuffer>();
+        QThread *thread = QThread::currentThread();
+        TraceState &state = traceState();
+        QMutexLocker locker(&state.mutex);
+        buffer->tid = int(state.threads.size()) + 1;
+        const QCoreApplication *app = QCoreApplication::instance();
+        if (app && thread == app->thread()) {
+            buffer->name = QStringLiteral("main");
+        } else {
+            const QString objectName = thread ? thread->objectName() : QString();
+            buffer->name = QStringLiteral("%1 #%2")
+                               .arg(objectName.isEmpty() ? QStringLiteral("thread") : objectName)
+                               .arg(buffer->tid);
+        }
+        state.threads.push_back(buffer);
+    }
+    return *buffer;
+}
+
+static void traceRecord(const char *name, qint64 startNs, qint64 durationNs, const QString &detail = QString()) {
+    TraceThreadBuffer &buffer = traceThreadBuffer();
+    QMutexLocker locker(&buffer.mutex);
+    buffer.stats[name].add(durationNs);
+    if (buffer.events.size() < traceMaxEventsPerThread) {
+        buffer.events.push_back(TraceEvent{name, startNs, durationNs, detail});
+    } else {
+        ++buffer.droppedEvents;
+    }
+}
+
+// Метка для замера ожидания: -1, если трассировка выключена.
+static inline qint64 traceMark() {
+    return traceEnabled() ? traceNowNs() : -1;
+}
+
+// Записывает этап name от метки mark до текущего момента.
+static inline void traceSince(const char *name, qint64 mark, const QString &detail = QString()) {
+    if (mark >= 0 && traceEnabled()) {
+        traceRecord(name, mark, traceNowNs() - mark, detail);
+    }
+}
+
+class TraceScope {
+public:
+    explicit TraceScope(const char *name) : name(traceEnabled() ? name : nullptr), start(this->name ? traceNowNs() : 0) {}
+    TraceScope(const char *name, const QString &detail) : TraceScope(name) {
+        if (this->name) {
+            this->detail = detail;
+        }
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    ~TraceScope() {
+        if (name) {
+            traceRecord(name, start, traceNowNs() - start, detail);
+        }
+    }
+
+    // дорогую подпись стоит собирать только при active()
+    bool active() const {
+        return name != nullptr;
+    }
+    void setDetail(const QString &value) {
+        if (name) {
+            detail = value;
+        }
+    }
+
+private:
+    const char *name;
+    qint64 start;
+    QString detail;
+};
+
+static void startTracing() {
+    TraceState &state = traceState();
+    {
+        QMutexLocker locker(&state.mutex);
+        if (!state.clock.isValid()) {
+            state.clock.start();
+        }
+    }
+    traceOn.store(true);
+}
+
+static void stopTracing() {
+    traceOn.store(false);
+}
+
+static QByteArray traceJsonString(const QString &text) {
+    QByteArray out = "\"";
+    for (const char c : text.toUtf8()) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (uchar(c) < 0x20) {
+            out += QByteArray("\\u00") + QByteArray::number(uchar(c), 16).rightJustified(2, '0');
+        } else {
+            out += c;
+        }
+    }
+    return out + '"';
+}
+
+// Все события в формате Chrome trace (JSON Array/Object Format, события "X").
+static QByteArray traceChromeJson() {
+    std::vector<std::shared_ptr<TraceThreadBuffer>> threads;
+    {
+        TraceState &state = traceState();
+        QMutexLocker locker(&state.mutex);
+        threads = state.threads;
+    }
+
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto separator = [&]() {
+        if (!first) {
+            json += ",\n";
+        }
+        first = false;
+    };
+    for (const std::shared_ptr<TraceThreadBuffer> &buffer : threads) {
+        QMutexLocker locker(&buffer->mutex);
+        separator();
+        json += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" + QByteArray::number(buffer->tid)
+                + ",\"args\":{\"name\":" + traceJsonString(buffer->name) + "}}";
+        for (const TraceEvent &event : buffer->events) {
+            separator();
+            json += "{\"ph\":\"X\",\"pid\":1,\"tid\":" + QByteArray::number(buffer->tid)
+                    + ",\"name\":" + traceJsonString(QString::fromLatin1(event.name))
+                    + ",\"ts\":" + QByteArray::number(event.startNs / 1000.0, 'f', 3)
+                    + ",\"dur\":" + QByteArray::number(event.durationNs / 1000.0, 'f', 3);
+            if (!event.detail.isEmpty()) {
+                json += ",\"args\":{\"detail\":" + traceJsonString(event.detail) + "}";
+            }
+            json += "}";
+        }
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+static bool writeChromeTrace(const QString &filePath) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    const QByteArray json = traceChromeJson();
+    return file.write(json) == json.size();
+}
+
+// Сводка по этапам: число, сумма, среднее, p50/p95 (с точностью до корзины) и максимум.
+static QString traceSummary() {
+    std::vector<std::shared_ptr<TraceThreadBuffer>> threads;
+    {
+        TraceState &state = traceState();
+        QMutexLocker locker(&state.mutex);
+        threads = state.threads;
+    }
+
+    QMap<QString, TraceStat> merged; // по имени: одинаковые литералы могут лежать по разным адресам
+    qint64 dropped = 0;
+    for (const std::shared_ptr<TraceThreadBuffer> &buffer : threads) {
+        QMutexLocker locker(&buffer->mutex);
+        for (const auto &entry : buffer->stats) {
+            merged[QString::fromLatin1(entry.first)].merge(entry.second);
+        }
+        dropped += buffer->droppedEvents;
+    }
+
+    QStringList lines;
+    lines << QStringLiteral("%1 %2 %3 %4 %5 %6 %7")
+                 .arg(QStringLiteral("stage"), -24)
+                 .arg(QStringLiteral("count"), 8)
+                 .arg(QStringLiteral("total ms"), 11)
+                 .arg(QStringLiteral("mean ms"), 9)
+                 .arg(QStringLiteral("p50 ms"), 9)
+                 .arg(QStringLiteral("p95 ms"), 9)
+                 .arg(QStringLiteral("max ms"), 9);
+    for (auto it = merged.constBegin(); it != merged.constEnd(); ++it) {
+        const TraceStat &stat = it.value();
+        lines << QStringLiteral("%1 %2 %3 %4 %5 %6 %7")
+                     .arg(it.key(), -24)
+                     .arg(stat.count, 8)
+                     .arg(stat.totalNs / 1e6, 11, 'f', 1)
+                     .arg(stat.totalNs / 1e6 / qMax<qint64>(1, stat.count), 9, 'f', 3)
+                     .arg(stat.percentileMs(0.5), 9, 'f', 3)
+                     .arg(stat.percentileMs(0.95), 9, 'f', 3)
+                     .arg(stat.maxNs / 1e6, 9, 'f', 3);
+    }
+    if (dropped > 0) {
+        lines << QStringLiteral("(%1 событий не попали в trace: буферы потоков заполнены)").arg(dropped);
+    }
+    return lines.join(QLatin1Char('\n'));
+}
+
+// Включает трассировку, если задана LAB2_TRACE; возвращает путь для trace.
+static QString startTracingFromEnvironment() {
+    const QString path = QString::fromLocal8Bit(qgetenv("LAB2_TRACE"));
+    if (!path.isEmpty()) {
+        startTracing();
+    }
+    return path;
+}
+
+// Выгружает trace в filePath и печатает сводку; ничего не делает, если трассировка не включалась.
+static void finishTracing(const QString &filePath) {
+    if (filePath.isEmpty() || !traceState().clock.isValid()) {
+        return;
+    }
+    stopTracing();
+    if (!writeChromeTrace(filePath)) {
+        qWarning() << "Не удалось записать trace" << filePath;
+    }
+    qInfo().noquote() << traceSummary();
+}
@@ -0,0 +1,166 @@
+#include <QAbstractVideoSurface>
+#include <QElapsedTimer>
+#include <QLabel>
+#include <QPixmap>
+#include <QPointer>
+#include <QVideoFrame>
+#include <QVideoSurfaceFormat>
+#include <QtConcurrent>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Полная копия кадра камеры. Буфер снимка (CaptureToBuffer) бывает и в JPEG —
+// тогда он декодируется прямо из памяти.
+static QImage imageFromVideoFrame(const QVideoFrame &frame) {
+    QVideoFrame mapped(frame);
+    if (!mapped.map(QAbstractVideoBuffer::ReadOnly)) {
+        return QImage();
+    }
+    QImage result;
+    if (mapped.pixelFormat() == QVideoFrame::Format_Jpeg) {
+        result = QImage::fromData(mapped.bits(), mapped.mappedBytes(), "JPG");
+    } else {
+        const QImage::Format format = QVideoFrame::imageFormatFromPixelFormat(mapped.pixelFormat());
+        if (format != QImage::Format_Invalid) {
+            result = QImage(mapped.bits(), mapped.width(), mapped.height(), mapped.bytesPerLine(), format).copy();
+        }
+    }
+    mapped.unmap();
+    return result;
+}
+
+// Живой предпросмотр с фильтром. Камера отдаёт кадры в LiveFilterSurface
+// вместо QCameraViewfinder; кадр сразу уменьшается до размера предпросмотра,
+// фильтруется в пуле и показывается в QLabel. В работе всегда не больше одного
+// кадра: пока он не показан, новые кадры отбрасываются, а не копятся в очереди,
+// поэтому задержка не растёт. Ширина предпросмотра подстраивается под бюджет
+// кадра: фильтр не успевает — кадр уменьшается, успевает с запасом — растёт.
+
+static const int liveFrameBudgetMs = 25; // из 33 мс кадра при 30 fps, остальное — копирование и отрисовка
+static const int liveMinWidth = 160;
+static const int liveMaxWidth = 1280;
+
+struct LiveFilterState {
+    std::atomic<bool> busy{false};
+    std::atomic<int> width{liveMaxWidth}; // текущая ширина предпросмотра
+
+    // дальше — только из потока приложения
+    QElapsedTimer fpsTimer;
+    int shownFrames = 0;
+    int droppedFrames = 0;
+
+    // Подстройка ширины по времени фильтра; площадь растёт квадратично, поэтому шаги мелкие.
+    void adapt(qint64 elapsedMs) {
+        const int current = width.load();
+        if (elapsedMs > liveFrameBudgetMs) {
+            width.store(qMax(liveMinWidth, current * 4 / 5));
+        } else if (elapsedMs * 2 < liveFrameBudgetMs) {
+            width.store(qMin(liveMaxWidth, current * 11 / 10 + 1));
+        }
+    }
+};
+
+class LiveFilterSurface : public QAbstractVideoSurface {
+public:
+    // currentFilter вызывается на каждый кадр в потоке приложения; fpsChanged —
+    // раз в секунду с частотой показанных кадров.
+    LiveFilterSurface(QLabel *target, std::function<QString()> currentFilter,
+                      std::function<void(double fps, int dropped)> fpsChanged, QObject *parent = nullptr)
+        : QAbstractVideoSurface(parent), target(target), currentFilter(std::move(currentFilter)),
+          fpsChanged(std::move(fpsChanged)), state(std::make_shared<LiveFilterState>()) {}
+
+    QList<QVideoFrame::PixelFormat> supportedPixelFormats(
+        QAbstractVideoBuffer::HandleType handleType = QAbstractVideoBuffer::NoHandle) const override {
+        if (handleType != QAbstractVideoBuffer::NoHandle) {
+            return QList<QVideoFrame::PixelFormat>();
+        }
+        // форматы, которые QImage читает без перепаковки
+        return QList<QVideoFrame::PixelFormat>()
+               << QVideoFrame::Format_RGB32
+               << QVideoFrame::Format_ARGB32
+               << QVideoFrame::Format_ARGB32_Premultiplied
+               << QVideoFrame::Format_RGB24
+               << QVideoFrame::Format_RGB565;
+    }
+
+    bool present(const QVideoFrame &frame) override {
+        if (state->busy.load()) {
+            ++state->droppedFrames; // прошлый кадр ещё в работе: этот устарел бы к показу
+            return true;
+        }
+
+        // кадр держит только задача: без второй ссылки фильтр меняет его на месте
+        auto image = std::make_shared<QImage>(previewImage(frame));
+        if (image->isNull()) {
+            return true;
+        }
+        const QString code = currentFilter ? currentFilter() : QString();
+        if (!state->fpsTimer.isValid()) {
+            state->fpsTimer.start();
+        }
+
+        state->busy.store(true);
+        std::shared_ptr<LiveFilterState> shared = state;
+        QPointer<QLabel> label(target);
+        std::function<void(double, int)> report = fpsChanged;
+        QtConcurrent::run([shared, label, report, image, code]() {
+            QElapsedTimer timer;
+            timer.start();
+            const QImage filtered = code.isEmpty() ? *image : applyFilter(std::move(*image), code);
+            shared->adapt(timer.elapsed());
+
+            runInApplicationThread([shared, label, report, filtered]() {
+                if (label) {
+                    QPixmap pixmap = QPixmap::fromImage(filtered);
+                    if (pixmap.width() < label->width() && pixmap.height() < label->height()) {
+                        pixmap = pixmap.scaled(label->size(), Qt::KeepAspectRatio, Qt::FastTransformation);
+                    }
+                    label->setPixmap(pixmap);
+                }
+                ++shared->shownFrames;
+                const qint64 elapsed = shared->fpsTimer.elapsed();
+                if (elapsed >= 1000) {
+                    if (report) {
+                        report(shared->shownFrames * 1000.0 / elapsed, shared->droppedFrames);
+                    }
+                    shared->shownFrames = 0;
+                    shared->droppedFrames = 0;
+                    shared->fpsTimer.restart();
+                }
+                shared->busy.store(false);
+            });
+        });
+        return true;
+    }
+
+private:
+    // Копия кадра, уже уменьшенная до текущей ширины предпросмотра. Память кадра
+    // после present() принадлежит камере, поэтому копируем до unmap().
+    QImage previewImage(const QVideoFrame &frame) const {
+        QVideoFrame mapped(frame);
+        if (!mapped.map(QAbstractVideoBuffer::ReadOnly)) {
+            return QImage();
+        }
+        const QImage::Format format = QVideoFrame::imageFormatFromPixelFormat(mapped.pixelFormat());
+        QImage result;
+        if (format != QImage::Format_Invalid) {
+            const QImage view(mapped.bits(), mapped.width(), mapped.height(), mapped.bytesPerLine(), format);
+            const int width = qMin(view.width(), target ? qMin(target->width(), state->width.load()) : state->width.load());
+            // без уменьшения копия берётся из пула сразу в ARGB32 — в нём фильтры работают на месте
+            result = width < view.width() ? view.scaledToWidth(qMax(1, width), Qt::FastTransformation)
+                                          : pooledArgb32Copy(view);
+            if (surfaceFormat().scanLineDirection() == QVideoSurfaceFormat::BottomToTop) {
+                result = result.mirrored();
+            }
+        }
+        mapped.unmap();
+        return result;
+    }
+
+    QPointer<QLabel> target;
+    std::function<QString()> currentFilter;
+    std::function<void(double fps, int dropped)> fpsChanged;
+    std::shared_ptr<LiveFilterState> state;
+};